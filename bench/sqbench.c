@@ -0,0 +1,834 @@
+// sqbench: event-storm benchmark for sqwatch.
+//
+// Builds a synthetic tree, runs sqwatch on it under a pseudo-terminal (so
+// its output is line buffered, as it is for a user) and drives bursts of
+// file operations at a set rate. Measures the startup scan, the time from
+// each operation to sqwatch reacting to it, the highest event rate that
+// does not overflow the kernel queue, and RSS. Results are written as JSON
+// so runs can be compared across commits.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <limits.h>
+#include <pthread.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READY_TIMEOUT_NS (30LL * 1000000000LL)
+#define DRAIN_TIMEOUT_NS (2LL * 1000000000LL)
+#define STEP_NS 1000000000LL
+#define LINE_MAX_LEN 8192
+
+typedef struct {
+  const char *sqwatch;
+  const char *out;
+  const char *label;
+  const char *dir;
+  int depth;
+  int fanout;
+  int files;           // per directory
+  size_t file_size;    // average; sizes spread from half to 1.5x
+  int ops;             // operations per latency phase
+  int burst;           // operations issued back to back
+  double rate;         // operations per second, averaged over bursts
+  double max_rate;     // highest rate the overflow ramp tries
+  int keep;
+} bench_options;
+
+typedef enum {
+  OP_MODIFY,
+  OP_CREATE,
+  OP_DELETE,
+  OP_RENAME,  // write a temp file, rename it over the target
+  OP_KIND_COUNT,
+} op_kind;
+
+static const char *const op_names[OP_KIND_COUNT] = {"modify", "create",
+                                                    "delete", "rename"};
+static const char op_tags[OP_KIND_COUNT] = {'m', 'c', 'd', 'r'};
+
+// What sqwatch -v prints once it has handled each kind of operation
+static const char *const op_markers[OP_KIND_COUNT] = {
+    "+ Trigger on ", "+ Added watch for new file: ",
+    "+ File no longer exists: ", "+ Trigger on "};
+
+typedef struct {
+  uint64_t dirs;
+  uint64_t files;
+  uint64_t bytes;
+} tree_stats;
+
+typedef struct {
+  int ops;
+  int missed;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double max_us;
+  double mean_us;
+} latency_stats;
+
+typedef struct {
+  double rate;         // asked for
+  double achieved;     // events written per second
+  double triggers;     // triggers printed per second
+  int overflow;
+} storm_step;
+
+// A running sqwatch and the thread reading its terminal
+typedef struct {
+  pid_t pid;
+  int master;
+  pthread_t reader;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  const char *storm_dir;
+  int scanned;
+  double scan_ms;
+  int probed;
+  uint64_t overflows;
+  uint64_t triggers;
+  // Current latency phase; count is 0 between phases
+  op_kind kind;
+  int64_t *seen;
+  int count;
+  int matched;
+} watcher;
+
+static int64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t deadline) {
+  struct timespec ts = {deadline / 1000000000LL, deadline % 1000000000LL};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+static void deadline_ts(int64_t deadline, struct timespec *ts) {
+  ts->tv_sec = deadline / 1000000000LL;
+  ts->tv_nsec = deadline % 1000000000LL;
+}
+
+static int write_text(const char *path, size_t size, unsigned *seed,
+                      int flags) {
+  int fd = open(path, flags | O_WRONLY | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return -1;
+  }
+  char line[80];
+  size_t written = 0;
+  while (written < size) {
+    int n = snprintf(line, sizeof(line), "line %zu value %u\n", written,
+                     rand_r(seed));
+    size_t chunk = (size_t)n < size - written ? (size_t)n : size - written;
+    if (write(fd, line, chunk) != (ssize_t)chunk) {
+      close(fd);
+      return -1;
+    }
+    written += chunk;
+  }
+  return close(fd);
+}
+
+static size_t pick_size(const bench_options *o, unsigned *seed) {
+  size_t half = o->file_size / 2;
+  return half + (o->file_size ? (size_t)rand_r(seed) % (o->file_size + 1) : 0);
+}
+
+static int make_tree(const char *dir, int depth, const bench_options *o,
+                     tree_stats *t, unsigned *seed) {
+  char path[PATH_MAX];
+  for (int f = 0; f < o->files; f++) {
+    snprintf(path, sizeof(path), "%s/file-%d.txt", dir, f);
+    size_t size = pick_size(o, seed);
+    if (write_text(path, size, seed, O_CREAT | O_TRUNC) != 0) {
+      perror(path);
+      return -1;
+    }
+    t->files++;
+    t->bytes += size;
+  }
+  if (depth == 0) {
+    return 0;
+  }
+  for (int d = 0; d < o->fanout; d++) {
+    snprintf(path, sizeof(path), "%s/dir-%d", dir, d);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+      perror(path);
+      return -1;
+    }
+    t->dirs++;
+    if (make_tree(path, depth - 1, o, t, seed) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Files the storm phases operate on, named <tag>-<n>
+static void storm_path(const char *storm_dir, char tag, int n, char *out,
+                       size_t len) {
+  snprintf(out, len, "%s/%c-%d", storm_dir, tag, n);
+}
+
+static int make_storm_files(const char *storm_dir, const bench_options *o,
+                            unsigned *seed) {
+  char path[PATH_MAX];
+  const char tags[] = {'m', 'd', 'r'};
+  for (size_t t = 0; t < sizeof(tags); t++) {
+    for (int n = 0; n < o->ops; n++) {
+      storm_path(storm_dir, tags[t], n, path, sizeof(path));
+      if (write_text(path, o->file_size, seed, O_CREAT | O_TRUNC) != 0) {
+        perror(path);
+        return -1;
+      }
+    }
+  }
+  // Left over from an earlier run in the same --dir
+  for (int n = 0; n < o->ops; n++) {
+    storm_path(storm_dir, 'c', n, path, sizeof(path));
+    unlink(path);
+  }
+  snprintf(path, sizeof(path), "%s/probe", storm_dir);
+  return write_text(path, 1, seed, O_CREAT | O_TRUNC);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag,
+                        struct FTW *ftw) {
+  (void)st;
+  (void)flag;
+  (void)ftw;
+  remove(path);
+  return 0;
+}
+
+static long read_status_kb(pid_t pid, const char *field) {
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return -1;
+  }
+  char line[256];
+  long kb = -1;
+  size_t len = strlen(field);
+  while (fgets(line, sizeof(line), f)) {
+    if (strncmp(line, field, len) == 0 && line[len] == ':') {
+      kb = strtol(line + len + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return kb;
+}
+
+// Drop colour escapes and the terminal's carriage returns
+static void strip_line(char *line) {
+  char *out = line;
+  for (char *p = line; *p; p++) {
+    if (*p == '\033' && p[1] == '[') {
+      p += 2;
+      while (*p && !((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))) {
+        p++;
+      }
+      if (!*p) {
+        break;
+      }
+      continue;
+    }
+    if (*p != '\r') {
+      *out++ = *p;
+    }
+  }
+  *out = '\0';
+}
+
+// Match a reaction line against the storm file it names
+static void match_op(watcher *w, const char *path, int64_t now) {
+  size_t dir_len = strlen(w->storm_dir);
+  if (strncmp(path, w->storm_dir, dir_len) != 0 || path[dir_len] != '/') {
+    return;
+  }
+  const char *name = path + dir_len + 1;
+  if (strcmp(name, "probe") == 0) {
+    w->probed = 1;
+    return;
+  }
+  char tag;
+  int n;
+  int end = 0;
+  if (w->count == 0 || sscanf(name, "%c-%d%n", &tag, &n, &end) != 2 ||
+      name[end] != '\0' || tag != op_tags[w->kind] || n < 0 ||
+      n >= w->count || w->seen[n] != 0) {
+    return;
+  }
+  w->seen[n] = now;
+  w->matched++;
+}
+
+static void handle_line(watcher *w, char *line, int64_t now) {
+  strip_line(line);
+  pthread_mutex_lock(&w->lock);
+  const char *scanned = strstr(line, "+ Scanned ");
+  const char *in;
+  if (scanned && (in = strstr(scanned, " in ")) != NULL) {
+    w->scan_ms += strtod(in + 4, NULL);
+    w->scanned = 1;
+  } else if (strstr(line, "Event queue overflow")) {
+    w->overflows++;
+  }
+
+  const char *marker = op_markers[w->count ? w->kind : OP_MODIFY];
+  const char *at = strstr(line, marker);
+  int is_trigger = strstr(line, "+ Trigger on ") != NULL;
+  if (is_trigger) {
+    w->triggers++;
+  }
+  if (at) {
+    char *path = (char *)at + strlen(marker);
+    char *end = strstr(path, ": [");
+    if (end) {
+      *end = '\0';
+    }
+    match_op(w, path, now);
+  }
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+}
+
+static void *reader_main(void *arg) {
+  watcher *w = arg;
+  char buf[4096];
+  char line[LINE_MAX_LEN];
+  size_t len = 0;
+  for (;;) {
+    ssize_t n = read(w->master, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;  // EIO once sqwatch has exited
+    }
+    int64_t now = now_ns();
+    for (ssize_t i = 0; i < n; i++) {
+      if (buf[i] == '\n') {
+        line[len] = '\0';
+        handle_line(w, line, now);
+        len = 0;
+      } else if (len < sizeof(line) - 1) {
+        line[len++] = buf[i];
+      }
+    }
+  }
+  pthread_mutex_lock(&w->lock);
+  w->pid = -w->pid;  // marks the watcher gone
+  pthread_cond_broadcast(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+static int watcher_start(watcher *w, const bench_options *o, const char *root,
+                         const char *storm_dir, int verbose) {
+  memset(w, 0, sizeof(*w));
+  w->storm_dir = storm_dir;
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&w->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  pid_t pid = forkpty(&w->master, NULL, NULL, NULL);
+  if (pid < 0) {
+    perror("forkpty");
+    return -1;
+  }
+  if (pid == 0) {
+    char *args[] = {(char *)o->sqwatch, "-q", "all", "-t", "0", "-d",
+                    (char *)root, verbose ? "-v" : NULL, NULL};
+    execv(o->sqwatch, args);
+    perror(o->sqwatch);
+    _exit(127);
+  }
+  w->pid = pid;
+  if (pthread_create(&w->reader, NULL, reader_main, w) != 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  return 0;
+}
+
+static void watcher_stop(watcher *w) {
+  pthread_mutex_lock(&w->lock);
+  pid_t pid = w->pid > 0 ? w->pid : -w->pid;
+  pthread_mutex_unlock(&w->lock);
+  kill(pid, SIGINT);
+  waitpid(pid, NULL, 0);
+  pthread_join(w->reader, NULL);
+  close(w->master);
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->lock);
+}
+
+// Wait until pred holds or the deadline passes; called with the lock held
+#define WAIT_UNTIL(w, pred, deadline)                                       \
+  do {                                                                      \
+    struct timespec ts_;                                                    \
+    deadline_ts((deadline), &ts_);                                          \
+    while (!(pred) && (w)->pid > 0 &&                                       \
+           pthread_cond_timedwait(&(w)->cond, &(w)->lock, &ts_) == 0) {     \
+    }                                                                       \
+  } while (0)
+
+// Ready once the scan is reported and a change to the probe file triggers
+static int wait_ready(watcher *w, int64_t start, double *ready_ms) {
+  int64_t deadline = start + READY_TIMEOUT_NS;
+  pthread_mutex_lock(&w->lock);
+  WAIT_UNTIL(w, w->scanned, deadline);
+  int scanned = w->scanned;
+  pthread_mutex_unlock(&w->lock);
+  if (!scanned) {
+    return -1;
+  }
+
+  char probe[PATH_MAX];
+  snprintf(probe, sizeof(probe), "%s/probe", w->storm_dir);
+  unsigned seed = 1;
+  int probed = 0;
+  while (!probed && now_ns() < deadline) {
+    write_text(probe, 1, &seed, O_APPEND);
+    pthread_mutex_lock(&w->lock);
+    WAIT_UNTIL(w, w->probed, now_ns() + 10000000LL);
+    probed = w->probed;
+    pthread_mutex_unlock(&w->lock);
+  }
+  *ready_ms = (now_ns() - start) / 1e6;
+  return probed ? 0 : -1;
+}
+
+static int do_op(const char *storm_dir, op_kind kind, int n, unsigned *seed,
+                 size_t size) {
+  char path[PATH_MAX];
+  storm_path(storm_dir, op_tags[kind], n, path, sizeof(path));
+  switch (kind) {
+  case OP_MODIFY:
+    return write_text(path, 32, seed, O_APPEND);
+  case OP_CREATE:
+    return write_text(path, size, seed, O_CREAT | O_EXCL);
+  case OP_DELETE:
+    return unlink(path);
+  case OP_RENAME: {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/t-%d.tmp", storm_dir, n);
+    if (write_text(tmp, size, seed, O_CREAT | O_TRUNC) != 0) {
+      return -1;
+    }
+    return rename(tmp, path);
+  }
+  default:
+    return -1;
+  }
+}
+
+static int compare_i64(const void *a, const void *b) {
+  int64_t x = *(const int64_t *)a;
+  int64_t y = *(const int64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile_us(const int64_t *sorted, int n, double p) {
+  if (n == 0) {
+    return 0;
+  }
+  int i = (int)(p * (n - 1) + 0.5);
+  return sorted[i] / 1e3;
+}
+
+// Issue o->ops operations of one kind in bursts of o->burst, spaced so
+// they average o->rate per second, and time each until sqwatch reacts
+static void run_phase(watcher *w, op_kind kind, const bench_options *o,
+                      latency_stats *stats) {
+  int64_t *sent = calloc(o->ops, sizeof(int64_t));
+  int64_t *seen = calloc(o->ops, sizeof(int64_t));
+  memset(stats, 0, sizeof(*stats));
+  stats->ops = o->ops;
+  if (!sent || !seen) {
+    free(sent);
+    free(seen);
+    stats->missed = o->ops;
+    return;
+  }
+  pthread_mutex_lock(&w->lock);
+  w->kind = kind;
+  w->seen = seen;
+  w->matched = 0;
+  w->count = o->ops;
+  pthread_mutex_unlock(&w->lock);
+
+  unsigned seed = (unsigned)kind + 7;
+  int64_t start = now_ns();
+  for (int i = 0; i < o->ops; i++) {
+    sleep_until(start + (int64_t)((i / o->burst) * o->burst * 1e9 / o->rate));
+    sent[i] = now_ns();
+    if (do_op(w->storm_dir, kind, i, &seed, o->file_size) != 0) {
+      sent[i] = 0;
+    }
+  }
+
+  pthread_mutex_lock(&w->lock);
+  WAIT_UNTIL(w, w->matched == w->count, now_ns() + DRAIN_TIMEOUT_NS);
+  w->count = 0;
+  pthread_mutex_unlock(&w->lock);
+
+  int64_t *latency = malloc(o->ops * sizeof(int64_t));
+  int n = 0;
+  double total = 0;
+  for (int i = 0; latency && i < o->ops; i++) {
+    if (sent[i] && seen[i]) {
+      latency[n] = seen[i] > sent[i] ? seen[i] - sent[i] : 0;
+      total += latency[n];
+      n++;
+    }
+  }
+  if (latency) {
+    qsort(latency, n, sizeof(int64_t), compare_i64);
+  }
+  stats->missed = o->ops - n;
+  stats->p50_us = percentile_us(latency, n, 0.50);
+  stats->p90_us = percentile_us(latency, n, 0.90);
+  stats->p99_us = percentile_us(latency, n, 0.99);
+  stats->max_us = n ? latency[n - 1] / 1e3 : 0;
+  stats->mean_us = n ? total / n / 1e3 : 0;
+  free(latency);
+  free(sent);
+  free(seen);
+}
+
+// Modify storm at doubling rates until sqwatch reports a queue overflow,
+// the writer cannot go any faster, or max_rate is passed
+static size_t run_storm(watcher *w, const bench_options *o, storm_step *steps,
+                        size_t max_steps) {
+  int *fds = malloc(o->ops * sizeof(int));
+  if (!fds) {
+    return 0;
+  }
+  char path[PATH_MAX];
+  for (int i = 0; i < o->ops; i++) {
+    storm_path(w->storm_dir, 'm', i, path, sizeof(path));
+    fds[i] = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+  }
+
+  size_t count = 0;
+  for (double rate = o->rate; rate <= o->max_rate && count < max_steps;
+       rate *= 2) {
+    pthread_mutex_lock(&w->lock);
+    uint64_t overflows = w->overflows;
+    uint64_t triggers = w->triggers;
+    pthread_mutex_unlock(&w->lock);
+
+    // Pace per millisecond rather than per write
+    int64_t start = now_ns();
+    int64_t end = start + STEP_NS;
+    uint64_t written = 0;
+    for (int64_t tick = start; tick < end; tick += 1000000LL) {
+      sleep_until(tick);
+      uint64_t due = (uint64_t)((tick - start + 1000000LL) / 1e9 * rate);
+      while (written < due && now_ns() < tick + 1000000LL) {
+        int fd = fds[written % (uint64_t)o->ops];
+        if (fd >= 0 && write(fd, "x\n", 2) != 2) {
+          break;
+        }
+        written++;
+      }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    sleep_until(now_ns() + 200000000LL);  // let it drain
+
+    storm_step *step = &steps[count++];
+    step->rate = rate;
+    step->achieved = written / elapsed;
+    pthread_mutex_lock(&w->lock);
+    step->overflow = w->overflows > overflows;
+    step->triggers = (w->triggers - triggers) / elapsed;
+    int gone = w->pid <= 0;
+    pthread_mutex_unlock(&w->lock);
+    if (step->overflow || gone || step->achieved < rate * 0.9) {
+      break;
+    }
+  }
+  for (int i = 0; i < o->ops; i++) {
+    if (fds[i] >= 0) {
+      close(fds[i]);
+    }
+  }
+  free(fds);
+  return count;
+}
+
+static void print_latency(FILE *out, const latency_stats *s, int last) {
+  fprintf(out,
+          "{\"ops\": %d, \"missed\": %d, \"p50\": %.1f, \"p90\": %.1f, "
+          "\"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f}%s\n",
+          s->ops, s->missed, s->p50_us, s->p90_us, s->p99_us, s->max_us,
+          s->mean_us, last ? "" : ",");
+}
+
+static int write_results(const bench_options *o, const tree_stats *tree,
+                         double scan_ms, double ready_ms, long rss_idle,
+                         long rss_storm, long rss_latency,
+                         const storm_step *steps, size_t step_count,
+                         const latency_stats *latency) {
+  FILE *out = strcmp(o->out, "-") == 0 ? stdout : fopen(o->out, "w");
+  if (!out) {
+    perror(o->out);
+    return -1;
+  }
+  char stamp[32];
+  time_t t = time(NULL);
+  strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+  double sustained = 0;
+  double overflow_at = 0;
+  for (size_t i = 0; i < step_count; i++) {
+    if (steps[i].overflow) {
+      overflow_at = steps[i].achieved;
+    } else if (steps[i].achieved > sustained) {
+      sustained = steps[i].achieved;
+    }
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"label\": \"%s\",\n", o->label);
+  fprintf(out, "  \"timestamp\": \"%s\",\n", stamp);
+  fprintf(out, "  \"cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+  fprintf(out,
+          "  \"options\": {\"depth\": %d, \"fanout\": %d, \"files\": %d, "
+          "\"file_size\": %zu, \"ops\": %d, \"burst\": %d, \"rate\": %.0f, "
+          "\"max_rate\": %.0f},\n",
+          o->depth, o->fanout, o->files, o->file_size, o->ops, o->burst,
+          o->rate, o->max_rate);
+  fprintf(out,
+          "  \"tree\": {\"dirs\": %llu, \"files\": %llu, \"bytes\": %llu},\n",
+          (unsigned long long)tree->dirs, (unsigned long long)tree->files,
+          (unsigned long long)tree->bytes);
+  fprintf(out, "  \"startup\": {\"scan_ms\": %.1f, \"ready_ms\": %.1f},\n",
+          scan_ms, ready_ms);
+  fprintf(out, "  \"latency_us\": {\n");
+  for (int k = 0; k < OP_KIND_COUNT; k++) {
+    fprintf(out, "    \"%s\": ", op_names[k]);
+    print_latency(out, &latency[k], k == OP_KIND_COUNT - 1);
+  }
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"storm\": {\n    \"steps\": [\n");
+  for (size_t i = 0; i < step_count; i++) {
+    fprintf(out,
+            "      {\"rate\": %.0f, \"achieved\": %.0f, \"triggers\": %.0f, "
+            "\"overflow\": %s}%s\n",
+            steps[i].rate, steps[i].achieved, steps[i].triggers,
+            steps[i].overflow ? "true" : "false",
+            i + 1 < step_count ? "," : "");
+  }
+  fprintf(out, "    ],\n");
+  fprintf(out, "    \"events_per_sec_without_overflow\": %.0f,\n", sustained);
+  if (overflow_at > 0) {
+    fprintf(out, "    \"overflow_at_events_per_sec\": %.0f\n", overflow_at);
+  } else {
+    fprintf(out, "    \"overflow_at_events_per_sec\": null\n");
+  }
+  fprintf(out, "  },\n");
+  fprintf(out,
+          "  \"rss_kb\": {\"after_scan\": %ld, \"peak_storm\": %ld, "
+          "\"peak_latency\": %ld}\n",
+          rss_idle, rss_storm, rss_latency);
+  fprintf(out, "}\n");
+  return out == stdout ? 0 : fclose(out);
+}
+
+static void print_usage(void) {
+  printf("Usage: sqbench [options]\n");
+  printf("  --sqwatch path    sqwatch binary (default: ./sqwatch)\n");
+  printf("  --out file        JSON results, - for stdout (default: bench/results.json)\n");
+  printf("  --label text      Recorded with the results, e.g. a commit\n");
+  printf("  --dir path        Where to build the tree (default: a new directory in $TMPDIR)\n");
+  printf("  --depth n         Directory levels below the root (default: 3)\n");
+  printf("  --fanout n        Subdirectories per directory (default: 4)\n");
+  printf("  --files n         Files per directory (default: 8)\n");
+  printf("  --file-size n     Average file size in bytes (default: 4096)\n");
+  printf("  --ops n           Operations per latency phase (default: 500)\n");
+  printf("  --burst n         Operations issued back to back (default: 10)\n");
+  printf("  --rate n          Operations per second (default: 1000)\n");
+  printf("  --max-rate n      Highest rate of the overflow ramp (default: 1024000)\n");
+  printf("  --keep            Leave the generated tree in place\n");
+}
+
+int main(int argc, char *argv[]) {
+  bench_options o = {
+      .sqwatch = "./sqwatch",
+      .out = "bench/results.json",
+      .label = "",
+      .depth = 3,
+      .fanout = 4,
+      .files = 8,
+      .file_size = 4096,
+      .ops = 500,
+      .burst = 10,
+      .rate = 1000,
+      .max_rate = 1024000,
+  };
+  static struct option long_options[] = {
+      {"sqwatch", required_argument, 0, 's'},
+      {"out", required_argument, 0, 'o'},
+      {"label", required_argument, 0, 'l'},
+      {"dir", required_argument, 0, 'D'},
+      {"depth", required_argument, 0, 'd'},
+      {"fanout", required_argument, 0, 'f'},
+      {"files", required_argument, 0, 'n'},
+      {"file-size", required_argument, 0, 'z'},
+      {"ops", required_argument, 0, 'p'},
+      {"burst", required_argument, 0, 'b'},
+      {"rate", required_argument, 0, 'r'},
+      {"max-rate", required_argument, 0, 'R'},
+      {"keep", no_argument, 0, 'k'},
+      {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0},
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 's': o.sqwatch = optarg; break;
+    case 'o': o.out = optarg; break;
+    case 'l': o.label = optarg; break;
+    case 'D': o.dir = optarg; break;
+    case 'd': o.depth = atoi(optarg); break;
+    case 'f': o.fanout = atoi(optarg); break;
+    case 'n': o.files = atoi(optarg); break;
+    case 'z': o.file_size = strtoull(optarg, NULL, 10); break;
+    case 'p': o.ops = atoi(optarg); break;
+    case 'b': o.burst = atoi(optarg); break;
+    case 'r': o.rate = atof(optarg); break;
+    case 'R': o.max_rate = atof(optarg); break;
+    case 'k': o.keep = 1; break;
+    case 'h':
+      print_usage();
+      return 0;
+    default:
+      print_usage();
+      return 1;
+    }
+  }
+  if (o.depth < 0 || o.fanout < 0 || o.files < 0 || o.ops <= 0 ||
+      o.burst <= 0 || o.rate <= 0) {
+    fprintf(stderr, "Invalid benchmark options\n");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  char root[PATH_MAX];
+  if (o.dir) {
+    snprintf(root, sizeof(root), "%s", o.dir);
+    if (mkdir(root, 0755) != 0 && errno != EEXIST) {
+      perror(root);
+      return 1;
+    }
+  } else {
+    const char *tmp = getenv("TMPDIR");
+    snprintf(root, sizeof(root), "%s/sqbench-XXXXXX", tmp ? tmp : "/tmp");
+    if (!mkdtemp(root)) {
+      perror("mkdtemp");
+      return 1;
+    }
+  }
+  char storm_dir[PATH_MAX];
+  if (snprintf(storm_dir, sizeof(storm_dir), "%s/storm", root) >=
+      (int)sizeof(storm_dir)) {
+    fprintf(stderr, "Path too long: %s\n", root);
+    return 1;
+  }
+
+  tree_stats tree = {1, 0, 0};
+  unsigned seed = 42;
+  printf("+ Building tree in %s\n", root);
+  if (make_tree(root, o.depth, &o, &tree, &seed) != 0 ||
+      (mkdir(storm_dir, 0755) != 0 && errno != EEXIST) ||
+      make_storm_files(storm_dir, &o, &seed) != 0) {
+    return 1;
+  }
+  printf("+ %llu dirs, %llu files, %llu bytes\n",
+         (unsigned long long)tree.dirs, (unsigned long long)tree.files,
+         (unsigned long long)tree.bytes);
+
+  // Startup and the overflow ramp run quiet, as most users do
+  watcher w;
+  int64_t start = now_ns();
+  if (watcher_start(&w, &o, root, storm_dir, 0) != 0) {
+    return 1;
+  }
+  double ready_ms = 0;
+  if (wait_ready(&w, start, &ready_ms) != 0) {
+    fprintf(stderr, "sqwatch did not become ready\n");
+    watcher_stop(&w);
+    return 1;
+  }
+  double scan_ms = w.scan_ms;
+  long rss_idle = read_status_kb(w.pid, "VmRSS");
+  printf("+ Scan %.1fms, ready after %.1fms, RSS %ldkB\n", scan_ms, ready_ms,
+         rss_idle);
+
+  storm_step steps[32];
+  size_t step_count = run_storm(&w, &o, steps, 32);
+  for (size_t i = 0; i < step_count; i++) {
+    printf("+ Storm at %.0f/s: wrote %.0f/s, %.0f triggers/s%s\n",
+           steps[i].rate, steps[i].achieved, steps[i].triggers,
+           steps[i].overflow ? ", queue overflow" : "");
+  }
+  long rss_storm = read_status_kb(w.pid, "VmHWM");
+  watcher_stop(&w);
+
+  // Latency phases need -v, which names every file sqwatch reacts to
+  latency_stats latency[OP_KIND_COUNT];
+  long rss_latency = -1;
+  start = now_ns();
+  if (watcher_start(&w, &o, root, storm_dir, 1) != 0) {
+    return 1;
+  }
+  double verbose_ready_ms;
+  if (wait_ready(&w, start, &verbose_ready_ms) != 0) {
+    fprintf(stderr, "sqwatch did not become ready\n");
+    watcher_stop(&w);
+    return 1;
+  }
+  for (int k = 0; k < OP_KIND_COUNT; k++) {
+    run_phase(&w, k, &o, &latency[k]);
+    printf("+ %-6s p50 %.0fus p90 %.0fus p99 %.0fus max %.0fus, %d missed\n",
+           op_names[k], latency[k].p50_us, latency[k].p90_us,
+           latency[k].p99_us, latency[k].max_us, latency[k].missed);
+  }
+  rss_latency = read_status_kb(w.pid, "VmHWM");
+  watcher_stop(&w);
+
+  if (!o.keep) {
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+  if (write_results(&o, &tree, scan_ms, ready_ms, rss_idle, rss_storm,
+                    rss_latency, steps, step_count, latency) != 0) {
+    return 1;
+  }
+  if (strcmp(o.out, "-") != 0) {
+    printf("+ Results written to %s\n", o.out);
+  }
+  return 0;
+}
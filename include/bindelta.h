@@ -0,0 +1,39 @@
+#ifndef BINDELTA_H
+#define BINDELTA_H
+
+#include <stddef.h>
+
+typedef enum {
+  REGION_INSERTED, // bytes only in the new file
+  REGION_DELETED,  // bytes only in the old file
+  REGION_REPLACED, // new bytes standing where old ones were removed
+  REGION_MOVED,    // old bytes that reappear out of order
+} delta_region_kind;
+
+// A changed stretch, listed in new-file order
+typedef struct {
+  delta_region_kind kind;
+  size_t new_offset;
+  size_t new_length;
+  size_t old_offset;
+  size_t old_length;
+} delta_region;
+
+typedef struct {
+  delta_region *regions;
+  size_t count;
+  size_t capacity;
+  size_t bytes_inserted; // new bytes not found anywhere in the old file
+  size_t bytes_deleted;  // old bytes not reused anywhere in the new file
+  size_t bytes_moved;
+  size_t old_size;
+  size_t new_size;
+  size_t block_size;
+} bin_delta;
+
+// Function declarations
+int bindelta_compute(const unsigned char *old_data, size_t old_size,
+                     const unsigned char *new_data, size_t new_size,
+                     bin_delta *delta);
+void bindelta_free(bin_delta *delta);
+#endif // BINDELTA_H
@@ -5,15 +5,17 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include "copy.h"
+#include "sqwatch.h"
+
 // Colors for output formatting
 #define DARK_GREY "\033[90m"
 #define RED "\033[31m"
 #define RESET "\033[0m"
 
 // Function declarations
-int copy_file(const char *src, const char *dest);
 void remove_directory(const char *path);
-void create_caches(int max_files, const char *cache_dir, char *watch_paths[], char *cached_paths[], int verbose);
-void create_cache_for_file(const char *path, const char *cache_dir, 
-                          char **cached_path, int verbose);
+int create_caches(const char *cache_dir, sqwatch_config *config);
+void create_cache_for_file(snapshot_store *store, const char *path,
+                           int verbose);
 #endif // CACHE_H 
\ No newline at end of file
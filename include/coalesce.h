@@ -0,0 +1,28 @@
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One record per path with every mask bit seen since the last flush
+typedef struct {
+  char *path;
+  uint64_t hash;
+  uint32_t mask;
+} coalesced_event;
+
+// Records are kept in first-seen order; index maps path hash -> record
+typedef struct {
+  coalesced_event *events;
+  size_t count;
+  size_t capacity;
+  uint32_t *index;      // slot -> record index + 1, 0 = empty
+  size_t index_capacity;
+} coalesce_table;
+
+// Function declarations
+int coalesce_init(coalesce_table *t);
+int coalesce_add(coalesce_table *t, const char *path, uint32_t mask);
+void coalesce_clear(coalesce_table *t);
+void coalesce_free(coalesce_table *t);
+#endif // COALESCE_H
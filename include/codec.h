@@ -0,0 +1,43 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compressed snapshot objects are a codec_header followed by blocks of at
+// most CODEC_BLOCK_SIZE input bytes, each a codec_block and its payload.
+// A block whose stored size equals its raw size is kept uncompressed.
+#define CODEC_MAGIC "SQZ1"
+#define CODEC_BLOCK_SIZE (128 * 1024)
+
+typedef enum {
+  CODEC_NONE = 0,  // plain copies, reflinked where possible
+  CODEC_LZ,        // built-in LZ77 codec
+  CODEC_ZSTD,      // libzstd, when built with ZSTD=1
+} snapshot_codec;
+
+typedef struct {
+  char magic[4];
+  uint8_t codec;
+  uint8_t pad[3];
+  uint64_t raw_size;
+} codec_header;
+
+typedef struct {
+  uint32_t raw_size;
+  uint32_t stored_size;
+} codec_block;
+
+// Function declarations
+size_t lz_bound(size_t size);
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst,
+                   size_t capacity);
+int lz_decompress(const uint8_t *src, size_t size, uint8_t *dst,
+                  size_t raw_size);
+int codec_write(int fd, snapshot_codec codec, const void *data, size_t size,
+                uint64_t *written);
+int codec_read(int fd, void *dst, size_t size);
+int codec_probe(int fd, uint64_t *raw_size);
+int parse_codec(const char *text, snapshot_codec *codec);
+const char *codec_name(snapshot_codec codec);
+#endif // CODEC_H
@@ -0,0 +1,18 @@
+#ifndef COPY_H
+#define COPY_H
+
+// How a file copy was carried out, cheapest first
+typedef enum {
+  COPY_NONE,
+  COPY_REFLINK,         // FICLONE: shares extents, no data moved
+  COPY_FILE_RANGE,      // copy_file_range: in-kernel, may offload
+  COPY_SENDFILE,        // sendfile: in-kernel, through the page cache
+  COPY_BUFFER,          // read/write through a large user buffer
+  COPY_METHOD_COUNT
+} copy_method;
+
+// Function declarations
+int copy_file(const char *src, const char *dest);
+int copy_file_method(const char *src, const char *dest, copy_method *method);
+const char *copy_method_name(copy_method method);
+#endif // COPY_H
@@ -0,0 +1,33 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#include <stdint.h>
+
+typedef enum {
+  DEBOUNCE_TRAILING = 0, // fire once the burst has been quiet for the window
+  DEBOUNCE_LEADING,      // fire on the first event, then once more at the end
+  DEBOUNCE_MAX_WAIT,     // trailing, but never hold a burst past max_wait
+} debounce_mode;
+
+// Burst scheduler. All times are CLOCK_MONOTONIC nanoseconds.
+typedef struct {
+  debounce_mode mode;
+  uint64_t window_ns;
+  uint64_t max_wait_ns;
+  int pending;          // a trailing fire is owed
+  int in_window;        // leading mode: inside the quiet window
+  uint64_t first_ns;    // first event of the current burst
+  uint64_t last_ns;     // most recent event
+} debouncer;
+
+// Function declarations
+void debounce_init(debouncer *d, debounce_mode mode, uint64_t window_ns,
+                   uint64_t max_wait_ns);
+int debounce_event(debouncer *d, uint64_t now_ns);
+int debounce_expire(debouncer *d, uint64_t now_ns);
+uint64_t debounce_deadline(const debouncer *d);
+uint64_t debounce_now_ns(void);
+int parse_duration_ns(const char *text, uint64_t *out_ns);
+int parse_debounce_mode(const char *text, debounce_mode *out);
+const char *debounce_mode_name(debounce_mode mode);
+#endif // DEBOUNCE_H
@@ -2,6 +2,16 @@
 #define DIFF_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bindelta.h"
+#include "diff_engine.h"
+#include "ingest.h"
+#include "linescan.h"
+#include "log.h"
+#include "snapshot.h"
+#include "versions.h"
 
 // Colors for output formatting
 #define RED "\033[31m"
@@ -10,27 +20,45 @@
 #define DARK_GREY "\033[90m"
 #define CYAN "\033[36m"
 
-#define MAX_BIN_DIFFS 16
+#define MAX_BIN_DIFFS 16   // Binary delta regions shown before eliding
 
+// Lines are views into one buffer holding the whole file
 typedef struct {
-    char **lines;
+    ingest_buffer content;  // File contents, read once or mapped
+    line_view *lines;   // NULL when the file is empty
+    uint64_t *hashes;   // hash_bytes() of each line
     int count;
 } file_lines;
 
-struct diff_entry {
-    size_t offset;
-    unsigned char local;
-    unsigned char cache;
-};
+// The change being diffed, as it is reported and logged
+typedef struct {
+    const char *path;
+    const char *type;   // e.g. "Modified"
+    uint32_t mask;      // inotify events merged into this diff
+} diff_event;
+
+// What a diff found, for callers that record it
+typedef struct {
+    int compared;       // 0 when there was no baseline or no change
+    int binary;
+    uint64_t changed;   // lines (text) or bytes (binary) changed
+    uint64_t size;      // current file size
+} diff_summary;
 
 // Function declarations
-void run_diff(const char *path, const char *cache_dir, const char *event_type, int verbose, const char *log_file);
-void print_diff(file_lines *current, file_lines *cached, int verbose);
+void run_diff(FILE *out, const diff_event *event, snapshot_store *store,
+              version_cache *versions, int verbose, log_sink *log,
+              diff_summary *summary);
+void print_diff(FILE *out, const edit_script *script, file_lines *current,
+                file_lines *cached, int verbose);
 void read_file(const char *filename, char **content, size_t *length);
-void log_changes(const char *log_file, const char *path, const char *event_type, 
-                file_lines *current, file_lines *cached);
-int is_binary_file(const char *filename);
-void print_bin_diff(const char *path, const char *cached_file_path, const char *log_file);
-void log_bin_diff(const char *log_file, const char *path, 
-                 const struct diff_entry *diffs, size_t diff_count);
+void log_changes(log_sink *log, const diff_event *event,
+                 const edit_script *script, file_lines *current,
+                 file_lines *cached);
+void print_bin_diff(FILE *out, const diff_event *event,
+                    const file_lines *current, const file_lines *cached,
+                    log_sink *log, diff_summary *summary);
+void log_bin_diff(log_sink *log, const diff_event *event,
+                  const bin_delta *delta, const file_lines *current,
+                  const file_lines *cached);
 #endif // DIFF_H 
\ No newline at end of file
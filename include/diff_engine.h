@@ -0,0 +1,32 @@
+#ifndef DIFF_ENGINE_H
+#define DIFF_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  EDIT_EQUAL,
+  EDIT_DELETE, // lines only in the old (cached) version
+  EDIT_INSERT, // lines only in the new (current) version
+} edit_op;
+
+// A run of `count` lines starting at old_start/new_start (0-based)
+typedef struct {
+  edit_op op;
+  int old_start;
+  int new_start;
+  int count;
+} edit_run;
+
+typedef struct {
+  edit_run *runs;
+  size_t count;
+  size_t capacity;
+  int changed_lines; // deleted + inserted
+} edit_script;
+
+// Function declarations
+int diff_compute(const uint32_t *old_ids, int old_count,
+                 const uint32_t *new_ids, int new_count, edit_script *script);
+void edit_script_free(edit_script *script);
+#endif // DIFF_ENGINE_H
@@ -0,0 +1,48 @@
+#ifndef DIFFPOOL_H
+#define DIFFPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*diff_job_fn)(const char *path, uint32_t mask, void *ctx);
+
+// One record per path with work outstanding
+typedef struct {
+  char *path;
+  uint64_t hash;
+  uint32_t mask; // events merged since the job last started
+  int queued;   // waiting in the queue
+  int running;  // a worker has it
+  int rerun;    // changed again while running
+} diff_request;
+
+// Bounded pool running one job per path at a time. A path that changes
+// while queued is merged; while running, it runs once more afterwards.
+typedef struct {
+  pthread_t *threads;
+  int thread_count;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  diff_request **queue;  // ring buffer, FIFO
+  size_t capacity;
+  size_t head;
+  size_t count;
+  diff_request **table;  // path -> request, linear probing
+  size_t table_mask;
+  int stopping;
+  diff_job_fn run;
+  void *ctx;
+  uint64_t submitted;
+  uint64_t merged;       // folded into a queued or running request
+  uint64_t stalls;       // submissions that waited for queue space
+} diff_pool;
+
+// Function declarations
+int diffpool_default_workers(void);
+int diffpool_start(diff_pool *pool, int workers, size_t capacity,
+                   diff_job_fn run, void *ctx);
+void diffpool_submit(diff_pool *pool, const char *path, uint32_t mask);
+void diffpool_stop(diff_pool *pool);
+#endif // DIFFPOOL_H
@@ -0,0 +1,29 @@
+#ifndef FANWATCH_H
+#define FANWATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/fanotify.h>
+
+// A watched tree under a single fanotify filesystem/mount mark
+typedef struct {
+  char *path;      // canonical root path
+  size_t len;
+  int mount_fd;    // any fd on the filesystem, for open_by_handle_at()
+  int32_t fsid[2];
+} fan_root;
+
+typedef struct {
+  int fd;
+  fan_root *roots;
+  int root_count;
+} fanwatch;
+
+// Function declarations
+int fanwatch_init(fanwatch *fw);
+int fanwatch_add(fanwatch *fw, const char *path, uint32_t flags, int verbose);
+int fanwatch_resolve(fanwatch *fw, const struct fanotify_event_metadata *meta,
+                     char *out, size_t out_len);
+uint32_t fanwatch_event_mask(uint64_t fan_mask);
+void fanwatch_close(fanwatch *fw);
+#endif // FANWATCH_H
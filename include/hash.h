@@ -0,0 +1,41 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// FNV-1a over a NUL-terminated string; used for path keys
+static inline uint64_t hash_string(const char *s) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (const unsigned char *p = (const unsigned char *)s; *p; p++) {
+    h ^= *p;
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// Fold a 128-bit product into 64 bits
+static inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+
+// Fast 64-bit hash over a byte range, 8 bytes per multiply; used for line
+// and content keys
+static inline uint64_t hash_bytes(const void *data, size_t len) {
+  const unsigned char *p = data;
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+  while (len >= 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    h = hash_mix(h ^ w, 0xbf58476d1ce4e5b9ULL);
+    p += 8;
+    len -= 8;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, p, len);
+  h = hash_mix(h ^ tail, 0x94d049bb133111ebULL);
+  return hash_mix(h, 0x2545f4914f6cdd1dULL);
+}
+#endif // HASH_H
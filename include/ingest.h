@@ -0,0 +1,25 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stddef.h>
+
+typedef enum {
+  INGEST_EMPTY,
+  INGEST_TEXT,
+  INGEST_BINARY,  // NUL bytes, or too many control / invalid UTF-8 bytes
+} ingest_class;
+
+// A whole file in one buffer, shared by the diff and the snapshot writer
+typedef struct {
+  char *data;
+  size_t size;
+  int mapped;        // data is an mmap and must be unmapped
+  ingest_class kind;
+} ingest_buffer;
+
+// Function declarations
+int ingest_read(const char *path, ingest_buffer *buf);
+int ingest_map(const char *path, ingest_buffer *buf);
+void ingest_release(ingest_buffer *buf);
+const char *ingest_impl(void);
+#endif // INGEST_H
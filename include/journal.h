@@ -0,0 +1,81 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// On-disk layout of a journal directory. Every file starts with a
+// journal_header and is only ever appended to.
+//   records.bin  fixed-size journal_record, in time order
+//   strings.bin  path table: u32 length + bytes; a path's id is its position
+//   index.bin    journal_index_entry for every JOURNAL_INDEX_STRIDE records
+#define JOURNAL_MAGIC "SQWJRNL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_INDEX_STRIDE 1024
+
+typedef enum {
+  JOURNAL_EVENT = 0,       // an event handed to the trigger pipeline
+  JOURNAL_DIFF_TEXT,       // diff of a text file; changed = lines
+  JOURNAL_DIFF_BINARY,     // diff of a binary file; changed = bytes
+} journal_kind;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+} journal_header;
+
+typedef struct {
+  uint64_t time_ns;  // CLOCK_REALTIME, never decreasing within a journal
+  uint32_t path_id;
+  uint32_t mask;     // inotify mask
+  uint32_t kind;     // journal_kind
+  uint32_t changed;
+  uint64_t size;     // file size after a diff, 0 for events
+} journal_record;
+
+typedef struct {
+  uint64_t time_ns;
+  uint64_t record; // position of the first record at or after time_ns
+} journal_index_entry;
+
+// Path -> id slot of the writer's string table
+typedef struct {
+  char *path;
+  uint64_t hash;
+  uint32_t id;
+} journal_path;
+
+// Journal writer, shared by the event loop and the diff workers. Appends
+// are buffered and written by journal_flush(); strings always reach the
+// disk before the records that use them.
+typedef struct {
+  pthread_mutex_t lock;
+  char *dir;  // NULL when journaling is off
+  int records_fd;
+  int strings_fd;
+  int index_fd;
+  journal_path *paths;
+  size_t path_capacity;
+  uint32_t path_count;
+  uint64_t record_count; // written + buffered
+  uint64_t last_ns;
+  journal_record *pending;
+  size_t pending_count;
+  char *strings;         // encoded path entries not yet written
+  size_t strings_length;
+  size_t strings_capacity;
+  journal_index_entry *index;
+  size_t index_count;
+  size_t index_capacity;
+} journal;
+
+// Function declarations
+int journal_open(journal *j, const char *dir);
+void journal_append(journal *j, const char *path, uint32_t mask,
+                    journal_kind kind, uint32_t changed, uint64_t size);
+void journal_flush(journal *j);
+void journal_close(journal *j);
+int journal_main(int argc, char *argv[]);
+#endif // JOURNAL_H
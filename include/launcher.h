@@ -0,0 +1,54 @@
+#ifndef LAUNCHER_H
+#define LAUNCHER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "reactor.h"
+
+typedef struct launcher launcher;
+
+// What a trigger does while the command is still running
+typedef enum {
+  BUSY_RESTART = 0, // terminate the running command and start again
+  BUSY_QUEUE_ONE,   // let it finish, then run once more for all triggers
+  BUSY_SKIP,        // drop the trigger
+  BUSY_PARALLEL,    // start another run if a job slot is free, else queue one
+} busy_policy;
+
+// Called on the event loop once a run has been reaped
+typedef void (*launcher_exit_fn)(launcher *l, int status, void *ctx);
+
+// One running command: the leader of its own process group
+typedef struct {
+  launcher *owner;
+  pid_t pid;        // 0 for a free slot
+  int pidfd;        // -1 when pidfd_open is unavailable (SIGCHLD fallback)
+  int kill_timer_fd;
+  int terminating;  // SIGTERM sent, SIGKILL once the grace period ends
+} launcher_job;
+
+// Runs the command through /bin/sh -c with posix_spawn, so the watcher's
+// address space is never copied. Exits are reported through each job's
+// pidfd on the reactor.
+struct launcher {
+  reactor *loop;
+  const char *command;
+  launcher_job *jobs;
+  int slots;
+  int running;
+  uint64_t grace_ns;
+  launcher_exit_fn on_exit;
+  void *ctx;
+};
+
+// Function declarations
+int launcher_init(launcher *l, reactor *loop, const char *command, int slots,
+                  uint64_t grace_ns, launcher_exit_fn on_exit, void *ctx);
+int launcher_spawn(launcher *l);
+void launcher_terminate(launcher *l);
+void launcher_reap(launcher *l);
+void launcher_shutdown(launcher *l, int signo);
+int parse_busy_policy(const char *text, busy_policy *policy, int *slots);
+const char *busy_policy_name(busy_policy policy);
+#endif // LAUNCHER_H
@@ -0,0 +1,15 @@
+#ifndef LINESCAN_H
+#define LINESCAN_H
+
+#include <stddef.h>
+
+// A line inside a larger buffer, without its newline
+typedef struct {
+  size_t offset;
+  size_t length;
+} line_view;
+
+// Function declarations
+int linescan_split(const char *data, size_t size, line_view **lines);
+const char *linescan_impl(void);
+#endif // LINESCAN_H
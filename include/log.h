@@ -0,0 +1,41 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+  LOG_FORMAT_TEXT = 0, // human-readable blocks, as printed to the terminal
+  LOG_FORMAT_JSONL,    // one JSON object per line
+} log_format;
+
+// Append-only log kept open for the whole run. Records are collected in a
+// buffer and written once it fills up or on the periodic flush; the file
+// is rotated (path -> path.1 -> ... -> path.N) once it reaches max_bytes.
+typedef struct {
+  pthread_mutex_t lock;
+  char *path;          // NULL when logging is off
+  int fd;
+  log_format format;
+  char *buffer;
+  size_t length;
+  size_t capacity;
+  uint64_t file_bytes; // size of the current file, buffered bytes excluded
+  uint64_t max_bytes;  // rotate past this size, 0 never rotates
+  int keep;            // rotated files kept
+} log_sink;
+
+// Function declarations
+int log_open(log_sink *sink, const char *path, log_format format,
+             uint64_t max_bytes, int keep);
+void log_append(log_sink *sink, const char *record, size_t length);
+void log_flush(log_sink *sink);
+void log_close(log_sink *sink);
+uint64_t log_now_ns(void);
+void log_format_time(uint64_t time_ns, char *out, size_t size);
+void log_json_string(FILE *out, const char *text, size_t length);
+int parse_log_format(const char *text, log_format *out);
+int parse_size_bytes(const char *text, uint64_t *out);
+#endif // LOG_H
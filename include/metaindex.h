@@ -0,0 +1,44 @@
+#ifndef METAINDEX_H
+#define METAINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// What was last seen at a path: enough to tell whether it changed without
+// reading it. generation records the last scan (or event) that saw it.
+typedef struct {
+  char *path; // NULL for empty slots and tombstones
+  uint64_t hash;
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+  uint64_t content_hash; // snapshot digest, only filled in from a saved index
+  uint64_t content_size;
+  uint32_t generation;
+  uint8_t is_dir;
+  uint8_t has_content;
+  uint8_t deleted; // tombstone
+} meta_entry;
+
+// Open-addressing hash of path metadata. Pointers returned by lookups are
+// invalidated by the next update; removals leave iteration intact.
+typedef struct {
+  meta_entry *slots;
+  size_t capacity;
+  size_t used;  // live + tombstones
+  size_t count; // live entries
+  uint32_t generation;
+  uint64_t changes; // updates and removals, to tell when a save is due
+} meta_index;
+
+// Function declarations
+int metaindex_init(meta_index *index, size_t initial_capacity);
+void metaindex_free(meta_index *index);
+meta_entry *metaindex_lookup(const meta_index *index, const char *path);
+meta_entry *metaindex_update(meta_index *index, const char *path,
+                             const struct stat *st);
+int metaindex_remove(meta_index *index, const char *path);
+int metaindex_changed(const meta_entry *entry, const struct stat *st);
+meta_entry *metaindex_next(const meta_index *index, size_t *iter);
+#endif // METAINDEX_H
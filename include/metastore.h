@@ -0,0 +1,38 @@
+#ifndef METASTORE_H
+#define METASTORE_H
+
+#include <stdint.h>
+
+#include "metaindex.h"
+#include "snapshot.h"
+
+// On-disk copy of the metadata index (--index). A metastore_header is
+// followed by one metastore_record per path, each followed by its path
+// bytes. Files are replaced atomically, never updated in place.
+#define METASTORE_MAGIC "SQWINDX"
+#define METASTORE_VERSION 1
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t count;
+} metastore_header;
+
+typedef struct {
+  uint64_t ino;
+  uint64_t size;
+  int64_t mtime_ns;
+  uint64_t content_hash; // digest of the path's snapshot, if it had one
+  uint64_t content_size;
+  uint32_t path_len;
+  uint8_t is_dir;
+  uint8_t has_content;
+  uint8_t pad[2];
+} metastore_record;
+
+// Function declarations
+int metastore_load(const char *file, meta_index *index);
+int metastore_save(const char *file, const meta_index *index,
+                   snapshot_store *snapshots);
+#endif // METASTORE_H
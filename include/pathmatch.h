@@ -0,0 +1,60 @@
+#ifndef PATHMATCH_H
+#define PATHMATCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct match_node match_node;
+
+// One state of the compiled pattern trie. Edges are path segments: literal
+// ones live in the matcher's edge table, glob ones in the node itself, and
+// "**" is a self-looping child.
+struct match_node {
+  char *segment;            // edge label leading here
+  match_node **globs;       // children reached through a glob segment
+  size_t glob_count;
+  match_node *any;          // "**" child: matches zero or more segments
+  int self_loop;            // this node was reached through "**"
+  uint32_t dir_rule;        // order of the last rule ending here, 0 = none
+  uint32_t file_rule;       // same, for rules that also apply to files
+  uint8_t dir_negate;
+  uint8_t file_negate;
+};
+
+// Literal edge: (parent, segment) -> child
+typedef struct {
+  uint64_t hash;
+  match_node *parent;
+  match_node *child;
+} match_edge;
+
+typedef struct {
+  match_node *root;
+  match_edge *edges;
+  size_t edge_capacity;
+  size_t edge_count;
+  uint32_t rules;           // rules added so far; later ones win
+} match_trie;
+
+// Include/exclude filter for watched paths. Patterns use .gitignore
+// syntax and are compiled into tries over path segments, so a check
+// walks the path once. .gitignore files can be added while a parallel
+// scan is using the matcher.
+typedef struct {
+  pthread_rwlock_t lock;
+  match_trie exclude;       // --exclude and .gitignore rules
+  match_trie include;       // --include rules
+  int has_rules;            // anything to check at all
+  int has_includes;
+  int gitignore;            // read .gitignore files while scanning
+} path_matcher;
+
+// Function declarations
+int pathmatch_init(path_matcher *m, int gitignore);
+void pathmatch_free(path_matcher *m);
+int pathmatch_add(path_matcher *m, const char *base, const char *pattern,
+                  int include);
+int pathmatch_load_gitignore(path_matcher *m, int dir_fd, const char *dir);
+int pathmatch_excluded(path_matcher *m, const char *path, int is_dir);
+#endif // PATHMATCH_H
@@ -0,0 +1,37 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdint.h>
+
+typedef void (*reactor_cb)(int fd, uint32_t events, void *data);
+
+typedef struct reactor_handler {
+  int fd;
+  reactor_cb cb;
+  void *data;
+  struct reactor_handler *next;
+} reactor_handler;
+
+// Single-threaded epoll loop. Handlers removed while a batch is being
+// dispatched are freed only after the batch completes.
+typedef struct {
+  int epoll_fd;
+  int running;
+  int exit_code;
+  reactor_handler *handlers;
+  reactor_handler *retired;
+} reactor;
+
+// Function declarations
+int reactor_init(reactor *r);
+int reactor_add(reactor *r, int fd, uint32_t events, reactor_cb cb, void *data);
+int reactor_remove(reactor *r, int fd);
+int reactor_run(reactor *r);
+void reactor_stop(reactor *r, int exit_code);
+void reactor_close(reactor *r);
+
+// timerfd helpers (CLOCK_MONOTONIC, relative deadlines)
+int reactor_timer_create(void);
+int reactor_timer_arm(int timer_fd, uint64_t delay_ns);
+int reactor_timer_disarm(int timer_fd);
+#endif // REACTOR_H
@@ -0,0 +1,26 @@
+#ifndef RECONCILE_H
+#define RECONCILE_H
+
+#include <stdint.h>
+
+#include "sqwatch.h"
+
+// Receives the events a reconciliation pass infers were missed
+typedef void (*reconcile_emit_fn)(const char *path, uint32_t mask);
+
+// What a reconciliation pass found
+typedef struct {
+  uint64_t created;
+  uint64_t modified;
+  uint64_t deleted;
+  uint64_t watches; // watches that had to be (re)added
+  uint64_t elapsed_ns;
+} reconcile_stats;
+
+// Function declarations
+void reconcile_tree(int inotify_fd, sqwatch_config *config,
+                    reconcile_emit_fn emit, reconcile_stats *stats);
+void reconcile_offline(sqwatch_config *config, const meta_index *saved,
+                       reconcile_emit_fn emit, reconcile_stats *stats);
+void reconcile_check_queue_limit(const sqwatch_config *config);
+#endif // RECONCILE_H
@@ -0,0 +1,42 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A single inotify watch. wd is the key; path is owned.
+typedef struct {
+  int wd;
+  int is_dir;
+  char *path;
+} watch_entry;
+
+// Reverse index slot: path hash -> wd
+typedef struct {
+  uint64_t hash;
+  int wd;
+} path_slot;
+
+// Open-addressing hash of watches keyed by wd, plus a path->wd index.
+// Pointers returned by lookups are invalidated by the next add/remove.
+typedef struct {
+  watch_entry *slots;
+  size_t capacity;
+  size_t used;   // live + tombstones
+  size_t count;  // live entries
+  size_t dir_count;
+  path_slot *paths;
+  size_t path_capacity;
+  size_t path_used;
+} watch_registry;
+
+// Function declarations
+int registry_init(watch_registry *reg, size_t initial_capacity);
+void registry_free(watch_registry *reg);
+watch_entry *registry_add(watch_registry *reg, int wd, const char *path,
+                          int is_dir);
+watch_entry *registry_lookup(const watch_registry *reg, int wd);
+watch_entry *registry_lookup_path(const watch_registry *reg, const char *path);
+int registry_remove(watch_registry *reg, int wd);
+watch_entry *registry_next(const watch_registry *reg, size_t *iter);
+#endif // REGISTRY_H
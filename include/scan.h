@@ -0,0 +1,25 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+#include "sqwatch.h"
+
+// Counters reported at the end of a scan
+typedef struct {
+  uint64_t dirs;
+  uint64_t files;
+  uint64_t watches;
+  uint64_t excluded;  // entries skipped by the path filter
+  uint64_t errors;
+  uint64_t elapsed_ns;
+  int threads;
+} scan_stats;
+
+// Function declarations
+int scan_default_threads(void);
+// Watch and index everything under root; an inotify_fd of -1 only indexes
+void scan_tree(int inotify_fd, const char *root, uint32_t flags,
+               sqwatch_config *config, int threads, int report,
+               scan_stats *stats);
+#endif // SCAN_H
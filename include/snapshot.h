@@ -0,0 +1,105 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codec.h"
+#include "copy.h"
+#include "ingest.h"
+
+// Content address of a snapshot: hash_bytes() of the file plus its size
+typedef struct {
+  uint64_t hash;
+  uint64_t size;
+} snapshot_digest;
+
+// Path index slot: which object a watched path was last seen as
+typedef struct {
+  char *path;
+  uint64_t path_hash;
+  snapshot_digest digest;
+  int64_t last_used; // CLOCK_REALTIME ns of the last capture, for eviction
+  uint8_t state;
+} snapshot_ref;
+
+// Object slot: how many paths currently point at this content
+typedef struct {
+  snapshot_digest digest;
+  uint64_t stored;     // bytes on disk, after compression
+  uint32_t refs;
+  uint8_t state;
+} snapshot_object;
+
+// Content-addressed store under <cache_dir>/objects. Identical content is
+// kept once; an object is unlinked when the last path moves off it. Safe
+// to share between the event loop and the diff workers.
+typedef struct {
+  pthread_mutex_t lock;
+  char *object_dir;
+  snapshot_ref *refs;
+  size_t ref_capacity;
+  size_t ref_used;     // live + tombstones
+  size_t ref_count;
+  snapshot_object *objects;
+  size_t object_capacity;
+  size_t object_used;
+  size_t object_count;
+  uint64_t stored_bytes; // on disk; the budget applies to this
+  uint64_t raw_bytes;    // content size before compression
+  uint64_t budget;     // evict least recently used paths above this, 0 = off
+  snapshot_codec codec;
+  size_t evicted;
+  size_t copies[COPY_METHOD_COUNT]; // captures per copy mechanism
+} snapshot_store;
+
+// A file to snapshot ahead of its first change
+typedef struct {
+  char *path;
+  int64_t mtime_ns;
+} snapshot_prefetch_item;
+
+// Captures snapshots for a list of files, most recently modified first,
+// either inline or on a background thread. Stops early once the store
+// is nearly at its budget, so the budget holds the hottest files.
+typedef struct {
+  snapshot_store *store;
+  snapshot_prefetch_item *items;
+  size_t count;
+  pthread_t thread;
+  int started;
+  int verbose;
+  atomic_int stop;
+} snapshot_prefetch;
+
+// Function declarations
+int snapshot_init(snapshot_store *store, const char *cache_dir,
+                  snapshot_codec codec);
+void snapshot_free(snapshot_store *store);
+snapshot_digest snapshot_digest_of(const void *data, size_t size);
+int snapshot_digest_equal(snapshot_digest a, snapshot_digest b);
+int snapshot_lookup(snapshot_store *store, const char *path,
+                    snapshot_digest *digest);
+int snapshot_pin(snapshot_store *store, const char *path,
+                 snapshot_digest *digest);
+void snapshot_unpin(snapshot_store *store, snapshot_digest digest);
+void snapshot_object_path(const snapshot_store *store, snapshot_digest digest,
+                          char *out, size_t len);
+int snapshot_capture_file(snapshot_store *store, const char *path,
+                          copy_method *method);
+int snapshot_capture_buffer(snapshot_store *store, const char *path,
+                            const void *data, size_t size);
+int snapshot_load(snapshot_store *store, snapshot_digest digest,
+                  ingest_buffer *buf);
+void snapshot_forget(snapshot_store *store, const char *path);
+int snapshot_restore(snapshot_store *store, const char *path,
+                     snapshot_digest digest, int64_t last_used);
+size_t snapshot_prune(snapshot_store *store, const snapshot_digest *digests,
+                      size_t count);
+int snapshot_prefetch_start(snapshot_prefetch *p, snapshot_store *store,
+                            snapshot_prefetch_item *items, size_t count,
+                            int background, int verbose);
+void snapshot_prefetch_stop(snapshot_prefetch *p);
+#endif // SNAPSHOT_H
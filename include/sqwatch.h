@@ -3,6 +3,15 @@
 #include <stdint.h>
 
 #include "diff.h"
+#include "registry.h"
+#include "fanwatch.h"
+#include "debounce.h"
+#include "diffpool.h"
+#include "snapshot.h"
+#include "metaindex.h"
+#include "journal.h"
+#include "launcher.h"
+#include "pathmatch.h"
 
 #ifndef SQWATCH_H
 #define SQWATCH_H
@@ -18,27 +27,39 @@
 #define MAX_DIR_WATCHES 16
 
 
-extern pid_t g_last_pid;
 extern char *cache_dir;
 
 typedef struct {
-    char *path;
-    int wd;
-} dir_watch;
-
-typedef struct {
-    char *watch_paths[MAX_PATHS];
-    char *cached_paths[MAX_PATHS];
+    watch_registry registry;  // All file and directory watches, keyed by wd
     int path_count;
-    uint8_t debounce_t;
+    uint64_t debounce_ns;     // Debounce window, 0 fires every event
+    uint64_t max_wait_ns;     // Upper bound on how long a burst is held
+    debounce_mode debounce_mode;
     int verbose;
     int diff_enabled;        // New flag for diff functionality
-    const char *log_file;
+    int diff_workers;        // Threads running diffs off the event loop
+    log_sink log;            // Diff log (-l), kept open for the whole run
+    journal journal;         // Binary change journal (--journal)
     const char *command;
+    busy_policy on_busy;     // What a trigger does while the command runs
+    int command_slots;       // Concurrent runs allowed (parallel policy)
+    uint64_t min_interval_ns; // Least time between two runs starting
     uint32_t flags;
-    dir_watch *dir_watches;  // Array for directory watches
-    int dir_watch_count;
-    int max_dir_watches;
+    int use_fanotify;        // Watch whole filesystems via fanotify (-m)
+    fanwatch fan;
+    snapshot_store snapshots; // Content-addressed diff baselines
+    snapshot_prefetch prefetch; // Initial snapshot capture
+    int lazy_cache;           // Capture in the background instead of before starting
+    uint64_t cache_budget;    // Snapshot bytes kept on disk, 0 = unlimited
+    snapshot_codec snapshot_codec; // How snapshot objects are compressed
+    version_cache versions;   // Parsed recent versions, the old side of diffs
+    meta_index meta;          // inode/size/mtime per path, for overflow recovery
+    const char *roots[MAX_PATHS]; // Paths given on the command line
+    int root_count;
+    long max_queued_events;   // Warn when the kernel queue is shorter than this
+    path_matcher filter;      // --include/--exclude/--gitignore
+    const char *index_path;   // Metadata index kept across runs (--index)
+    meta_index saved;         // That index as the last run left it, until replayed
 } sqwatch_config;
 
 
@@ -46,7 +67,8 @@ typedef struct {
 
 int add_watch(int inotify_fd, const char *path, int flags);
 void add_watches_recursive(int inotify_fd, const char *path, uint32_t flags, sqwatch_config *config);
-void handle_events(int inotify_fd, sqwatch_config config);
+int handle_events(int inotify_fd, sqwatch_config *config);
+const char *event_description(uint32_t mask);
 void print_usage(void);
 
 
@@ -0,0 +1,53 @@
+#ifndef VERSIONS_H
+#define VERSIONS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "linescan.h"
+#include "snapshot.h"
+
+// One parsed file version: the content, its lines and their hashes, all
+// in a single allocation following the header
+typedef struct version_entry version_entry;
+struct version_entry {
+  snapshot_digest digest;
+  version_entry *chain;     // next in the hash bucket
+  version_entry *newer;     // LRU list, most recent at the head
+  version_entry *older;
+  size_t bytes;             // whole allocation, charged to the budget
+  int refs;                 // 1 while cached, +1 per borrower
+  char *data;
+  size_t size;
+  line_view *lines;         // NULL when count is 0
+  uint64_t *hashes;
+  int count;
+};
+
+// Byte-budgeted LRU of recently diffed versions, keyed by snapshot
+// digest, so the old side of a diff is usually still in memory. Entries
+// are reference counted: eviction never frees one a diff is reading.
+typedef struct {
+  pthread_mutex_t lock;
+  version_entry **buckets;
+  size_t bucket_count;
+  size_t count;
+  version_entry *newest;
+  version_entry *oldest;
+  uint64_t bytes;
+  uint64_t budget;          // 0 disables the cache
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+} version_cache;
+
+// Function declarations
+int versions_init(version_cache *cache, uint64_t budget);
+void versions_free(version_cache *cache);
+version_entry *versions_get(version_cache *cache, snapshot_digest digest);
+void versions_put(version_cache *cache, snapshot_digest digest,
+                  const char *data, size_t size, const line_view *lines,
+                  const uint64_t *hashes, int count);
+void versions_release(version_cache *cache, version_entry *entry);
+#endif // VERSIONS_H
@@ -0,0 +1,407 @@
+#include "bindelta.h"
+#include "hash.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// rsync-style delta: index the old file's fixed-size blocks by a weak
+// rolling checksum, slide a window over the new file, and grow every
+// confirmed hit in both directions to its exact extent. The window only
+// ever moves forward, so the pass is linear in the size of the new file.
+
+#define MIN_BLOCK 32
+#define MAX_BLOCK 1024
+#define MAX_PROBES 16 // block compares per window position
+
+typedef struct {
+  size_t old_offset;
+  size_t new_offset;
+  size_t length;
+} delta_copy;
+
+typedef struct {
+  uint32_t sum;
+  uint32_t block; // block index + 1, 0 = empty
+} block_slot;
+
+typedef struct {
+  uint32_t a;
+  uint32_t b;
+} rolling_sum;
+
+typedef struct {
+  const unsigned char *old_data;
+  size_t old_size;
+  const unsigned char *new_data;
+  size_t new_size;
+  size_t block;
+  block_slot *slots;
+  size_t slot_mask;
+  delta_copy *copies; // in new-file order
+  size_t copy_count;
+  size_t copy_capacity;
+} delta_state;
+
+static rolling_sum sum_block(const unsigned char *p, size_t n) {
+  uint32_t a = 0, b = 0;
+  for (size_t i = 0; i < n; i++) {
+    a += p[i];
+    b += (uint32_t)(n - i) * p[i];
+  }
+  return (rolling_sum){a & 0xffff, b & 0xffff};
+}
+
+// Slide the window one byte: drop `out`, take in `in`
+static void sum_roll(rolling_sum *s, unsigned char out, unsigned char in,
+                     size_t n) {
+  s->a = (s->a - out + in) & 0xffff;
+  s->b = (s->b - (uint32_t)n * out + s->a) & 0xffff;
+}
+
+static uint32_t sum_value(rolling_sum s) { return s.a | (s.b << 16); }
+
+static size_t slot_of(const delta_state *st, uint32_t sum) {
+  return hash_mix(sum, 0x9e3779b97f4a7c15ULL) & st->slot_mask;
+}
+
+static int build_index(delta_state *st) {
+  size_t blocks = st->old_size / st->block;
+  size_t capacity = 16;
+  while (capacity < blocks * 2) {
+    capacity <<= 1;
+  }
+  st->slots = calloc(capacity, sizeof(block_slot));
+  if (!st->slots) {
+    return -1;
+  }
+  st->slot_mask = capacity - 1;
+
+  for (size_t k = 0; k < blocks; k++) {
+    const unsigned char *data = st->old_data + k * st->block;
+    uint32_t sum = sum_value(sum_block(data, st->block));
+    size_t i = slot_of(st, sum);
+    int duplicate = 0;
+    while (st->slots[i].block != 0) {
+      // Runs of identical blocks (zero fill) keep only their first copy
+      const block_slot *slot = &st->slots[i];
+      if (slot->sum == sum &&
+          memcmp(st->old_data + (slot->block - 1) * st->block, data,
+                 st->block) == 0) {
+        duplicate = 1;
+        break;
+      }
+      i = (i + 1) & st->slot_mask;
+    }
+    if (!duplicate) {
+      st->slots[i] = (block_slot){sum, (uint32_t)(k + 1)};
+    }
+  }
+  return 0;
+}
+
+// Old offset whose block matches the window at pos, or SIZE_MAX. The
+// offset that continues the previous copy wins when it also matches, so
+// overwritten bytes line up instead of jumping to an identical block.
+static size_t find_match(const delta_state *st, uint32_t sum, size_t pos,
+                         size_t preferred) {
+  const unsigned char *window = st->new_data + pos;
+  int probes = 0;
+  for (size_t i = slot_of(st, sum); st->slots[i].block != 0;
+       i = (i + 1) & st->slot_mask) {
+    if (st->slots[i].sum != sum) {
+      continue;
+    }
+    if (probes++ == 0 && preferred + st->block <= st->old_size &&
+        memcmp(st->old_data + preferred, window, st->block) == 0) {
+      return preferred;
+    }
+    size_t offset = (size_t)(st->slots[i].block - 1) * st->block;
+    if (memcmp(st->old_data + offset, window, st->block) == 0) {
+      return offset;
+    }
+    if (probes >= MAX_PROBES) {
+      break;
+    }
+  }
+  return SIZE_MAX;
+}
+
+static int add_copy(delta_state *st, size_t old_offset, size_t new_offset,
+                    size_t length) {
+  if (length == 0) {
+    return 0;
+  }
+  if (st->copy_count > 0) {
+    delta_copy *last = &st->copies[st->copy_count - 1];
+    if (last->old_offset + last->length == old_offset &&
+        last->new_offset + last->length == new_offset) {
+      last->length += length;
+      return 0;
+    }
+  }
+  if (st->copy_count == st->copy_capacity) {
+    size_t capacity = st->copy_capacity ? st->copy_capacity * 2 : 64;
+    delta_copy *copies = realloc(st->copies, capacity * sizeof(delta_copy));
+    if (!copies) {
+      return -1;
+    }
+    st->copies = copies;
+    st->copy_capacity = capacity;
+  }
+  st->copies[st->copy_count++] = (delta_copy){old_offset, new_offset, length};
+  return 0;
+}
+
+// Find every stretch of new[start, end) that also occurs in the old file
+static int match_blocks(delta_state *st, size_t start, size_t end,
+                        size_t expected_old) {
+  const unsigned char *old_data = st->old_data;
+  const unsigned char *new_data = st->new_data;
+  size_t block = st->block;
+  size_t literal_start = start;
+  size_t pos = start;
+
+  if (end - start < block || st->old_size < block) {
+    return 0;
+  }
+  rolling_sum sum = sum_block(new_data + pos, block);
+  for (;;) {
+    size_t preferred = expected_old + (pos - literal_start);
+    size_t old_offset = find_match(st, sum_value(sum), pos, preferred);
+    if (old_offset != SIZE_MAX) {
+      // Grow the hit backwards into the pending literal, then forwards
+      size_t back = 0;
+      while (pos - back > literal_start && old_offset - back > 0 &&
+             new_data[pos - back - 1] == old_data[old_offset - back - 1]) {
+        back++;
+      }
+      size_t length = block;
+      while (pos + length < end && old_offset + length < st->old_size &&
+             new_data[pos + length] == old_data[old_offset + length]) {
+        length++;
+      }
+      if (add_copy(st, old_offset - back, pos - back, length + back) != 0) {
+        return -1;
+      }
+      pos += length;
+      literal_start = pos;
+      expected_old = old_offset + length;
+      if (end - pos < block) {
+        break;
+      }
+      sum = sum_block(new_data + pos, block);
+      continue;
+    }
+
+    if (pos + block >= end) {
+      break;
+    }
+    sum_roll(&sum, new_data[pos], new_data[pos + block], block);
+    pos++;
+  }
+  return 0;
+}
+
+static int compare_old_offset(const void *a, const void *b) {
+  const delta_copy *x = a, *y = b;
+  return (x->old_offset > y->old_offset) - (x->old_offset < y->old_offset);
+}
+
+// Old-file spans reused by at least one copy, sorted and merged
+static size_t merge_coverage(const delta_state *st, delta_copy *spans) {
+  // A full rewrite matches nothing and has no copies array at all
+  if (st->copy_count == 0) {
+    return 0;
+  }
+  memcpy(spans, st->copies, st->copy_count * sizeof(delta_copy));
+  qsort(spans, st->copy_count, sizeof(delta_copy), compare_old_offset);
+  size_t count = 0;
+  for (size_t i = 0; i < st->copy_count; i++) {
+    size_t end = spans[i].old_offset + spans[i].length;
+    if (count > 0 &&
+        spans[i].old_offset <= spans[count - 1].old_offset +
+                                   spans[count - 1].length) {
+      size_t last_end = spans[count - 1].old_offset + spans[count - 1].length;
+      if (end > last_end) {
+        spans[count - 1].length = end - spans[count - 1].old_offset;
+      }
+    } else {
+      spans[count++] = spans[i];
+    }
+  }
+  return count;
+}
+
+// Bytes of old[start, end) that no copy reuses
+static size_t uncovered(const delta_copy *spans, size_t count, size_t start,
+                        size_t end) {
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (spans[mid].old_offset + spans[mid].length <= start) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  size_t missing = end - start;
+  for (size_t i = lo; i < count && spans[i].old_offset < end; i++) {
+    size_t s = spans[i].old_offset > start ? spans[i].old_offset : start;
+    size_t e = spans[i].old_offset + spans[i].length;
+    if (e > end) {
+      e = end;
+    }
+    missing -= e - s;
+  }
+  return missing;
+}
+
+static int add_region(bin_delta *delta, delta_region region) {
+  if (delta->count == delta->capacity) {
+    size_t capacity = delta->capacity ? delta->capacity * 2 : 16;
+    delta_region *regions =
+        realloc(delta->regions, capacity * sizeof(delta_region));
+    if (!regions) {
+      return -1;
+    }
+    delta->regions = regions;
+    delta->capacity = capacity;
+  }
+  delta->regions[delta->count++] = region;
+  return 0;
+}
+
+// The stretch between two copies: new bytes, dropped old bytes, or both
+static int add_gap(bin_delta *delta, size_t new_offset, size_t new_length,
+                   size_t old_offset, size_t old_length) {
+  delta_region_kind kind;
+  if (new_length > 0 && old_length > 0) {
+    kind = REGION_REPLACED;
+  } else if (new_length > 0) {
+    kind = REGION_INSERTED;
+  } else if (old_length > 0) {
+    kind = REGION_DELETED;
+  } else {
+    return 0;
+  }
+  return add_region(delta, (delta_region){kind, new_offset, new_length,
+                                          old_offset, old_length});
+}
+
+// Walk the copies in new-file order and describe what lies between them
+static int build_regions(const delta_state *st, bin_delta *delta) {
+  delta_copy *spans =
+      malloc((st->copy_count ? st->copy_count : 1) * sizeof(delta_copy));
+  if (!spans) {
+    return -1;
+  }
+  size_t span_count = merge_coverage(st, spans);
+
+  size_t covered = 0;
+  for (size_t i = 0; i < span_count; i++) {
+    covered += spans[i].length;
+  }
+  delta->bytes_deleted = st->old_size - covered;
+
+  size_t expected_old = 0, new_pos = 0;
+  int rc = 0;
+  for (size_t i = 0; i < st->copy_count && rc == 0; i++) {
+    const delta_copy *copy = &st->copies[i];
+    size_t literal = copy->new_offset - new_pos;
+    delta->bytes_inserted += literal;
+
+    if (copy->old_offset >= expected_old) {
+      rc = add_gap(delta, new_pos, literal, expected_old,
+                   uncovered(spans, span_count, expected_old,
+                             copy->old_offset));
+      expected_old = copy->old_offset + copy->length;
+    } else {
+      // Jumped back in the old file: this stretch was moved
+      rc = add_gap(delta, new_pos, literal, expected_old, 0);
+      if (rc == 0) {
+        rc = add_region(delta, (delta_region){REGION_MOVED, copy->new_offset,
+                                              copy->length, copy->old_offset,
+                                              copy->length});
+      }
+      delta->bytes_moved += copy->length;
+      if (copy->old_offset + copy->length > expected_old) {
+        expected_old = copy->old_offset + copy->length;
+      }
+    }
+    new_pos = copy->new_offset + copy->length;
+  }
+
+  if (rc == 0) {
+    size_t literal = st->new_size - new_pos;
+    delta->bytes_inserted += literal;
+    size_t dropped = expected_old < st->old_size
+                         ? uncovered(spans, span_count, expected_old,
+                                     st->old_size)
+                         : 0;
+    rc = add_gap(delta, new_pos, literal, expected_old, dropped);
+  }
+  free(spans);
+  return rc;
+}
+
+static size_t pick_block_size(size_t old_size) {
+  size_t block = MIN_BLOCK;
+  while (block < MAX_BLOCK && block * block * 4 < old_size) {
+    block <<= 1;
+  }
+  return block;
+}
+
+int bindelta_compute(const unsigned char *old_data, size_t old_size,
+                     const unsigned char *new_data, size_t new_size,
+                     bin_delta *delta) {
+  memset(delta, 0, sizeof(*delta));
+  delta->old_size = old_size;
+  delta->new_size = new_size;
+
+  delta_state st = {0};
+  st.old_data = old_data;
+  st.old_size = old_size;
+  st.new_data = new_data;
+  st.new_size = new_size;
+  st.block = pick_block_size(old_size);
+  delta->block_size = st.block;
+
+  // In-place edits are the common case; settle the shared ends first
+  size_t limit = old_size < new_size ? old_size : new_size;
+  size_t prefix = 0;
+  while (prefix < limit && old_data[prefix] == new_data[prefix]) {
+    prefix++;
+  }
+  size_t suffix = 0;
+  while (suffix < limit - prefix &&
+         old_data[old_size - suffix - 1] == new_data[new_size - suffix - 1]) {
+    suffix++;
+  }
+
+  int rc = build_index(&st);
+  if (rc == 0) {
+    rc = add_copy(&st, 0, 0, prefix);
+  }
+  if (rc == 0) {
+    rc = match_blocks(&st, prefix, new_size - suffix, prefix);
+  }
+  if (rc == 0) {
+    rc = add_copy(&st, old_size - suffix, new_size - suffix, suffix);
+  }
+  if (rc == 0) {
+    rc = build_regions(&st, delta);
+  }
+
+  free(st.slots);
+  free(st.copies);
+  if (rc != 0) {
+    bindelta_free(delta);
+  }
+  return rc;
+}
+
+void bindelta_free(bin_delta *delta) {
+  free(delta->regions);
+  memset(delta, 0, sizeof(*delta));
+}
@@ -1,54 +1,11 @@
 #include "cache.h"
 #include <dirent.h>
 #include <errno.h>
-#include <fcntl.h>
-#include <libgen.h>
 #include <limits.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-int copy_file(const char *src, const char *dest) {
-  struct stat statbuf;
-
-  // Check if the destination is a directory
-  if (stat(dest, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
-    fprintf(stderr, "Failed to open destination file: %s is a directory\n",
-            dest);
-    return -1;
-  }
-
-  int src_fd = open(src, O_RDONLY);
-  if (src_fd < 0) {
-    perror("Failed to open source file");
-    return -1;
-  }
-
-  int dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-  if (dest_fd < 0) {
-    perror("Failed to open destination file");
-    close(src_fd);
-
-    return -1;
-  }
-
-  char buffer[4096];
-  ssize_t bytes_read;
-  while ((bytes_read = read(src_fd, buffer, sizeof(buffer))) > 0) {
-    ssize_t result = write(dest_fd, buffer, bytes_read);
-    if (result < 0) {
-      perror("Failed to write to destination file");
-      close(src_fd);
-      close(dest_fd);
-      return -1;
-    }
-  }
-
-  close(src_fd);
-  close(dest_fd);
-  return 0;
-}
-
 void remove_directory(const char *path) {
   DIR *dir = opendir(path);
   if (dir) {
@@ -75,66 +32,120 @@ void remove_directory(const char *path) {
   }
 }
 
-void create_caches(int max_files, const char *cache_dir, char *watch_paths[],
-                   char *cached_paths[], int verbose) {
-  if (!cache_dir || !watch_paths || !cached_paths) {
-    return;
+int create_caches(const char *cache_dir, sqwatch_config *config) {
+  if (!cache_dir || !config) {
+    return -1;
   }
+  snapshot_store *store = &config->snapshots;
+  const meta_index *saved = config->saved.slots ? &config->saved : NULL;
+  int verbose = config->verbose;
 
   // Create cache directory if it doesn't exist
   struct stat st;
   if (stat(cache_dir, &st) != 0) {
     if (mkdir(cache_dir, 0755) != 0) {
       perror("Failed to create cache directory");
-      return;
+      return -1;
+    }
+  }
+  if (snapshot_init(store, cache_dir, config->snapshot_codec) != 0) {
+    return -1;
+  }
+  store->budget = config->cache_budget;
+
+  // Paths from the saved index point back at the snapshots they had, so
+  // files changed while we were down diff against their old content.
+  // Objects the index listed that nothing points at any more are dropped.
+  if (saved) {
+    snapshot_digest *listed = malloc((saved->count + 1) * sizeof(*listed));
+    if (!listed) {
+      return -1;
+    }
+    size_t listed_count = 0;
+    size_t restored = 0;
+    size_t iter = 0;
+    meta_entry *old;
+    while ((old = metaindex_next(saved, &iter)) != NULL) {
+      if (!old->has_content) {
+        continue;
+      }
+      snapshot_digest digest = {old->content_hash, old->content_size};
+      listed[listed_count++] = digest;
+      if (snapshot_restore(store, old->path, digest, old->mtime_ns) == 0) {
+        restored++;
+      }
+    }
+    size_t pruned = snapshot_prune(store, listed, listed_count);
+    free(listed);
+    if (verbose) {
+      printf(DARK_GREY "+ Reused %zu snapshots, pruned %zu stale objects\n" RESET,
+             restored, pruned);
     }
   }
 
-  // For each watched path, create a cache file
-  for (int i = 0; i < max_files; i++) {
-    if (watch_paths[i] != NULL) {
-      char dest_path[PATH_MAX];
-      snprintf(dest_path, sizeof(dest_path), "%s/%s", cache_dir,
-               basename(watch_paths[i]));
+  // Snapshot every other watched file, most recently modified first;
+  // identical content is stored once
+  snapshot_prefetch_item *items =
+      malloc((config->registry.count + 1) * sizeof(snapshot_prefetch_item));
+  if (!items) {
+    return -1;
+  }
+  size_t count = 0;
+  size_t iter = 0;
+  watch_entry *entry;
+  while ((entry = registry_next(&config->registry, &iter)) != NULL) {
+    snapshot_digest digest;
+    if (entry->is_dir || snapshot_lookup(store, entry->path, &digest)) {
+      continue;
+    }
+    meta_entry *meta = metaindex_lookup(&config->meta, entry->path);
+    items[count].path = strdup(entry->path);
+    items[count].mtime_ns = meta ? meta->mtime_ns : 0;
+    if (items[count].path) {
+      count++;
+    }
+  }
+  snapshot_prefetch_start(&config->prefetch, store, items, count,
+                          config->lazy_cache, verbose);
+  if (config->lazy_cache) {
+    if (verbose) {
+      printf(DARK_GREY "+ Capturing %zu snapshots in the background\n" RESET,
+             count);
+    }
+    return 0;
+  }
 
-      if (copy_file(watch_paths[i], dest_path) == 0) {
-        cached_paths[i] = strdup(dest_path);
-        if (verbose) {
-          printf(DARK_GREY "+ Cached [%d]: %s -> %s\n" RESET, i, watch_paths[i],
-                 dest_path);
-        }
+  if (verbose) {
+    printf(DARK_GREY "+ Snapshot store: %zu files, %zu objects, %llu bytes "
+                     "(%llu uncompressed, %s)\n" RESET,
+           store->ref_count, store->object_count,
+           (unsigned long long)store->stored_bytes,
+           (unsigned long long)store->raw_bytes,
+           codec_name(store->codec));
+    for (int m = COPY_REFLINK; m < COPY_METHOD_COUNT; m++) {
+      if (store->copies[m] > 0) {
+        printf(DARK_GREY "+ Snapshot copies via %s: %zu\n" RESET,
+               copy_method_name(m), store->copies[m]);
       }
     }
   }
+  return 0;
 }
 
-void create_cache_for_file(const char *path, const char *cache_dir,
-                          char **cached_path, int verbose) {
-    if (!path || !cache_dir || !cached_path) {
+void create_cache_for_file(snapshot_store *store, const char *path,
+                           int verbose) {
+    if (!store || !path) {
         return;
     }
-    
-    char *path_copy = strdup(path);
-    if (!path_copy) {
+
+    // Only snapshot the file if it isn't indexed yet
+    snapshot_digest digest;
+    if (snapshot_lookup(store, path, &digest)) {
         return;
     }
-    
-    char *base = basename(path_copy);
-    char cache_path[PATH_MAX];
-    snprintf(cache_path, sizeof(cache_path), "%s/%s", cache_dir, base);
-    
-    // Always update the cached_path pointer
-    *cached_path = strdup(cache_path);
-    
-    // Only copy the file if it doesn't exist in cache
-    struct stat cache_stat;
-    if (stat(cache_path, &cache_stat) != 0) {
-        if (copy_file(path, cache_path) == 0) {
-            if (verbose) {
-                printf(DARK_GREY "+ Cached: %s -> %s\n" RESET, path, cache_path);
-            }
-        }
+    copy_method method;
+    if (snapshot_capture_file(store, path, &method) == 0 && verbose) {
+        printf(DARK_GREY "+ Cached: %s (%s)\n" RESET, path,
+               copy_method_name(method));
     }
-    
-    free(path_copy);
 }
@@ -0,0 +1,93 @@
+#include "coalesce.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_RECORDS 64
+
+static int grow_index(coalesce_table *t, size_t capacity) {
+  uint32_t *index = calloc(capacity, sizeof(uint32_t));
+  if (!index) {
+    return -1;
+  }
+  size_t mask = capacity - 1;
+  for (size_t r = 0; r < t->count; r++) {
+    size_t i = t->events[r].hash & mask;
+    while (index[i] != 0) {
+      i = (i + 1) & mask;
+    }
+    index[i] = (uint32_t)(r + 1);
+  }
+  free(t->index);
+  t->index = index;
+  t->index_capacity = capacity;
+  return 0;
+}
+
+int coalesce_init(coalesce_table *t) {
+  memset(t, 0, sizeof(*t));
+  t->events = malloc(INITIAL_RECORDS * sizeof(coalesced_event));
+  if (!t->events) {
+    return -1;
+  }
+  t->capacity = INITIAL_RECORDS;
+  return grow_index(t, INITIAL_RECORDS * 2);
+}
+
+// Merge an event into the table. Returns 1 for a new record, 0 when it was
+// folded into an existing one, -1 on allocation failure.
+int coalesce_add(coalesce_table *t, const char *path, uint32_t mask) {
+  uint64_t hash = hash_string(path);
+  size_t slot_mask = t->index_capacity - 1;
+  size_t i = hash & slot_mask;
+  while (t->index[i] != 0) {
+    coalesced_event *event = &t->events[t->index[i] - 1];
+    if (event->hash == hash && strcmp(event->path, path) == 0) {
+      event->mask |= mask;
+      return 0;
+    }
+    i = (i + 1) & slot_mask;
+  }
+
+  if (t->count == t->capacity) {
+    size_t capacity = t->capacity * 2;
+    coalesced_event *events =
+        realloc(t->events, capacity * sizeof(coalesced_event));
+    if (!events) {
+      return -1;
+    }
+    t->events = events;
+    t->capacity = capacity;
+  }
+
+  char *path_copy = strdup(path);
+  if (!path_copy) {
+    return -1;
+  }
+  coalesced_event *event = &t->events[t->count];
+  event->path = path_copy;
+  event->hash = hash;
+  event->mask = mask;
+  t->index[i] = (uint32_t)(++t->count);
+
+  // Keep the index at most half full
+  if (t->count * 2 > t->index_capacity) {
+    grow_index(t, t->index_capacity * 2);
+  }
+  return 1;
+}
+
+void coalesce_clear(coalesce_table *t) {
+  for (size_t r = 0; r < t->count; r++) {
+    free(t->events[r].path);
+  }
+  t->count = 0;
+  memset(t->index, 0, t->index_capacity * sizeof(uint32_t));
+}
+
+void coalesce_free(coalesce_table *t) {
+  coalesce_clear(t);
+  free(t->events);
+  free(t->index);
+  memset(t, 0, sizeof(*t));
+}
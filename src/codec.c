@@ -0,0 +1,390 @@
+#include "codec.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef SQWATCH_ZSTD
+#include <zstd.h>
+#endif
+
+// LZ4-style sequences: a token (literal count in the high nibble, match
+// length - LZ_MIN_MATCH in the low one, 15 meaning more length bytes
+// follow), the literals, and a 16-bit little-endian match offset. The
+// last sequence carries literals only.
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+#define ZSTD_LEVEL 3
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t lz_hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *put_length(uint8_t *op, size_t length) {
+  while (length >= 255) {
+    *op++ = 255;
+    length -= 255;
+  }
+  *op++ = (uint8_t)length;
+  return op;
+}
+
+// Room for any sequence header around a run of literals
+size_t lz_bound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *literals,
+                             size_t literal_count, size_t offset,
+                             size_t match_length) {
+  size_t extra = match_length ? match_length - LZ_MIN_MATCH : 0;
+  *op++ = (uint8_t)(((literal_count < 15 ? literal_count : 15) << 4) |
+                    (extra < 15 ? extra : 15));
+  if (literal_count >= 15) {
+    op = put_length(op, literal_count - 15);
+  }
+  memcpy(op, literals, literal_count);
+  op += literal_count;
+  if (match_length) {
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    if (extra >= 15) {
+      op = put_length(op, extra - 15);
+    }
+  }
+  return op;
+}
+
+// Greedy single-probe compressor. Returns the compressed size, or 0 when
+// the result would not fit in capacity.
+size_t lz_compress(const uint8_t *src, size_t size, uint8_t *dst,
+                   size_t capacity) {
+  uint32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0, sizeof(table));
+  const uint8_t *ip = src;
+  const uint8_t *anchor = src;
+  const uint8_t *end = src + size;
+  uint8_t *op = dst;
+
+  while (size >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+    uint32_t h = lz_hash(read32(ip));
+    const uint8_t *ref = src + table[h];
+    table[h] = (uint32_t)(ip - src);
+    if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != read32(ip)) {
+      ip++;
+      continue;
+    }
+    size_t match_length = LZ_MIN_MATCH;
+    while (ip + match_length < end && ref[match_length] == ip[match_length]) {
+      match_length++;
+    }
+
+    size_t literal_count = (size_t)(ip - anchor);
+    size_t worst = 1 + literal_count / 255 + 1 + literal_count + 2 +
+                   match_length / 255 + 1;
+    if ((size_t)(dst + capacity - op) < worst) {
+      return 0;
+    }
+    op = put_sequence(op, anchor, literal_count, (size_t)(ip - ref),
+                      match_length);
+    ip += match_length;
+    anchor = ip;
+    // Index the tail of the match so the next repeat of it is found
+    if (ip <= end - LZ_MIN_MATCH) {
+      table[lz_hash(read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+    }
+  }
+
+  size_t literal_count = (size_t)(end - anchor);
+  if ((size_t)(dst + capacity - op) < 1 + literal_count / 255 + 1 +
+                                          literal_count) {
+    return 0;
+  }
+  op = put_sequence(op, anchor, literal_count, 0, 0);
+  return (size_t)(op - dst);
+}
+
+static int get_length(const uint8_t **ip, const uint8_t *end,
+                      size_t *length) {
+  uint8_t b;
+  do {
+    if (*ip >= end) {
+      return -1;
+    }
+    b = *(*ip)++;
+    *length += b;
+  } while (b == 255);
+  return 0;
+}
+
+// Decode exactly raw_size bytes; anything malformed is an error rather
+// than a read or write out of bounds
+int lz_decompress(const uint8_t *src, size_t size, uint8_t *dst,
+                  size_t raw_size) {
+  const uint8_t *ip = src;
+  const uint8_t *end = src + size;
+  uint8_t *op = dst;
+  uint8_t *out_end = dst + raw_size;
+
+  while (ip < end) {
+    unsigned token = *ip++;
+    size_t literal_count = token >> 4;
+    if (literal_count == 15 && get_length(&ip, end, &literal_count) != 0) {
+      return -1;
+    }
+    if (literal_count > (size_t)(end - ip) ||
+        literal_count > (size_t)(out_end - op)) {
+      return -1;
+    }
+    memcpy(op, ip, literal_count);
+    op += literal_count;
+    ip += literal_count;
+    if (ip == end) {
+      break;
+    }
+
+    if (end - ip < 2) {
+      return -1;
+    }
+    size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+    ip += 2;
+    size_t match_length = token & 15;
+    if (match_length == 15 && get_length(&ip, end, &match_length) != 0) {
+      return -1;
+    }
+    match_length += LZ_MIN_MATCH;
+    if (offset == 0 || offset > (size_t)(op - dst) ||
+        match_length > (size_t)(out_end - op)) {
+      return -1;
+    }
+    const uint8_t *ref = op - offset;
+    if (offset >= match_length) {
+      memcpy(op, ref, match_length);
+    } else {
+      // Overlapping copy repeats the last offset bytes
+      for (size_t i = 0; i < match_length; i++) {
+        op[i] = ref[i];
+      }
+    }
+    op += match_length;
+  }
+  return op == out_end ? 0 : -1;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+  const char *p = data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return -1;
+    }
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+static int read_all(int fd, void *data, size_t size) {
+  char *p = data;
+  while (size > 0) {
+    ssize_t n = read(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+static size_t block_bound(void) {
+#ifdef SQWATCH_ZSTD
+  size_t zstd = ZSTD_compressBound(CODEC_BLOCK_SIZE);
+  size_t lz = lz_bound(CODEC_BLOCK_SIZE);
+  return zstd > lz ? zstd : lz;
+#else
+  return lz_bound(CODEC_BLOCK_SIZE);
+#endif
+}
+
+// Compress one block; 0 means store it as is
+static size_t compress_block(snapshot_codec codec, const uint8_t *src,
+                             size_t size, uint8_t *dst, size_t capacity) {
+#ifdef SQWATCH_ZSTD
+  if (codec == CODEC_ZSTD) {
+    size_t n = ZSTD_compress(dst, capacity, src, size, ZSTD_LEVEL);
+    return ZSTD_isError(n) ? 0 : n;
+  }
+#endif
+  (void)codec;
+  return lz_compress(src, size, dst, capacity);
+}
+
+static int decompress_block(snapshot_codec codec, const uint8_t *src,
+                            size_t size, uint8_t *dst, size_t raw_size) {
+#ifdef SQWATCH_ZSTD
+  if (codec == CODEC_ZSTD) {
+    size_t n = ZSTD_decompress(dst, raw_size, src, size);
+    return ZSTD_isError(n) || n != raw_size ? -1 : 0;
+  }
+#endif
+  if (codec != CODEC_LZ) {
+    return -1;
+  }
+  return lz_decompress(src, size, dst, raw_size);
+}
+
+// Write data to fd as a compressed object, block by block
+int codec_write(int fd, snapshot_codec codec, const void *data, size_t size,
+                uint64_t *written) {
+  codec_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CODEC_MAGIC, sizeof(header.magic));
+  header.codec = (uint8_t)codec;
+  header.raw_size = size;
+  if (write_all(fd, &header, sizeof(header)) != 0) {
+    return -1;
+  }
+  uint64_t total = sizeof(header);
+
+  size_t capacity = block_bound();
+  uint8_t *out = malloc(sizeof(codec_block) + capacity);
+  if (!out) {
+    return -1;
+  }
+  const uint8_t *p = data;
+  for (size_t off = 0; off < size; off += CODEC_BLOCK_SIZE) {
+    size_t raw = size - off < CODEC_BLOCK_SIZE ? size - off : CODEC_BLOCK_SIZE;
+    size_t stored = compress_block(codec, p + off, raw,
+                                   out + sizeof(codec_block), capacity);
+    codec_block block = {(uint32_t)raw, (uint32_t)raw};
+    int ok;
+    if (stored > 0 && stored < raw) {
+      block.stored_size = (uint32_t)stored;
+      memcpy(out, &block, sizeof(block));
+      ok = write_all(fd, out, sizeof(block) + stored) == 0;
+    } else {
+      ok = write_all(fd, &block, sizeof(block)) == 0 &&
+           write_all(fd, p + off, raw) == 0;
+    }
+    if (!ok) {
+      free(out);
+      return -1;
+    }
+    total += sizeof(block) + block.stored_size;
+  }
+  free(out);
+  if (written) {
+    *written = total;
+  }
+  return 0;
+}
+
+static int read_header(int fd, codec_header *header) {
+  if (read_all(fd, header, sizeof(*header)) != 0 ||
+      memcmp(header->magic, CODEC_MAGIC, sizeof(header->magic)) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static int decodable(uint8_t codec) {
+#ifdef SQWATCH_ZSTD
+  if (codec == CODEC_ZSTD) {
+    return 1;
+  }
+#endif
+  return codec == CODEC_LZ;
+}
+
+// Read an object's header. Fails unless this build can decode the object,
+// so objects from a zstd build are not trusted by one without it.
+int codec_probe(int fd, uint64_t *raw_size) {
+  codec_header header;
+  if (read_header(fd, &header) != 0 || !decodable(header.codec)) {
+    return -1;
+  }
+  *raw_size = header.raw_size;
+  return 0;
+}
+
+// Decompress an object into dst, which holds exactly its raw size. Blocks
+// are decoded as they are read; stored blocks are read straight into dst.
+int codec_read(int fd, void *dst, size_t size) {
+  codec_header header;
+  if (read_header(fd, &header) != 0 || header.raw_size != size) {
+    return -1;
+  }
+  uint8_t *in = malloc(block_bound());
+  if (!in) {
+    return -1;
+  }
+  uint8_t *out = dst;
+  size_t off = 0;
+  int rc = 0;
+  while (off < size) {
+    codec_block block;
+    if (read_all(fd, &block, sizeof(block)) != 0 ||
+        block.raw_size > size - off || block.raw_size > CODEC_BLOCK_SIZE ||
+        block.stored_size > block.raw_size) {
+      rc = -1;
+      break;
+    }
+    if (block.stored_size == block.raw_size) {
+      rc = read_all(fd, out + off, block.raw_size);
+    } else {
+      rc = read_all(fd, in, block.stored_size);
+      if (rc == 0) {
+        rc = decompress_block(header.codec, in, block.stored_size, out + off,
+                              block.raw_size);
+      }
+    }
+    if (rc != 0) {
+      break;
+    }
+    off += block.raw_size;
+  }
+  free(in);
+  return rc;
+}
+
+int parse_codec(const char *text, snapshot_codec *codec) {
+  if (strcmp(text, "none") == 0) {
+    *codec = CODEC_NONE;
+  } else if (strcmp(text, "lz") == 0) {
+    *codec = CODEC_LZ;
+  } else if (strcmp(text, "zstd") == 0) {
+#ifdef SQWATCH_ZSTD
+    *codec = CODEC_ZSTD;
+#else
+    return -1;
+#endif
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+const char *codec_name(snapshot_codec codec) {
+  switch (codec) {
+  case CODEC_NONE:
+    return "none";
+  case CODEC_LZ:
+    return "lz";
+  case CODEC_ZSTD:
+    return "zstd";
+  }
+  return "unknown";
+}
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include "copy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define COPY_CHUNK (1 << 30)       // per copy_file_range/sendfile call
+#define COPY_BUFFER_SIZE (256 * 1024)
+
+// Errors that mean "this mechanism can't do it here", not "the copy failed"
+static int unsupported(int err) {
+  return err == ENOSYS || err == EXDEV || err == EINVAL || err == EOPNOTSUPP ||
+         err == ENOTSUP || err == EBADF || err == ETXTBSY;
+}
+
+// Each copier continues from the current file offsets, so a later one can
+// pick up wherever an earlier one gave up. Returns 1 when done, 0 when the
+// mechanism is unsupported, -1 on error.
+static int copy_range(int src_fd, int dest_fd) {
+  for (;;) {
+    ssize_t n = copy_file_range(src_fd, NULL, dest_fd, NULL, COPY_CHUNK, 0);
+    if (n > 0) {
+      continue;
+    }
+    if (n == 0) {
+      return 1;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return unsupported(errno) ? 0 : -1;
+  }
+}
+
+static int copy_sendfile(int src_fd, int dest_fd) {
+  for (;;) {
+    ssize_t n = sendfile(dest_fd, src_fd, NULL, COPY_CHUNK);
+    if (n > 0) {
+      continue;
+    }
+    if (n == 0) {
+      return 1;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return unsupported(errno) ? 0 : -1;
+  }
+}
+
+static int copy_buffer(int src_fd, int dest_fd) {
+  char *buffer = malloc(COPY_BUFFER_SIZE);
+  if (!buffer) {
+    return -1;
+  }
+
+  int rc = 1;
+  for (;;) {
+    ssize_t bytes_read = read(src_fd, buffer, COPY_BUFFER_SIZE);
+    if (bytes_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read <= 0) {
+      rc = bytes_read == 0 ? 1 : -1;
+      break;
+    }
+
+    // write() may take less than asked; keep going until it's all out
+    ssize_t written = 0;
+    while (written < bytes_read) {
+      ssize_t n = write(dest_fd, buffer + written, bytes_read - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        rc = -1;
+        break;
+      }
+      written += n;
+    }
+    if (rc < 0) {
+      break;
+    }
+  }
+  free(buffer);
+  return rc;
+}
+
+// Copy src to dest with the cheapest mechanism the filesystems allow:
+// reflink, then copy_file_range, then sendfile, then a large buffer
+int copy_file_method(const char *src, const char *dest, copy_method *method) {
+  struct stat statbuf;
+  if (method) {
+    *method = COPY_NONE;
+  }
+
+  // Check if the destination is a directory
+  if (stat(dest, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
+    fprintf(stderr, "Failed to open destination file: %s is a directory\n",
+            dest);
+    return -1;
+  }
+
+  int src_fd = open(src, O_RDONLY | O_CLOEXEC);
+  if (src_fd < 0) {
+    perror("Failed to open source file");
+    return -1;
+  }
+
+  int dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (dest_fd < 0) {
+    perror("Failed to open destination file");
+    close(src_fd);
+    return -1;
+  }
+
+  copy_method used = COPY_REFLINK;
+  int rc = ioctl(dest_fd, FICLONE, src_fd) == 0 ? 1 : 0;
+  if (rc == 0) {
+    used = COPY_FILE_RANGE;
+    rc = copy_range(src_fd, dest_fd);
+  }
+  if (rc == 0) {
+    used = COPY_SENDFILE;
+    rc = copy_sendfile(src_fd, dest_fd);
+  }
+  if (rc == 0) {
+    used = COPY_BUFFER;
+    rc = copy_buffer(src_fd, dest_fd);
+  }
+
+  if (rc < 0) {
+    perror("Failed to write to destination file");
+  } else if (method) {
+    *method = used;
+  }
+  close(src_fd);
+  if (close(dest_fd) != 0 && rc > 0) {
+    perror("Failed to write to destination file");
+    rc = -1;
+  }
+  return rc > 0 ? 0 : -1;
+}
+
+int copy_file(const char *src, const char *dest) {
+  return copy_file_method(src, dest, NULL);
+}
+
+const char *copy_method_name(copy_method method) {
+  switch (method) {
+  case COPY_REFLINK:
+    return "reflink";
+  case COPY_FILE_RANGE:
+    return "copy_file_range";
+  case COPY_SENDFILE:
+    return "sendfile";
+  case COPY_BUFFER:
+    return "buffered";
+  default:
+    return "none";
+  }
+}
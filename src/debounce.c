@@ -0,0 +1,137 @@
+#include "debounce.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+void debounce_init(debouncer *d, debounce_mode mode, uint64_t window_ns,
+                   uint64_t max_wait_ns) {
+  memset(d, 0, sizeof(*d));
+  d->mode = mode;
+  d->window_ns = window_ns;
+  d->max_wait_ns = max_wait_ns;
+}
+
+// Record an event. Returns 1 if it should fire right away.
+int debounce_event(debouncer *d, uint64_t now_ns) {
+  if (d->window_ns == 0) {
+    return 1;
+  }
+
+  if (d->mode == DEBOUNCE_LEADING) {
+    if (!d->in_window) {
+      d->in_window = 1;
+      d->pending = 0;
+      d->first_ns = now_ns;
+      d->last_ns = now_ns;
+      return 1;
+    }
+    if (!d->pending) {
+      d->first_ns = now_ns;
+    }
+    d->pending = 1;
+    d->last_ns = now_ns;
+    return 0;
+  }
+
+  if (!d->pending) {
+    d->pending = 1;
+    d->first_ns = now_ns;
+  }
+  d->last_ns = now_ns;
+  return 0;
+}
+
+// Saturating add, so a huge window waits forever rather than wrapping
+static uint64_t add_ns(uint64_t t, uint64_t ns) {
+  return ns > UINT64_MAX - t ? UINT64_MAX : t + ns;
+}
+
+// Absolute time the scheduler next needs to run, 0 if idle
+uint64_t debounce_deadline(const debouncer *d) {
+  if (d->window_ns == 0) {
+    return 0;
+  }
+  if (!d->pending && !(d->mode == DEBOUNCE_LEADING && d->in_window)) {
+    return 0;
+  }
+
+  uint64_t deadline = add_ns(d->last_ns, d->window_ns);
+  if (d->pending && d->max_wait_ns > 0 &&
+      add_ns(d->first_ns, d->max_wait_ns) < deadline) {
+    deadline = add_ns(d->first_ns, d->max_wait_ns);
+  }
+  return deadline;
+}
+
+// Called when the timer fires. Returns 1 if the owed trailing trigger
+// should fire now; the final change of a burst always fires exactly once.
+int debounce_expire(debouncer *d, uint64_t now_ns) {
+  uint64_t deadline = debounce_deadline(d);
+  if (deadline == 0 || now_ns < deadline) {
+    return 0;
+  }
+
+  int fire = d->pending;
+  d->pending = 0;
+  d->in_window = 0;
+  return fire;
+}
+
+uint64_t debounce_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// "250ms", "500us", "2s", "0.5" -- a bare number is seconds
+int parse_duration_ns(const char *text, uint64_t *out_ns) {
+  char *end = NULL;
+  double value = strtod(text, &end);
+  if (end == text || !isfinite(value) || value < 0) {
+    return -1;
+  }
+
+  double scale;
+  if (*end == '\0' || strcmp(end, "s") == 0) {
+    scale = 1e9;
+  } else if (strcmp(end, "ms") == 0) {
+    scale = 1e6;
+  } else if (strcmp(end, "us") == 0) {
+    scale = 1e3;
+  } else if (strcmp(end, "ns") == 0) {
+    scale = 1;
+  } else {
+    return -1;
+  }
+  // Converting a double at or past 2^64 to uint64_t is undefined
+  if (value * scale >= 18446744073709551616.0) {
+    return -1;
+  }
+  *out_ns = (uint64_t)(value * scale);
+  return 0;
+}
+
+int parse_debounce_mode(const char *text, debounce_mode *out) {
+  if (strcmp(text, "trailing") == 0) {
+    *out = DEBOUNCE_TRAILING;
+  } else if (strcmp(text, "leading") == 0) {
+    *out = DEBOUNCE_LEADING;
+  } else if (strcmp(text, "max-wait") == 0) {
+    *out = DEBOUNCE_MAX_WAIT;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+const char *debounce_mode_name(debounce_mode mode) {
+  switch (mode) {
+  case DEBOUNCE_LEADING:
+    return "leading";
+  case DEBOUNCE_MAX_WAIT:
+    return "max-wait";
+  default:
+    return "trailing";
+  }
+}
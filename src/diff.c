@@ -1,543 +1,575 @@
 #include "cache.h"
 #include "diff.h"
-#include <errno.h>
-#include <fcntl.h>
-#include <libgen.h>
+#include "hash.h"
 #include <string.h>
-#include <sys/stat.h>
 #include <time.h>
-#include <unistd.h>
-
-#define MAX_LINE_LENGTH 1024
 
 static void free_file_lines(file_lines *fl) {
-  if (fl->lines) {
-    for (int i = 0; i < fl->count; i++) {
-      free(fl->lines[i]);
-    }
-    free(fl->lines);
-  }
+  ingest_release(&fl->content);
+  free(fl->lines);
+  free(fl->hashes);
+  *fl = (file_lines){0};
 }
 
-static file_lines read_file_lines(const char *filename) {
-  file_lines fl = {NULL, 0};
-  int retry_count = 0;
-  FILE *file = NULL;
-
-  // Try to open the file a few times with a small delay
-  while ((file = fopen(filename, "r")) == NULL && retry_count < 3) {
-    usleep(10000); // Wait 10ms between retries
-    retry_count++;
-  }
-  if (!file) {
-    fprintf(stderr, RED "Failed to open %s after %d retries: %s\n" RESET,
-            filename, retry_count, strerror(errno));
-    return fl;
-  }
-
-  // Get file size with retries for empty files
-  struct stat st;
-  retry_count = 0;
-  int fd = fileno(file);
-  while (retry_count < 5) { // Try up to 5 times
-    if (fstat(fd, &st) < 0) {
-      fprintf(stderr, RED "Failed to stat %s: %s\n" RESET, filename,
-              strerror(errno));
-      fclose(file);
-      return fl;
-    }
-
-    if (st.st_size > 0) {
-      break; // File has content, proceed
-    }
+static inline const char *line_text(const file_lines *fl, int i) {
+  return fl->content.data + fl->lines[i].offset;
+}
 
-    // Wait before retry
-    usleep(50000); // 50ms delay between attempts
-    retry_count++;
+// Find every line boundary in one vectorized pass, then hash each line
+// once so comparisons never touch the text
+static int split_file_lines(file_lines *fl) {
+  if (fl->content.size == 0) {
+    return 0;
   }
-
-  if (st.st_size == 0) {
-    fprintf(stderr, DARK_GREY "File %s is empty after %d attempts\n" RESET, filename,
-            retry_count);
-    fclose(file);
-    return fl;
+  int count = linescan_split(fl->content.data, fl->content.size, &fl->lines);
+  if (count < 0) {
+    return -1;
+  }
+  fl->count = count;
+  fl->hashes = malloc((count > 0 ? count : 1) * sizeof(uint64_t));
+  if (!fl->hashes) {
+    return -1;
   }
+  for (int i = 0; i < count; i++) {
+    fl->hashes[i] = hash_bytes(line_text(fl, i), fl->lines[i].length);
+  }
+  return 0;
+}
 
-  // Initialize buffer with reasonable capacity
-  char line[MAX_LINE_LENGTH];
-  int capacity = 16;
-  fl.lines = malloc(capacity * sizeof(char *));
-  if (!fl.lines) {
-    fprintf(stderr, RED "Failed to allocate initial buffer\n" RESET);
-    fclose(file);
-    return fl;
+typedef struct {
+  uint64_t hash;
+  size_t length;
+  const char *text;
+  uint32_t id;
+} intern_slot;
+
+// Map every line of both versions to an equivalence-class id; identical
+// lines share an id, so the diff engine only compares integers
+static int intern_lines(file_lines *cached, file_lines *current,
+                        uint32_t **old_ids, uint32_t **new_ids) {
+  size_t total = (size_t)cached->count + (size_t)current->count;
+  size_t capacity = 16;
+  while (capacity < total * 2) {
+    capacity <<= 1;
   }
 
-  // Read lines using fgets
-  while (fgets(line, sizeof(line), file)) {
-    // Remove trailing newline if present
-    size_t len = strlen(line);
-    if (len > 0 && line[len - 1] == '\n') {
-      line[len - 1] = '\0';
-    }
+  intern_slot *table = calloc(capacity, sizeof(intern_slot));
+  *old_ids = malloc((cached->count ? cached->count : 1) * sizeof(uint32_t));
+  *new_ids = malloc((current->count ? current->count : 1) * sizeof(uint32_t));
+  if (!table || !*old_ids || !*new_ids) {
+    free(table);
+    free(*old_ids);
+    free(*new_ids);
+    return -1;
+  }
 
-    if (fl.count == capacity) {
-      capacity *= 2;
-      char **new_lines = realloc(fl.lines, capacity * sizeof(char *));
-      if (!new_lines) {
-        fprintf(stderr, RED "Memory allocation failed\n" RESET);
-        free_file_lines(&fl);
-        fclose(file);
-        return (file_lines){NULL, 0};
+  uint32_t next_id = 1; // 0 marks an empty slot
+  file_lines *sides[2] = {cached, current};
+  uint32_t *ids[2] = {*old_ids, *new_ids};
+  for (int side = 0; side < 2; side++) {
+    file_lines *fl = sides[side];
+    for (int i = 0; i < fl->count; i++) {
+      uint64_t hash = fl->hashes[i];
+      size_t length = fl->lines[i].length;
+      const char *text = line_text(fl, i);
+      size_t slot = hash & (capacity - 1);
+      while (table[slot].id != 0 &&
+             !(table[slot].hash == hash && table[slot].length == length &&
+               memcmp(table[slot].text, text, length) == 0)) {
+        slot = (slot + 1) & (capacity - 1);
       }
-      fl.lines = new_lines;
-    }
-
-    fl.lines[fl.count] = strdup(line);
-    if (!fl.lines[fl.count]) {
-      fprintf(stderr, RED "Failed to strdup line\n" RESET);
-      free_file_lines(&fl);
-      fclose(file);
-      return (file_lines){NULL, 0};
+      if (table[slot].id == 0) {
+        table[slot] = (intern_slot){hash, length, text, next_id++};
+      }
+      ids[side][i] = table[slot].id;
     }
-    fl.count++;
   }
 
-  fclose(file);
-  return fl;
+  free(table);
+  return 0;
 }
 
-void print_diff(file_lines *current, file_lines *cached, int verbose) {
-  if (!verbose)
-    return;
-
-  int i = 0, j = 0;
-  int context_lines = 0;
-  int in_change_block = 0;
-  int lines_since_change = 0;
+// Run the diff engine once; the script feeds both the terminal and the log
+static int compute_line_diff(file_lines *current, file_lines *cached,
+                             edit_script *script) {
+  uint32_t *old_ids, *new_ids;
+  if (intern_lines(cached, current, &old_ids, &new_ids) != 0) {
+    return -1;
+  }
+  int rc = diff_compute(old_ids, cached->count, new_ids, current->count,
+                        script);
+  free(old_ids);
+  free(new_ids);
+  return rc;
+}
 
-  while (i < current->count && j < cached->count) {
-    if (strcmp(current->lines[i], cached->lines[j]) == 0) {
-      // Lines match - show context if needed
-      if (in_change_block && lines_since_change < context_lines) {
-        printf("  %d: %s\n", i + 1, current->lines[i]);
-      }
-      lines_since_change++;
-      if (lines_since_change >= context_lines) {
-        in_change_block = 0;
-      }
-      i++;
-      j++;
-    } else {
-      // Check for single line modification first
-      int next_i = i + 1;
-      int next_j = j + 1;
-      if (next_i < current->count && next_j < cached->count &&
-          strcmp(current->lines[next_i], cached->lines[next_j]) == 0) {
-        // Single line modification detected
-        if (!in_change_block) {
-          printf("\n");
-        }
-        in_change_block = 1;
-        lines_since_change = 0;
-        printf(RED "-%d: %s\n" RESET, j + 1, cached->lines[j]);
-        printf(GREEN "+%d: %s\n" RESET, i + 1, current->lines[i]);
-        i++;
-        j++;
-        continue;
-      }
+// Print each hunk (a maximal stretch of non-equal runs) as its removed
+// lines followed by its added lines
+static void render_diff(FILE *out, const edit_script *script,
+                        file_lines *current, file_lines *cached, int color) {
+  size_t r = 0;
+  while (r < script->count) {
+    if (script->runs[r].op == EDIT_EQUAL) {
+      r++;
+      continue;
+    }
 
-      // Lines differ - find next matching line
-      int next_match_i = i;
-      int next_match_j = j;
-      int found_match = 0;
-
-      // Look ahead for next matching line
-      for (int look_ahead = 1; look_ahead <= 10; look_ahead++) {
-        if (i + look_ahead < current->count && j < cached->count &&
-            strcmp(current->lines[i + look_ahead], cached->lines[j]) == 0) {
-          // Found match in current file
-          next_match_i = i + look_ahead;
-          next_match_j = j;
-          found_match = 1;
-          break;
-        }
-        if (i < current->count && j + look_ahead < cached->count &&
-            strcmp(current->lines[i], cached->lines[j + look_ahead]) == 0) {
-          // Found match in cached file
-          next_match_i = i;
-          next_match_j = j + look_ahead;
-          found_match = 1;
-          break;
-        }
-      }
+    size_t hunk_end = r;
+    while (hunk_end < script->count &&
+           script->runs[hunk_end].op != EDIT_EQUAL) {
+      hunk_end++;
+    }
 
-      // Print the changes
-      if (!in_change_block) {
-        printf("\n");
+    fprintf(out, "\n");
+    for (size_t h = r; h < hunk_end; h++) {
+      const edit_run *run = &script->runs[h];
+      if (run->op != EDIT_DELETE) {
+        continue;
       }
-      in_change_block = 1;
-      lines_since_change = 0;
-
-      // Print removed lines
-      while (j < next_match_j) {
-        printf(RED "-%d: %s\n" RESET, j + 1, cached->lines[j]);
-        j++;
+      for (int k = 0; k < run->count; k++) {
+        int j = run->old_start + k;
+        fprintf(out, "%s-%d: %.*s\n%s", color ? RED : "", j + 1,
+                (int)cached->lines[j].length, line_text(cached, j),
+                color ? RESET : "");
       }
-      // Print added lines
-      while (i < next_match_i) {
-        printf(GREEN "+%d: %s\n" RESET, i + 1, current->lines[i]);
-        i++;
+    }
+    for (size_t h = r; h < hunk_end; h++) {
+      const edit_run *run = &script->runs[h];
+      if (run->op != EDIT_INSERT) {
+        continue;
       }
-
-      if (!found_match) {
-        // No match found within look-ahead window
-        i++;
-        j++;
+      for (int k = 0; k < run->count; k++) {
+        int i = run->new_start + k;
+        fprintf(out, "%s+%d: %.*s\n%s", color ? GREEN : "", i + 1,
+                (int)current->lines[i].length, line_text(current, i),
+                color ? RESET : "");
       }
     }
+    r = hunk_end;
   }
-
-  // Print any remaining lines
-  while (i < current->count) {
-    printf(GREEN "+%d: %s\n" RESET, i + 1, current->lines[i]);
-    i++;
-  }
-  while (j < cached->count) {
-    printf(RED "-%d: %s\n" RESET, j + 1, cached->lines[j]);
-    j++;
-  }
-  printf(RESET "\n");
 }
 
-// Modified log_changes to include the diff output
-void log_changes(const char *log_file, const char *path, const char *event_type,
-                 file_lines *current, file_lines *cached) {
-  if (!log_file)
-    return;
-
-  FILE *log_fp = fopen(log_file, "a");
-  if (!log_fp) {
-    perror(RED "Failed to open log file" RESET);
+void print_diff(FILE *out, const edit_script *script, file_lines *current,
+                file_lines *cached, int verbose) {
+  if (!verbose)
     return;
-  }
 
-  time_t now = time(NULL);
-  char *timestamp = ctime(&now);
-  timestamp[strlen(timestamp) - 1] = '\0';
-
-  fprintf(log_fp, "\n=== Text File Diff ===\n");
-  fprintf(log_fp, "Time: %s\n", timestamp);
-  fprintf(log_fp, "File: %s\n", path);
-  fprintf(log_fp, "Event: %s\n", event_type);
-
-  int i = 0, j = 0;
-  int in_change_block = 0;
+  render_diff(out, script, current, cached, 1);
+  fprintf(out, RESET "\n");
+}
 
-  while (i < current->count && j < cached->count) {
-    if (strcmp(current->lines[i], cached->lines[j]) == 0) {
-      i++;
-      j++;
-    } else {
-      int next_match_i = i;
-      int next_match_j = j;
-      int found_match = 0;
-
-      // Look ahead for next matching line
-      for (int look_ahead = 1; look_ahead <= 10; look_ahead++) {
-        if (i + look_ahead < current->count && j < cached->count &&
-            strcmp(current->lines[i + look_ahead], cached->lines[j]) == 0) {
-          next_match_i = i + look_ahead;
-          next_match_j = j;
-          found_match = 1;
-          break;
-        }
-        if (i < current->count && j + look_ahead < cached->count &&
-            strcmp(current->lines[i], cached->lines[j + look_ahead]) == 0) {
-          next_match_i = i;
-          next_match_j = j + look_ahead;
-          found_match = 1;
-          break;
-        }
-      }
+// Hunks as JSON: 1-based start and line count on each side, then the
+// removed and added lines
+static void render_diff_json(FILE *out, const edit_script *script,
+                             file_lines *current, file_lines *cached) {
+  fputc('[', out);
+  int first = 1;
+  size_t r = 0;
+  while (r < script->count) {
+    if (script->runs[r].op == EDIT_EQUAL) {
+      r++;
+      continue;
+    }
 
-      // Print change block separator
-      if (!in_change_block) {
-        fprintf(log_fp, "\n");
+    size_t hunk_end = r;
+    int old_lines = 0, new_lines = 0;
+    while (hunk_end < script->count &&
+           script->runs[hunk_end].op != EDIT_EQUAL) {
+      const edit_run *run = &script->runs[hunk_end];
+      if (run->op == EDIT_DELETE) {
+        old_lines += run->count;
+      } else {
+        new_lines += run->count;
       }
-      in_change_block = 1;
+      hunk_end++;
+    }
 
-      while (j < next_match_j) {
-        fprintf(log_fp, "-%d: %s\n", j + 1, cached->lines[j]);
-        j++;
-      }
-      while (i < next_match_i) {
-        fprintf(log_fp, "+%d: %s\n", i + 1, current->lines[i]);
-        i++;
+    fprintf(out,
+            "%s{\"old_start\":%d,\"old_lines\":%d,\"new_start\":%d,"
+            "\"new_lines\":%d,\"removed\":[",
+            first ? "" : ",", script->runs[r].old_start + 1, old_lines,
+            script->runs[r].new_start + 1, new_lines);
+    first = 0;
+    int sep = 0;
+    for (size_t h = r; h < hunk_end; h++) {
+      const edit_run *run = &script->runs[h];
+      for (int k = 0; run->op == EDIT_DELETE && k < run->count; k++) {
+        int j = run->old_start + k;
+        fputs(sep++ ? "," : "", out);
+        log_json_string(out, line_text(cached, j), cached->lines[j].length);
       }
-
-      if (!found_match) {
-        i++;
-        j++;
+    }
+    fputs("],\"added\":[", out);
+    sep = 0;
+    for (size_t h = r; h < hunk_end; h++) {
+      const edit_run *run = &script->runs[h];
+      for (int k = 0; run->op == EDIT_INSERT && k < run->count; k++) {
+        int i = run->new_start + k;
+        fputs(sep++ ? "," : "", out);
+        log_json_string(out, line_text(current, i), current->lines[i].length);
       }
     }
+    fputs("]}", out);
+    r = hunk_end;
   }
+  fputc(']', out);
+}
 
-  // Handle remaining lines exactly like print_diff
-  if (i < current->count || j < cached->count) {
-    fprintf(log_fp, "\n"); // Separator for final block
-  }
-
-  while (i < current->count) {
-    fprintf(log_fp, "+%d: %s\n", i + 1, current->lines[i]);
-    i++;
-  }
-  while (j < cached->count) {
-    fprintf(log_fp, "-%d: %s\n", j + 1, cached->lines[j]);
-    j++;
-  }
+// Fields every JSON record starts with
+static void json_record_header(FILE *out, const diff_event *event,
+                               const char *kind, uint64_t time_ns) {
+  fprintf(out, "{\"ts_ns\":%llu,\"path\":", (unsigned long long)time_ns);
+  log_json_string(out, event->path, strlen(event->path));
+  fprintf(out, ",\"event\":\"%s\",\"mask\":%u,\"kind\":\"%s\"",
+          event->type, event->mask, kind);
+}
 
-  fprintf(log_fp, "=== End Text Diff ===\n\n");
-  fclose(log_fp);
+static void text_record_header(FILE *out, const char *title,
+                               const diff_event *event, uint64_t time_ns) {
+  char timestamp[64];
+  log_format_time(time_ns, timestamp, sizeof(timestamp));
+  fprintf(out, "\n=== %s ===\n", title);
+  fprintf(out, "Time: %s\n", timestamp);
+  fprintf(out, "File: %s\n", event->path);
 }
 
-int is_binary_file(const char *filename) {
-  unsigned char buffer[4096];
-  size_t bytes_read = 0;
-  int retry_count = 0;
-  const int max_retries = 3;
-
-  while (retry_count < max_retries) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-      fprintf(stderr, RED "Cannot open %s: %s\n" RESET, filename,
-              strerror(errno));
-      return -1;
-    }
+// Render the record privately, then hand it to the sink in one piece
+void log_changes(log_sink *log, const diff_event *event,
+                 const edit_script *script, file_lines *current,
+                 file_lines *cached) {
+  if (!log || !log->path)
+    return;
+
+  char *record = NULL;
+  size_t length = 0;
+  FILE *out = open_memstream(&record, &length);
+  if (!out) {
+    perror(RED "Failed to render log record" RESET);
+    return;
+  }
 
-    bytes_read = fread(buffer, 1, sizeof(buffer), file);
+  uint64_t now = log_now_ns();
+  if (log->format == LOG_FORMAT_JSONL) {
+    json_record_header(out, event, "text", now);
+    fprintf(out, ",\"changed_lines\":%d,\"hunks\":", script->changed_lines);
+    render_diff_json(out, script, current, cached);
+    fputs("}\n", out);
+  } else {
+    text_record_header(out, "Text File Diff", event, now);
+    fprintf(out, "Event: %s\n", event->type);
+    render_diff(out, script, current, cached, 0);
+    fprintf(out, "=== End Text Diff ===\n\n");
+  }
 
-    fclose(file);
+  fclose(out);
+  log_append(log, record, length);
+  free(record);
+}
 
-    if (bytes_read > 0) {
-      for (size_t i = 0; i < bytes_read; i++) {
-        if (buffer[i] == 0x00) {
-          return 1; // Found null byte, likely binary
-        }
-      }
-      return 0; // No null bytes found, treat as text
-    }
+// Borrow a cached version as the old side of a diff; nothing in it is
+// freed by the diff
+static void view_version(const version_entry *entry, file_lines *fl) {
+  fl->content.data = entry->data;
+  fl->content.size = entry->size;
+  fl->content.kind = entry->size ? INGEST_TEXT : INGEST_EMPTY;
+  fl->lines = entry->lines;
+  fl->hashes = entry->hashes;
+  fl->count = entry->count;
+}
 
-    usleep(1000 * (retry_count + 1));
-    retry_count++;
+// Keep a parsed text version in memory for the next diff of its file
+static void remember_version(version_cache *versions, snapshot_digest digest,
+                             file_lines *fl) {
+  if (fl->content.kind == INGEST_BINARY ||
+      (!fl->hashes && split_file_lines(fl) != 0)) {
+    return;
   }
+  versions_put(versions, digest, fl->content.data, fl->content.size,
+               fl->lines, fl->hashes, fl->count);
+}
 
-  fprintf(stderr, RED "Failed to read %s after %d attempts\n" RESET, filename,
-          max_retries);
-  return -1; // Failed to read file after retries
+// Store what was just diffed as the new baseline for path
+static void update_snapshot(snapshot_store *store, const char *path,
+                            const file_lines *current) {
+  if (snapshot_capture_buffer(store, path, current->content.data,
+                              current->content.size) != 0) {
+    fprintf(stderr, RED "Failed to update snapshot for %s\n" RESET, path);
+  }
 }
 
-void run_diff(const char *path, const char *cache_dir, const char *event_type,
-              int verbose, const char *log_file) {
-  char *path_copy = strdup(path);
+// Record current as path's baseline without reporting a change
+static void record_baseline(FILE *out, snapshot_store *store,
+                            version_cache *versions, const char *path,
+                            snapshot_digest digest, file_lines *current,
+                            int verbose) {
+  update_snapshot(store, path, current);
+  remember_version(versions, digest, current);
+  if (verbose) {
+    fprintf(out, DARK_GREY "+ Cached: %s\n" RESET, path);
+  }
+}
 
-  if (!path_copy) {
-    perror(RED "Failed to allocate memory for path_copy" RESET);
+// Diff path against its snapshot, writing the report to out. Safe to run
+// from several workers at once as long as each has its own path.
+void run_diff(FILE *out, const diff_event *event, snapshot_store *store,
+              version_cache *versions, int verbose, log_sink *log,
+              diff_summary *summary) {
+  const char *path = event->path;
+  diff_summary unused;
+  if (!summary) {
+    summary = &unused;
+  }
+  memset(summary, 0, sizeof(*summary));
+  // The one read of the file; the diff and the snapshot share the buffer
+  file_lines current = {0};
+  if (ingest_read(path, &current.content) != 0) {
     return;
   }
 
-  char *cached_file_path =
-      malloc(strlen(cache_dir) + strlen(basename(path_copy)) + 2);
-  if (!cached_file_path) {
-    perror(RED "Failed to allocate memory for cached_file_path" RESET);
-    free(path_copy);
+  // First sighting (e.g. a file found through fanotify): there is nothing
+  // to compare against yet, so record the baseline
+  snapshot_digest current_digest =
+      snapshot_digest_of(current.content.data, current.content.size);
+  snapshot_digest cached_digest;
+  if (!snapshot_pin(store, path, &cached_digest)) {
+    record_baseline(out, store, versions, path, current_digest, &current,
+                    verbose);
+    free_file_lines(&current);
     return;
   }
-  sprintf(cached_file_path, "%s/%s", cache_dir, basename(path_copy));
 
-  // Check if file is binary
-  int bin_check = is_binary_file(path);
-  if (bin_check > 0) {
+  // Same content as the snapshot: nothing to diff or store
+  if (snapshot_digest_equal(current_digest, cached_digest)) {
+    snapshot_unpin(store, cached_digest);
+    free_file_lines(&current);
+    return;
+  }
+  summary->size = current.content.size;
+  if (current.content.kind == INGEST_BINARY) {
     if (verbose) {
-      printf(DARK_GREY "Binary file detected: %s\n" RESET, path);
-      print_bin_diff(path, cached_file_path, log_file);
+      fprintf(out, DARK_GREY "Binary file detected: %s\n" RESET, path);
+      file_lines cached = {0};
+      if (snapshot_load(store, cached_digest, &cached.content) == 0) {
+        print_bin_diff(out, event, &current, &cached, log, summary);
+        free_file_lines(&cached);
+      }
     }
+    snapshot_unpin(store, cached_digest);
 
     // Still update the cache for binary files
-    if (copy_file(path, cached_file_path) != 0) {
-      fprintf(stderr, RED "Failed to update cache file: %s\n" RESET,
-              cached_file_path);
-    }
+    update_snapshot(store, path, &current);
+    free_file_lines(&current);
+    return;
+  }
 
-    free(path_copy);
-    free(cached_file_path);
+  // The old side is usually still in memory from the last diff of this
+  // file; the snapshot on disk is the cold fallback. A snapshot that
+  // cannot be loaded (gone, corrupt, or from a codec this build lacks)
+  // leaves the file without a baseline, like a first sighting.
+  file_lines cached = {0};
+  version_entry *hot = versions_get(versions, cached_digest);
+  if (hot) {
+    view_version(hot, &cached);
+  } else if (snapshot_load(store, cached_digest, &cached.content) != 0) {
+    snapshot_unpin(store, cached_digest);
+    record_baseline(out, store, versions, path, current_digest, &current,
+                    verbose);
+    free_file_lines(&current);
     return;
-  } else if (bin_check < 0) {
-    fprintf(stderr, RED "Failed to read %s.\n" RESET, path);
-    free(path_copy);
-    free(cached_file_path);
+  }
+  // In memory now; eviction may take the object from here on
+  snapshot_unpin(store, cached_digest);
+
+  edit_script script;
+  if (split_file_lines(&current) != 0 ||
+      (!hot && split_file_lines(&cached) != 0) ||
+      compute_line_diff(&current, &cached, &script) != 0) {
+    fprintf(stderr, RED "Failed to diff %s\n" RESET, path);
+    free_file_lines(&current);
+    if (hot) {
+      versions_release(versions, hot);
+    } else {
+      free_file_lines(&cached);
+    }
     return;
   }
 
-  file_lines current = read_file_lines(path);
-  file_lines cached = read_file_lines(cached_file_path);
+  summary->compared = 1;
+  summary->changed = script.changed_lines;
 
   // First check if either file is empty
   if (!current.lines || !cached.lines) {
     if (!current.lines && cached.lines) {
       // File was emptied
-      printf(RED "- File emptied\n" RESET);
-      if (log_file) {
-        log_changes(log_file, path, "Emptied", &current, &cached);
-      }
+      fprintf(out, RED "- File emptied\n" RESET);
+      diff_event emptied = {path, "Emptied", event->mask};
+      log_changes(log, &emptied, &script, &current, &cached);
     } else if (current.lines && !cached.lines) {
       // New content added to empty file
-      printf(GREEN "+ New content added\n" RESET);
-      if (log_file) {
-        log_changes(log_file, path, "New content", &current, &cached);
-      }
+      fprintf(out, GREEN "+ New content added\n" RESET);
+      diff_event filled = {path, "New content", event->mask};
+      log_changes(log, &filled, &script, &current, &cached);
     }
-    
-    // Update cache regardless of which case
-    if (copy_file(path, cached_file_path) != 0) {
-      fprintf(stderr, RED "Failed to update cache file: %s\n" RESET,
-              cached_file_path);
-    }
-    return;
+  } else if (script.changed_lines > 0) {
+    // Both files have content, proceed with normal diff
+    print_diff(out, &script, &current, &cached, verbose);
+    log_changes(log, event, &script, &current, &cached);
   }
 
-  // Both files have content, proceed with normal diff
-  if (current.lines && cached.lines) {
-    // Print the changes
-    print_diff(&current, &cached, verbose);
-
-    // Count changes for logging
-    int changes = abs(current.count - cached.count);
-    for (int i = 0; i < current.count && i < cached.count; i++) {
-      if (strcmp(current.lines[i], cached.lines[i]) != 0) {
-        changes++;
-      }
-    }
-
-    if (changes > 0) {
-      if (log_file) {
-        log_changes(log_file, path, event_type, &current, &cached);
-      }
-
-      // Update the cache file with the current content
-      if (copy_file(path, cached_file_path) != 0) {
-        fprintf(stderr, RED "Failed to update cache file: %s\n" RESET,
-                cached_file_path);
-      }
-    }
-  }
+  // The digest differs, so the snapshot always moves forward
+  update_snapshot(store, path, &current);
+  remember_version(versions, current_digest, &current);
 
   // Cleanup
+  edit_script_free(&script);
   free_file_lines(&current);
-  free_file_lines(&cached);
-  free(cached_file_path);
-  free(path_copy);
+  if (hot) {
+    versions_release(versions, hot);
+  } else {
+    free_file_lines(&cached);
+  }
 }
 
-void print_bin_diff(const char *path, const char *cached_path,
-                    const char *log_file) {
-  FILE *f1 = fopen(path, "rb");
-  FILE *f2 = fopen(cached_path, "rb");
-
-  if (!f1 || !f2) {
-    if (f1)
-      fclose(f1);
-    if (f2)
-      fclose(f2);
-    return;
+// Show up to 8 bytes of a region as hex
+static void print_hex(FILE *out, const char *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    fprintf(out, "%02x", (unsigned char)data[i]);
   }
+}
 
-  unsigned char buf1[MAX_BIN_DIFFS], buf2[MAX_BIN_DIFFS];
-  struct diff_entry diffs[MAX_BIN_DIFFS]; // Store up to 10 differences
-
-  size_t offset = 0;
-  int differences = 0;
-  int continue_reading = 1;
-
-  while (continue_reading) {
-    size_t n1 = fread(buf1, 1, sizeof(buf1), f1);
-    size_t n2 = fread(buf2, 1, sizeof(buf2), f2);
-
-    if (n1 == 0 && n2 == 0)
+static void render_bin_delta(FILE *out, const bin_delta *delta,
+                             const file_lines *current,
+                             const file_lines *cached, int color) {
+  size_t changed = delta->bytes_inserted + delta->bytes_deleted;
+  size_t total = delta->new_size > delta->old_size ? delta->new_size
+                                                   : delta->old_size;
+  fprintf(out, "Binary delta: %zu bytes changed in %zu regions (%.2f%% of %zu bytes)",
+          changed, delta->count, total ? 100.0 * changed / total : 0.0, total);
+  if (delta->bytes_moved > 0) {
+    fprintf(out, ", %zu bytes moved", delta->bytes_moved);
+  }
+  fprintf(out, "\n");
+
+  size_t shown = delta->count < MAX_BIN_DIFFS ? delta->count : MAX_BIN_DIFFS;
+  for (size_t i = 0; i < shown; i++) {
+    const delta_region *r = &delta->regions[i];
+    switch (r->kind) {
+    case REGION_INSERTED:
+      fprintf(out, "%s%08zx: +%zu bytes inserted%s\n", color ? GREEN : "",
+              r->new_offset, r->new_length, color ? RESET : "");
       break;
-
-    if (n1 != n2) {
-      printf(RED "Files have different sizes at offset %08zx (local: %zu != "
-                 "cache: %zu)\n" RESET,
-             offset, n1, n2);
+    case REGION_DELETED:
+      fprintf(out, "%s%08zx: -%zu bytes deleted (cache %08zx)%s\n",
+              color ? RED : "", r->new_offset, r->old_length, r->old_offset,
+              color ? RESET : "");
       break;
-    }
-
-    size_t compare_len = (n1 < n2) ? n1 : n2;
-    for (size_t i = 0; i < compare_len && continue_reading; i++) {
-      if (buf1[i] != buf2[i]) {
-        printf("%08zx: " RED "%02x" RESET " -> " GREEN "%02x" RESET "\n",
-               offset + i, buf2[i], buf1[i]);
-
-        if (differences < MAX_BIN_DIFFS) {
-          diffs[differences].offset = offset + i;
-          diffs[differences].local = buf1[i];
-          diffs[differences].cache = buf2[i];
-        }
-
-        differences++;
-
-        if (differences >= MAX_BIN_DIFFS) {
-          printf(DARK_GREY "... more differences follow ...\n" RESET);
-          continue_reading = 0;
-          break;
-        }
+    case REGION_REPLACED:
+      fprintf(out, "%08zx: %zu -> %zu bytes replaced", r->new_offset,
+              r->old_length, r->new_length);
+      if (r->old_length <= 8 && r->new_length <= 8) {
+        fprintf(out, ": %s", color ? RED : "");
+        print_hex(out, cached->content.data + r->old_offset, r->old_length);
+        fprintf(out, "%s -> %s", color ? RESET : "", color ? GREEN : "");
+        print_hex(out, current->content.data + r->new_offset, r->new_length);
+        fprintf(out, "%s", color ? RESET : "");
       }
+      fprintf(out, "\n");
+      break;
+    case REGION_MOVED:
+      fprintf(out, "%s%08zx: %zu bytes moved from cache %08zx%s\n",
+              color ? DARK_GREY : "", r->new_offset, r->new_length,
+              r->old_offset, color ? RESET : "");
+      break;
     }
-
-    offset += n1;
   }
-
-  if (log_file && differences > 0) {
-    log_bin_diff(log_file, path, diffs, differences);
+  if (delta->count > shown) {
+    fprintf(out, "%s... %zu more regions ...%s\n", color ? DARK_GREY : "",
+            delta->count - shown, color ? RESET : "");
   }
-
-  fclose(f1);
-  fclose(f2);
 }
 
-void log_bin_diff(const char *log_file, const char *path,
-                  const struct diff_entry *diffs, size_t diff_count) {
-  if (!log_file)
+void print_bin_diff(FILE *out, const diff_event *event,
+                    const file_lines *current, const file_lines *cached,
+                    log_sink *log, diff_summary *summary) {
+  bin_delta delta;
+  if (bindelta_compute((const unsigned char *)cached->content.data,
+                       cached->content.size,
+                       (const unsigned char *)current->content.data,
+                       current->content.size, &delta) != 0) {
+    fprintf(stderr, RED "Failed to compute binary delta for %s\n" RESET,
+            event->path);
     return;
+  }
 
-  FILE *log_fp = fopen(log_file, "a");
-  if (!log_fp) {
-    fprintf(stderr, RED "Failed to open log file for binary diff: %s\n" RESET,
-            strerror(errno));
-    return;
+  render_bin_delta(out, &delta, current, cached, 1);
+  if (summary) {
+    summary->compared = 1;
+    summary->binary = 1;
+    summary->changed = delta.bytes_inserted + delta.bytes_deleted;
   }
+  if (delta.count > 0) {
+    log_bin_diff(log, event, &delta, current, cached);
+  }
+  bindelta_free(&delta);
+}
 
-  time_t now = time(NULL);
-  char *timestamp = ctime(&now);
-  timestamp[strlen(timestamp) - 1] = '\0';
+static const char *region_kind_name(delta_region_kind kind) {
+  switch (kind) {
+  case REGION_INSERTED:
+    return "inserted";
+  case REGION_DELETED:
+    return "deleted";
+  case REGION_REPLACED:
+    return "replaced";
+  default:
+    return "moved";
+  }
+}
 
-  fprintf(log_fp, "\n=== Binary File Diff ===\n");
-  fprintf(log_fp, "Time: %s\n", timestamp);
-  fprintf(log_fp, "File: %s\n", path);
-  fprintf(log_fp, "Offset: 0x%08zx\n",
-          diffs[0].offset & ~0xF); // Base offset of first change
+// Every region goes to JSON; only the text form is elided
+static void render_bin_delta_json(FILE *out, const bin_delta *delta) {
+  fprintf(out,
+          ",\"old_size\":%zu,\"new_size\":%zu,\"bytes_inserted\":%zu,"
+          "\"bytes_deleted\":%zu,\"bytes_moved\":%zu,\"regions\":[",
+          delta->old_size, delta->new_size, delta->bytes_inserted,
+          delta->bytes_deleted, delta->bytes_moved);
+  for (size_t i = 0; i < delta->count; i++) {
+    const delta_region *r = &delta->regions[i];
+    fprintf(out,
+            "%s{\"op\":\"%s\",\"new_offset\":%zu,\"new_length\":%zu,"
+            "\"old_offset\":%zu,\"old_length\":%zu}",
+            i ? "," : "", region_kind_name(r->kind), r->new_offset,
+            r->new_length, r->old_offset, r->old_length);
+  }
+  fputc(']', out);
+}
 
-  size_t log_count = diff_count > MAX_BIN_DIFFS ? MAX_BIN_DIFFS : diff_count;
-  for (size_t i = 0; i < log_count; i++) {
-    fprintf(log_fp, "0x%08zx: %02x -> %02x\n", diffs[i].offset, diffs[i].cache,
-            diffs[i].local);
+void log_bin_diff(log_sink *log, const diff_event *event,
+                  const bin_delta *delta, const file_lines *current,
+                  const file_lines *cached) {
+  if (!log || !log->path)
+    return;
+
+  char *record = NULL;
+  size_t length = 0;
+  FILE *out = open_memstream(&record, &length);
+  if (!out) {
+    perror(RED "Failed to render log record" RESET);
+    return;
   }
 
-  if (diff_count >= MAX_BIN_DIFFS) {
-    fprintf(log_fp, "More differences follow ...\n");
+  uint64_t now = log_now_ns();
+  if (log->format == LOG_FORMAT_JSONL) {
+    json_record_header(out, event, "binary", now);
+    render_bin_delta_json(out, delta);
+    fputs("}\n", out);
+  } else {
+    text_record_header(out, "Binary File Diff", event, now);
+    render_bin_delta(out, delta, current, cached, 0);
+    fprintf(out, "=== End Binary Diff ===\n\n");
   }
 
-  fprintf(log_fp, "=== End Binary Diff ===\n\n");
-  fclose(log_fp);
+  fclose(out);
+  log_append(log, record, length);
+  free(record);
 }
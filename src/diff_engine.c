@@ -0,0 +1,261 @@
+#include "diff_engine.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Linear-space Myers O(ND) diff: find the middle snake of the shortest
+// edit path, then recurse on the halves on either side of it. Lines are
+// compared as interned equivalence-class ids, so matching is an integer
+// compare over two contiguous arrays.
+//
+// Like xdiff, the search gives up being minimal past a cost bound: once
+// the edit distance explored exceeds about sqrt(N+M) it splits at the
+// furthest-reaching path found so far, so a rewritten file costs
+// O((N+M)^1.5) instead of O((N+M)^2).
+
+// Cost bound floor, so ordinary edits are still diffed minimally
+#define MIN_MAX_COST 256
+
+typedef struct {
+  const uint32_t *a; // old ids
+  const uint32_t *b; // new ids
+  edit_script *script;
+  int *v1; // forward furthest-reaching x per diagonal
+  int *v2; // reverse furthest-reaching x per diagonal
+  int max_cost; // edit distance a bisect explores before settling
+} diff_state;
+
+static int emit(edit_script *script, edit_op op, int old_start, int new_start,
+                int count) {
+  if (count <= 0) {
+    return 0;
+  }
+  if (op != EDIT_EQUAL) {
+    script->changed_lines += count;
+  }
+
+  // Extend the previous run when it continues seamlessly
+  if (script->count > 0) {
+    edit_run *last = &script->runs[script->count - 1];
+    if (last->op == op &&
+        (op == EDIT_INSERT || last->old_start + last->count == old_start) &&
+        (op == EDIT_DELETE || last->new_start + last->count == new_start)) {
+      last->count += count;
+      return 0;
+    }
+  }
+
+  if (script->count == script->capacity) {
+    size_t capacity = script->capacity ? script->capacity * 2 : 32;
+    edit_run *runs = realloc(script->runs, capacity * sizeof(edit_run));
+    if (!runs) {
+      return -1;
+    }
+    script->runs = runs;
+    script->capacity = capacity;
+  }
+  script->runs[script->count++] =
+      (edit_run){op, old_start, new_start, count};
+  return 0;
+}
+
+// Past the cost bound: split at whichever of the forward and reverse
+// searches got furthest. Any point reached is a correct split; it is just
+// not guaranteed to lie on a shortest path. Returns -1 when no point
+// would shrink the problem.
+static int furthest_split(const diff_state *st, int n, int m, int d,
+                          int v_offset, int *split_x, int *split_y) {
+  int best = 0;
+  for (int k = -d; k <= d; k++) {
+    int x1 = st->v1[v_offset + k];
+    int y1 = x1 - k;
+    if (x1 >= 0 && x1 <= n && y1 >= 0 && y1 <= m && x1 + y1 < n + m &&
+        x1 + y1 > best) {
+      best = x1 + y1;
+      *split_x = x1;
+      *split_y = y1;
+    }
+    int x2 = st->v2[v_offset + k];
+    int y2 = x2 - k;
+    if (x2 >= 0 && x2 <= n && y2 >= 0 && y2 <= m && x2 + y2 < n + m &&
+        x2 + y2 > best) {
+      best = x2 + y2;
+      *split_x = n - x2;
+      *split_y = m - y2;
+    }
+  }
+  return best > 0 ? 0 : -1;
+}
+
+// Returns 0 and the split point if a middle snake was found
+static int bisect(diff_state *st, int a0, int n, int b0, int m, int *split_x,
+                  int *split_y) {
+  int max_d = (n + m + 1) / 2;
+  int v_offset = max_d;
+  int v_length = 2 * max_d + 2;
+  int *v1 = st->v1;
+  int *v2 = st->v2;
+  for (int i = 0; i < v_length; i++) {
+    v1[i] = -1;
+    v2[i] = -1;
+  }
+  v1[v_offset + 1] = 0;
+  v2[v_offset + 1] = 0;
+
+  int delta = n - m;
+  // With an odd delta the forward path collides with the reverse one
+  int front = (delta & 1) != 0;
+  int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+  for (int d = 0; d < max_d; d++) {
+    for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+      int k1_offset = v_offset + k1;
+      int x1;
+      if (k1 == -d || (k1 != d && v1[k1_offset - 1] < v1[k1_offset + 1])) {
+        x1 = v1[k1_offset + 1];
+      } else {
+        x1 = v1[k1_offset - 1] + 1;
+      }
+      int y1 = x1 - k1;
+      while (x1 < n && y1 < m && st->a[a0 + x1] == st->b[b0 + y1]) {
+        x1++;
+        y1++;
+      }
+      v1[k1_offset] = x1;
+      if (x1 > n) {
+        k1end += 2;
+      } else if (y1 > m) {
+        k1start += 2;
+      } else if (front) {
+        int k2_offset = v_offset + delta - k1;
+        if (k2_offset >= 0 && k2_offset < v_length && v2[k2_offset] != -1) {
+          int x2 = n - v2[k2_offset];
+          if (x1 >= x2) {
+            *split_x = x1;
+            *split_y = y1;
+            return 0;
+          }
+        }
+      }
+    }
+
+    for (int k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+      int k2_offset = v_offset + k2;
+      int x2;
+      if (k2 == -d || (k2 != d && v2[k2_offset - 1] < v2[k2_offset + 1])) {
+        x2 = v2[k2_offset + 1];
+      } else {
+        x2 = v2[k2_offset - 1] + 1;
+      }
+      int y2 = x2 - k2;
+      while (x2 < n && y2 < m &&
+             st->a[a0 + n - x2 - 1] == st->b[b0 + m - y2 - 1]) {
+        x2++;
+        y2++;
+      }
+      v2[k2_offset] = x2;
+      if (x2 > n) {
+        k2end += 2;
+      } else if (y2 > m) {
+        k2start += 2;
+      } else if (!front) {
+        int k1_offset = v_offset + delta - k2;
+        if (k1_offset >= 0 && k1_offset < v_length && v1[k1_offset] != -1) {
+          int x1 = v1[k1_offset];
+          int y1 = v_offset + x1 - k1_offset;
+          if (x1 >= n - x2) {
+            *split_x = x1;
+            *split_y = y1;
+            return 0;
+          }
+        }
+      }
+    }
+
+    if (d >= st->max_cost) {
+      return furthest_split(st, n, m, d, v_offset, split_x, split_y);
+    }
+  }
+  return -1;
+}
+
+static int diff_range(diff_state *st, int a0, int a1, int b0, int b1) {
+  // Common prefix and suffix never take part in the search
+  int prefix = 0;
+  while (a0 + prefix < a1 && b0 + prefix < b1 &&
+         st->a[a0 + prefix] == st->b[b0 + prefix]) {
+    prefix++;
+  }
+  if (emit(st->script, EDIT_EQUAL, a0, b0, prefix) != 0) {
+    return -1;
+  }
+  a0 += prefix;
+  b0 += prefix;
+
+  int suffix = 0;
+  while (a1 - suffix > a0 && b1 - suffix > b0 &&
+         st->a[a1 - suffix - 1] == st->b[b1 - suffix - 1]) {
+    suffix++;
+  }
+  a1 -= suffix;
+  b1 -= suffix;
+
+  int n = a1 - a0;
+  int m = b1 - b0;
+  int rc = 0;
+  int split_x, split_y;
+  if (n == 0) {
+    rc = emit(st->script, EDIT_INSERT, a0, b0, m);
+  } else if (m == 0) {
+    rc = emit(st->script, EDIT_DELETE, a0, b0, n);
+  } else if (bisect(st, a0, n, b0, m, &split_x, &split_y) == 0) {
+    rc = diff_range(st, a0, a0 + split_x, b0, b0 + split_y);
+    if (rc == 0) {
+      rc = diff_range(st, a0 + split_x, a1, b0 + split_y, b1);
+    }
+  } else {
+    // Nothing in common at all
+    rc = emit(st->script, EDIT_DELETE, a0, b0, n);
+    if (rc == 0) {
+      rc = emit(st->script, EDIT_INSERT, a1, b0, m);
+    }
+  }
+
+  if (rc == 0) {
+    rc = emit(st->script, EDIT_EQUAL, a1, b1, suffix);
+  }
+  return rc;
+}
+
+// Compute an edit script turning the old sequence into the new one; it is
+// minimal unless the inputs differ by more than the cost bound allows
+int diff_compute(const uint32_t *old_ids, int old_count,
+                 const uint32_t *new_ids, int new_count, edit_script *script) {
+  memset(script, 0, sizeof(*script));
+
+  // Workspace for the largest bisect; sub-problems reuse it
+  size_t v_length = (size_t)(old_count + new_count + 1) / 2 * 2 + 2;
+  int max_cost = MIN_MAX_COST;
+  while ((long)max_cost * max_cost < (long)old_count + new_count) {
+    max_cost *= 2;
+  }
+  diff_state st = {old_ids, new_ids, script, malloc(v_length * sizeof(int)),
+                   malloc(v_length * sizeof(int)), max_cost};
+  if (!st.v1 || !st.v2) {
+    free(st.v1);
+    free(st.v2);
+    return -1;
+  }
+
+  int rc = diff_range(&st, 0, old_count, 0, new_count);
+  free(st.v1);
+  free(st.v2);
+  if (rc != 0) {
+    edit_script_free(script);
+  }
+  return rc;
+}
+
+void edit_script_free(edit_script *script) {
+  free(script->runs);
+  memset(script, 0, sizeof(*script));
+}
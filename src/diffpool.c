@@ -0,0 +1,203 @@
+#include "diffpool.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_DIFF_WORKERS 8
+
+int diffpool_default_workers(void) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) {
+    return 1;
+  }
+  return cpus > MAX_DIFF_WORKERS ? MAX_DIFF_WORKERS : (int)cpus;
+}
+
+static diff_request **find_slot(diff_pool *pool, const char *path,
+                                uint64_t hash) {
+  size_t i = hash & pool->table_mask;
+  while (pool->table[i] != NULL) {
+    if (pool->table[i]->hash == hash && strcmp(pool->table[i]->path, path) == 0) {
+      break;
+    }
+    i = (i + 1) & pool->table_mask;
+  }
+  return &pool->table[i];
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+static void table_remove(diff_pool *pool, diff_request *request) {
+  size_t i = request->hash & pool->table_mask;
+  while (pool->table[i] != request) {
+    i = (i + 1) & pool->table_mask;
+  }
+  size_t j = i;
+  for (;;) {
+    pool->table[i] = NULL;
+    for (;;) {
+      j = (j + 1) & pool->table_mask;
+      if (pool->table[j] == NULL) {
+        return;
+      }
+      size_t home = pool->table[j]->hash & pool->table_mask;
+      // Move j back into the hole unless its home lies cyclically in (i, j]
+      if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+        break;
+      }
+    }
+    pool->table[i] = pool->table[j];
+    i = j;
+  }
+}
+
+static void *worker_main(void *arg) {
+  diff_pool *pool = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (pool->count == 0 && !pool->stopping) {
+      pthread_cond_wait(&pool->not_empty, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    diff_request *request = pool->queue[pool->head];
+    pool->head = (pool->head + 1) % pool->capacity;
+    pool->count--;
+    request->queued = 0;
+    request->running = 1;
+    pthread_cond_signal(&pool->not_full);
+
+    // Same-path work never overlaps: later changes rerun here, in order
+    do {
+      uint32_t mask = request->mask;
+      request->mask = 0;
+      request->rerun = 0;
+      pthread_mutex_unlock(&pool->lock);
+      pool->run(request->path, mask, pool->ctx);
+      pthread_mutex_lock(&pool->lock);
+    } while (request->rerun && !pool->stopping);
+
+    table_remove(pool, request);
+    free(request->path);
+    free(request);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+int diffpool_start(diff_pool *pool, int workers, size_t capacity,
+                   diff_job_fn run, void *ctx) {
+  memset(pool, 0, sizeof(*pool));
+  pool->run = run;
+  pool->ctx = ctx;
+  pool->capacity = capacity;
+
+  // Live requests never exceed queued + running, so the table never grows
+  size_t table_size = 16;
+  while (table_size < (capacity + workers) * 2) {
+    table_size <<= 1;
+  }
+  pool->table_mask = table_size - 1;
+  pool->table = calloc(table_size, sizeof(diff_request *));
+  pool->queue = calloc(capacity, sizeof(diff_request *));
+  pool->threads = calloc(workers, sizeof(pthread_t));
+  if (!pool->table || !pool->queue || !pool->threads) {
+    free(pool->table);
+    free(pool->queue);
+    free(pool->threads);
+    return -1;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->not_empty, NULL);
+  pthread_cond_init(&pool->not_full, NULL);
+
+  for (int i = 0; i < workers; i++) {
+    if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+      perror("Failed to start diff worker");
+      break;
+    }
+    pool->thread_count++;
+  }
+  if (pool->thread_count == 0) {
+    diffpool_stop(pool);
+    return -1;
+  }
+  return 0;
+}
+
+// Queue a diff for path. Blocks while the queue is full, which pushes back
+// on the event loop rather than growing without bound.
+void diffpool_submit(diff_pool *pool, const char *path, uint32_t mask) {
+  uint64_t hash = hash_string(path);
+
+  pthread_mutex_lock(&pool->lock);
+  pool->submitted++;
+  diff_request **slot = find_slot(pool, path, hash);
+  if (*slot) {
+    // Latest wins: the pending run reads the file when it starts
+    if ((*slot)->running) {
+      (*slot)->rerun = 1;
+    }
+    (*slot)->mask |= mask;
+    pool->merged++;
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+
+  if (pool->count == pool->capacity) {
+    pool->stalls++;
+    while (pool->count == pool->capacity && !pool->stopping) {
+      pthread_cond_wait(&pool->not_full, &pool->lock);
+    }
+  }
+  diff_request *request = calloc(1, sizeof(diff_request));
+  char *path_copy = strdup(path);
+  if (pool->stopping || !request || !path_copy) {
+    free(request);
+    free(path_copy);
+    pthread_mutex_unlock(&pool->lock);
+    return;
+  }
+  request->path = path_copy;
+  request->hash = hash;
+  request->mask = mask;
+  request->queued = 1;
+  // Workers may have removed entries while we waited; probe again
+  *find_slot(pool, path, hash) = request;
+  pool->queue[(pool->head + pool->count) % pool->capacity] = request;
+  pool->count++;
+  pthread_cond_signal(&pool->not_empty);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+// Let running jobs finish, drop whatever is still queued, join workers
+void diffpool_stop(diff_pool *pool) {
+  if (!pool->table) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->not_empty);
+  pthread_cond_broadcast(&pool->not_full);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int i = 0; i < pool->thread_count; i++) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (size_t i = 0; i < pool->count; i++) {
+    diff_request *request = pool->queue[(pool->head + i) % pool->capacity];
+    free(request->path);
+    free(request);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->not_empty);
+  pthread_cond_destroy(&pool->not_full);
+  free(pool->threads);
+  free(pool->queue);
+  free(pool->table);
+  memset(pool, 0, sizeof(*pool));
+}
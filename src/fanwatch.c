@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include "fanwatch.h"
+#include "sqwatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+
+// Events that only filesystem (not mount) marks can report
+#define FAN_DIRENT_EVENTS                                                      \
+  (FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ATTRIB |      \
+   FAN_DELETE_SELF | FAN_MOVE_SELF)
+
+int fanwatch_init(fanwatch *fw) {
+  fw->roots = NULL;
+  fw->root_count = 0;
+  fw->fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC,
+                         O_RDONLY | O_LARGEFILE);
+  if (fw->fd == -1) {
+    fprintf(stderr, RED "+ fanotify_init failed: %s\n" RESET, strerror(errno));
+    if (errno == EPERM) {
+      fprintf(stderr, RED "+ fanotify requires CAP_SYS_ADMIN\n" RESET);
+    } else if (errno == EINVAL) {
+      fprintf(stderr, RED "+ FAN_REPORT_DFID_NAME requires Linux 5.9+\n" RESET);
+    }
+    return -1;
+  }
+  return 0;
+}
+
+int fanwatch_add(fanwatch *fw, const char *path, uint32_t flags, int verbose) {
+  char resolved[PATH_MAX];
+  if (!realpath(path, resolved)) {
+    fprintf(stderr, RED "+ Failed to resolve %s: %s\n" RESET, path,
+            strerror(errno));
+    return -1;
+  }
+
+  struct statfs sfs;
+  if (statfs(resolved, &sfs) != 0) {
+    fprintf(stderr, RED "+ Failed to statfs %s: %s\n" RESET, resolved,
+            strerror(errno));
+    return -1;
+  }
+
+  // fanotify shares the inotify bit layout for these events
+  uint64_t mask = flags & (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                           IN_MOVE | IN_ATTRIB);
+  unsigned int mark_type =
+      (mask & FAN_DIRENT_EVENTS) ? FAN_MARK_FILESYSTEM : FAN_MARK_MOUNT;
+  if (fanotify_mark(fw->fd, FAN_MARK_ADD | mark_type, mask | FAN_ONDIR,
+                    AT_FDCWD, resolved) != 0) {
+    fprintf(stderr, RED "+ fanotify_mark failed for %s: %s\n" RESET, resolved,
+            strerror(errno));
+    return -1;
+  }
+
+  fan_root *roots = realloc(fw->roots, (fw->root_count + 1) * sizeof(fan_root));
+  if (!roots) {
+    fprintf(stderr, RED "+ Failed to allocate memory for fanotify roots\n" RESET);
+    return -1;
+  }
+  fw->roots = roots;
+
+  fan_root *root = &fw->roots[fw->root_count];
+  root->mount_fd = open(resolved, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (root->mount_fd == -1) {
+    fprintf(stderr, RED "+ Failed to open %s: %s\n" RESET, resolved,
+            strerror(errno));
+    return -1;
+  }
+  root->path = strdup(resolved);
+  root->len = strlen(resolved);
+  memcpy(root->fsid, &sfs.f_fsid, sizeof(root->fsid));
+  fw->root_count++;
+
+  if (verbose) {
+    printf(CYAN "+ fanotify %s mark set covering %s\n" RESET,
+           mark_type == FAN_MARK_FILESYSTEM ? "filesystem" : "mount", resolved);
+  }
+  return 0;
+}
+
+static fan_root *find_root(fanwatch *fw, const int32_t *fsid) {
+  for (int i = 0; i < fw->root_count; i++) {
+    if (memcmp(fw->roots[i].fsid, fsid, sizeof(fw->roots[i].fsid)) == 0) {
+      return &fw->roots[i];
+    }
+  }
+  return NULL;
+}
+
+static int under_root(fanwatch *fw, const char *path) {
+  for (int i = 0; i < fw->root_count; i++) {
+    fan_root *root = &fw->roots[i];
+    if (strncmp(path, root->path, root->len) == 0 &&
+        (path[root->len] == '\0' || path[root->len] == '/' ||
+         root->len == 1)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Resolve the directory handle + name of an event to a path under one of
+// the watched roots. Returns 0 on success, -1 if the event should be dropped.
+int fanwatch_resolve(fanwatch *fw, const struct fanotify_event_metadata *meta,
+                     char *out, size_t out_len) {
+  const char *ptr = (const char *)meta + meta->metadata_len;
+  const char *end = (const char *)meta + meta->event_len;
+
+  while (ptr < end) {
+    const struct fanotify_event_info_header *hdr =
+        (const struct fanotify_event_info_header *)ptr;
+    if (hdr->len == 0) {
+      break;
+    }
+
+    if (hdr->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME ||
+        hdr->info_type == FAN_EVENT_INFO_TYPE_DFID) {
+      const struct fanotify_event_info_fid *fid =
+          (const struct fanotify_event_info_fid *)hdr;
+      struct file_handle *handle = (struct file_handle *)fid->handle;
+      const char *name = NULL;
+      if (hdr->info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+        name = (const char *)handle->f_handle + handle->handle_bytes;
+      }
+
+      fan_root *root = find_root(fw, (const int32_t *)&fid->fsid);
+      if (!root) {
+        return -1;
+      }
+
+      // Directory may already be gone (ESTALE); nothing to report then
+      int dir_fd = open_by_handle_at(root->mount_fd, handle, O_PATH | O_CLOEXEC);
+      if (dir_fd == -1) {
+        return -1;
+      }
+
+      char proc_path[64];
+      char dir_path[PATH_MAX];
+      snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", dir_fd);
+      ssize_t n = readlink(proc_path, dir_path, sizeof(dir_path) - 1);
+      close(dir_fd);
+      if (n < 0) {
+        return -1;
+      }
+      dir_path[n] = '\0';
+
+      if (name && strcmp(name, ".") != 0 && name[0] != '\0') {
+        snprintf(out, out_len, "%s/%s", strcmp(dir_path, "/") == 0 ? "" : dir_path,
+                 name);
+      } else {
+        snprintf(out, out_len, "%s", dir_path);
+      }
+      return under_root(fw, out) ? 0 : -1;
+    }
+    ptr += hdr->len;
+  }
+  return -1;
+}
+
+uint32_t fanwatch_event_mask(uint64_t fan_mask) {
+  uint32_t mask = 0;
+  if (fan_mask & FAN_MODIFY)
+    mask |= IN_MODIFY;
+  if (fan_mask & FAN_CLOSE_WRITE)
+    mask |= IN_CLOSE_WRITE;
+  if (fan_mask & FAN_CREATE)
+    mask |= IN_CREATE;
+  if (fan_mask & FAN_DELETE)
+    mask |= IN_DELETE;
+  if (fan_mask & FAN_MOVED_FROM)
+    mask |= IN_MOVED_FROM;
+  if (fan_mask & FAN_MOVED_TO)
+    mask |= IN_MOVED_TO;
+  if (fan_mask & FAN_ATTRIB)
+    mask |= IN_ATTRIB;
+  if (fan_mask & FAN_Q_OVERFLOW)
+    mask |= IN_Q_OVERFLOW;
+  if (fan_mask & FAN_ONDIR)
+    mask |= IN_ISDIR;
+  return mask;
+}
+
+void fanwatch_close(fanwatch *fw) {
+  for (int i = 0; i < fw->root_count; i++) {
+    close(fw->roots[i].mount_fd);
+    free(fw->roots[i].path);
+  }
+  free(fw->roots);
+  fw->roots = NULL;
+  fw->root_count = 0;
+  if (fw->fd >= 0) {
+    close(fw->fd);
+    fw->fd = -1;
+  }
+}
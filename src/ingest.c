@@ -0,0 +1,265 @@
+#include "ingest.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+#define READ_CHUNK (256 * 1024)
+
+// More than 1 in 16 suspicious bytes makes a file binary; one stray byte
+// (a Latin-1 accent in a short file) never does
+#define SUSPICIOUS_SHIFT 4
+
+// Running classification, carried across read() chunks
+typedef struct {
+  int nul;
+  int pending;       // UTF-8 continuation bytes still expected
+  size_t suspicious; // stray control bytes and malformed UTF-8
+} text_scan;
+
+// Bell, backspace, tab, newline, vertical tab, form feed, carriage return
+// and escape all show up in real text
+static int allowed_control(unsigned char c) {
+  return (c >= 0x07 && c <= 0x0d) || c == 0x1b;
+}
+
+static void scan_scalar(text_scan *ts, const unsigned char *p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = p[i];
+    if (ts->pending > 0) {
+      if ((c & 0xc0) == 0x80) {
+        ts->pending--;
+        continue;
+      }
+      ts->pending = 0; // Truncated sequence; c starts afresh
+      ts->suspicious++;
+    }
+    if (c < 0x80) {
+      if (c == 0) {
+        ts->nul = 1;
+      } else if (c < 0x20 && !allowed_control(c)) {
+        ts->suspicious++;
+      }
+    } else if (c >= 0xc2 && c <= 0xdf) {
+      ts->pending = 1;
+    } else if (c >= 0xe0 && c <= 0xef) {
+      ts->pending = 2;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      ts->pending = 3;
+    } else {
+      ts->suspicious++;
+    }
+  }
+}
+
+#if defined(__x86_64__)
+// Blocks of printable ASCII, tabs and line endings are skipped whole;
+// anything else goes through the scalar state machine. The compares are
+// signed, so bytes with the high bit set count as "below space" too.
+static void scan_sse2(text_scan *ts, const unsigned char *p, size_t n) {
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    if (ts->pending == 0) {
+      __m128i chunk = _mm_loadu_si128((const __m128i *)(p + i));
+      __m128i ok = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(chunk, tab), _mm_cmpeq_epi8(chunk, nl)),
+          _mm_cmpeq_epi8(chunk, cr));
+      __m128i odd = _mm_andnot_si128(ok, _mm_cmplt_epi8(chunk, space));
+      if (_mm_movemask_epi8(odd) == 0) {
+        continue;
+      }
+    }
+    scan_scalar(ts, p + i, 16);
+  }
+  scan_scalar(ts, p + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+scan_avx2(text_scan *ts, const unsigned char *p, size_t n) {
+  const __m256i space = _mm256_set1_epi8(0x20);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    if (ts->pending == 0) {
+      __m256i chunk = _mm256_loadu_si256((const __m256i *)(p + i));
+      __m256i ok = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, tab),
+                                                   _mm256_cmpeq_epi8(chunk, nl)),
+                                   _mm256_cmpeq_epi8(chunk, cr));
+      __m256i odd = _mm256_andnot_si256(ok, _mm256_cmpgt_epi8(space, chunk));
+      if (_mm256_movemask_epi8(odd) == 0) {
+        continue;
+      }
+    }
+    scan_scalar(ts, p + i, 32);
+  }
+  scan_scalar(ts, p + i, n - i);
+}
+#endif
+
+typedef void (*scan_fn)(text_scan *ts, const unsigned char *p, size_t n);
+
+static scan_fn select_scanner(void) {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return scan_avx2;
+  }
+  return scan_sse2; // baseline on x86-64
+#else
+  return scan_scalar;
+#endif
+}
+
+const char *ingest_impl(void) {
+  scan_fn scan = select_scanner();
+#if defined(__x86_64__)
+  if (scan == scan_avx2) {
+    return "avx2";
+  }
+  if (scan == scan_sse2) {
+    return "sse2";
+  }
+#endif
+  (void)scan;
+  return "scalar";
+}
+
+static ingest_class classify(const text_scan *ts, size_t size) {
+  if (size == 0) {
+    return INGEST_EMPTY;
+  }
+  size_t suspicious = ts->suspicious + (ts->pending > 0);
+  if (ts->nul || suspicious > (size >> SUSPICIOUS_SHIFT) + 1) {
+    return INGEST_BINARY;
+  }
+  return INGEST_TEXT;
+}
+
+// Read a watched file once, classifying each chunk as it arrives. It is
+// read up to EOF rather than to the fstat size, since a writer may still
+// be extending it. Never mapped: a writer truncating the file under a
+// live mapping would raise SIGBUS.
+int ingest_read(const char *path, ingest_buffer *buf) {
+  memset(buf, 0, sizeof(*buf));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    // Editor temp files are often gone by the time the batch fires
+    if (errno != ENOENT) {
+      fprintf(stderr, RED "Failed to open %s: %s\n" RESET, path,
+              strerror(errno));
+    }
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    fprintf(stderr, RED "Failed to stat %s: %s\n" RESET, path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  // One spare chunk so a file that has not grown needs no realloc
+  size_t capacity = (size_t)st.st_size + READ_CHUNK;
+  char *data = malloc(capacity);
+  if (!data) {
+    fprintf(stderr, RED "Failed to allocate buffer for %s\n" RESET, path);
+    close(fd);
+    return -1;
+  }
+
+  scan_fn scan = select_scanner();
+  text_scan ts = {0};
+  size_t size = 0;
+  for (;;) {
+    if (capacity - size < READ_CHUNK) {
+      char *grown = realloc(data, capacity * 2);
+      if (!grown) {
+        fprintf(stderr, RED "Failed to allocate buffer for %s\n" RESET, path);
+        free(data);
+        close(fd);
+        return -1;
+      }
+      data = grown;
+      capacity *= 2;
+    }
+    ssize_t n = read(fd, data + size, READ_CHUNK);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      fprintf(stderr, RED "Failed to read %s: %s\n" RESET, path,
+              strerror(errno));
+      free(data);
+      close(fd);
+      return -1;
+    }
+    if (n == 0) {
+      break;
+    }
+    scan(&ts, (const unsigned char *)data + size, (size_t)n);
+    size += (size_t)n;
+  }
+  close(fd);
+
+  buf->data = data;
+  buf->size = size;
+  buf->kind = classify(&ts, size);
+  return 0;
+}
+
+// Map a file sqwatch owns (a snapshot object). It is not classified: the
+// watched side already decided how the pair is diffed.
+int ingest_map(const char *path, ingest_buffer *buf) {
+  memset(buf, 0, sizeof(*buf));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, RED "Failed to open %s: %s\n" RESET, path,
+            strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  if (st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return ingest_read(path, buf);
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    buf->data = data;
+    buf->size = (size_t)st.st_size;
+    buf->mapped = 1;
+  }
+  close(fd);
+  buf->kind = buf->size ? INGEST_TEXT : INGEST_EMPTY;
+  return 0;
+}
+
+void ingest_release(ingest_buffer *buf) {
+  if (buf->mapped) {
+    munmap(buf->data, buf->size);
+  } else {
+    free(buf->data);
+  }
+  memset(buf, 0, sizeof(*buf));
+}
@@ -0,0 +1,715 @@
+#define _GNU_SOURCE
+#include "journal.h"
+#include "hash.h"
+#include "log.h"
+#include "sqwatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PENDING_RECORDS 4096
+
+static int open_journal_file(const char *dir, const char *name,
+                             uint64_t *size) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    fprintf(stderr, RED "+ Failed to open journal file %s: %s\n" RESET, path,
+            strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+  journal_header header;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header.version = JOURNAL_VERSION;
+    header.record_size = sizeof(journal_record);
+    if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+      close(fd);
+      return -1;
+    }
+    *size = sizeof(header);
+    return fd;
+  }
+
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+      header.version != JOURNAL_VERSION ||
+      header.record_size != sizeof(journal_record)) {
+    fprintf(stderr, RED "+ %s is not a sqwatch journal file\n" RESET, path);
+    close(fd);
+    return -1;
+  }
+  *size = st.st_size;
+  return fd;
+}
+
+static journal_path *find_path(const journal *j, const char *path,
+                               uint64_t hash) {
+  size_t mask = j->path_capacity - 1;
+  size_t i = hash & mask;
+  while (j->paths[i].path) {
+    if (j->paths[i].hash == hash && strcmp(j->paths[i].path, path) == 0) {
+      return &j->paths[i];
+    }
+    i = (i + 1) & mask;
+  }
+  return &j->paths[i];
+}
+
+static int grow_paths(journal *j) {
+  size_t capacity = j->path_capacity ? j->path_capacity * 2 : 1024;
+  journal_path *paths = calloc(capacity, sizeof(journal_path));
+  if (!paths) {
+    return -1;
+  }
+  for (size_t i = 0; i < j->path_capacity; i++) {
+    if (!j->paths[i].path) {
+      continue;
+    }
+    size_t k = j->paths[i].hash & (capacity - 1);
+    while (paths[k].path) {
+      k = (k + 1) & (capacity - 1);
+    }
+    paths[k] = j->paths[i];
+  }
+  free(j->paths);
+  j->paths = paths;
+  j->path_capacity = capacity;
+  return 0;
+}
+
+static int remember_path(journal *j, const char *path, size_t length) {
+  if ((j->path_count + 1) * 2 > j->path_capacity && grow_paths(j) != 0) {
+    return -1;
+  }
+  char *copy = strndup(path, length);
+  if (!copy) {
+    return -1;
+  }
+  uint64_t hash = hash_string(copy);
+  journal_path *slot = find_path(j, copy, hash);
+  slot->path = copy;
+  slot->hash = hash;
+  slot->id = j->path_count++;
+  return 0;
+}
+
+// Rebuild the path table from strings.bin, dropping a torn last entry
+static int load_strings(journal *j, uint64_t size) {
+  size_t length = size - sizeof(journal_header);
+  char *data = malloc(length ? length : 1);
+  if (!data ||
+      pread(j->strings_fd, data, length, sizeof(journal_header)) !=
+          (ssize_t)length) {
+    free(data);
+    return -1;
+  }
+
+  size_t off = 0;
+  while (off + sizeof(uint32_t) <= length) {
+    uint32_t n;
+    memcpy(&n, data + off, sizeof(n));
+    if (off + sizeof(n) + n > length) {
+      break;
+    }
+    if (remember_path(j, data + off + sizeof(n), n) != 0) {
+      free(data);
+      return -1;
+    }
+    off += sizeof(n) + n;
+  }
+  free(data);
+  if (off != length) {
+    return ftruncate(j->strings_fd, sizeof(journal_header) + off);
+  }
+  return 0;
+}
+
+// Records and index entries are fixed size; cut anything torn off the end
+static int load_records(journal *j, uint64_t records_size,
+                        uint64_t index_size) {
+  uint64_t count = (records_size - sizeof(journal_header)) /
+                   sizeof(journal_record);
+  if (ftruncate(j->records_fd,
+                sizeof(journal_header) + count * sizeof(journal_record)) != 0) {
+    return -1;
+  }
+  j->record_count = count;
+  if (count > 0) {
+    journal_record last;
+    if (pread(j->records_fd, &last, sizeof(last),
+              sizeof(journal_header) + (count - 1) * sizeof(last)) !=
+        sizeof(last)) {
+      return -1;
+    }
+    j->last_ns = last.time_ns;
+  }
+
+  // One entry per stride of records that exist
+  uint64_t entries = (index_size - sizeof(journal_header)) /
+                     sizeof(journal_index_entry);
+  uint64_t wanted = (count + JOURNAL_INDEX_STRIDE - 1) / JOURNAL_INDEX_STRIDE;
+  if (entries > wanted) {
+    entries = wanted;
+  }
+  if (ftruncate(j->index_fd, sizeof(journal_header) +
+                                 entries * sizeof(journal_index_entry)) != 0) {
+    return -1;
+  }
+  // Reindex the tail if the index fell behind the records
+  for (uint64_t e = entries; e < wanted; e++) {
+    journal_record r;
+    if (pread(j->records_fd, &r, sizeof(r),
+              sizeof(journal_header) +
+                  e * JOURNAL_INDEX_STRIDE * sizeof(r)) != sizeof(r)) {
+      return -1;
+    }
+    journal_index_entry entry = {r.time_ns, e * JOURNAL_INDEX_STRIDE};
+    if (write(j->index_fd, &entry, sizeof(entry)) != sizeof(entry)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int journal_open(journal *j, const char *dir) {
+  memset(j, 0, sizeof(*j));
+  j->records_fd = j->strings_fd = j->index_fd = -1;
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, RED "+ Failed to create journal directory %s: %s\n" RESET,
+            dir, strerror(errno));
+    return -1;
+  }
+  j->dir = strdup(dir);
+  if (!j->dir) {
+    return -1;
+  }
+  pthread_mutex_init(&j->lock, NULL);
+
+  uint64_t records_size = 0, strings_size = 0, index_size = 0;
+  j->records_fd = open_journal_file(dir, "records.bin", &records_size);
+  j->strings_fd = open_journal_file(dir, "strings.bin", &strings_size);
+  j->index_fd = open_journal_file(dir, "index.bin", &index_size);
+  j->pending = malloc(PENDING_RECORDS * sizeof(journal_record));
+  if (j->records_fd == -1 || j->strings_fd == -1 || j->index_fd == -1 ||
+      !j->pending || grow_paths(j) != 0 ||
+      load_strings(j, strings_size) != 0 ||
+      load_records(j, records_size, index_size) != 0) {
+    fprintf(stderr, RED "+ Failed to open journal %s\n" RESET, dir);
+    journal_close(j);
+    return -1;
+  }
+  return 0;
+}
+
+static int write_all(int fd, const void *data, size_t length) {
+  const char *p = data;
+  while (length > 0) {
+    ssize_t n = write(fd, p, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    length -= n;
+  }
+  return 0;
+}
+
+static void flush_locked(journal *j) {
+  // Strings first: a record on disk never refers to a missing path
+  if (write_all(j->strings_fd, j->strings, j->strings_length) != 0 ||
+      write_all(j->records_fd, j->pending,
+                j->pending_count * sizeof(journal_record)) != 0 ||
+      write_all(j->index_fd, j->index,
+                j->index_count * sizeof(journal_index_entry)) != 0) {
+    fprintf(stderr, RED "+ Failed to write journal %s: %s\n" RESET, j->dir,
+            strerror(errno));
+  }
+  j->strings_length = 0;
+  j->pending_count = 0;
+  j->index_count = 0;
+}
+
+static int buffer_string(journal *j, const char *path, uint32_t length) {
+  size_t needed = j->strings_length + sizeof(length) + length;
+  if (needed > j->strings_capacity) {
+    size_t capacity = j->strings_capacity ? j->strings_capacity : 4096;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    char *strings = realloc(j->strings, capacity);
+    if (!strings) {
+      return -1;
+    }
+    j->strings = strings;
+    j->strings_capacity = capacity;
+  }
+  memcpy(j->strings + j->strings_length, &length, sizeof(length));
+  memcpy(j->strings + j->strings_length + sizeof(length), path, length);
+  j->strings_length = needed;
+  return 0;
+}
+
+static int buffer_index(journal *j, uint64_t time_ns) {
+  if (j->index_count == j->index_capacity) {
+    size_t capacity = j->index_capacity ? j->index_capacity * 2 : 16;
+    journal_index_entry *index =
+        realloc(j->index, capacity * sizeof(journal_index_entry));
+    if (!index) {
+      return -1;
+    }
+    j->index = index;
+    j->index_capacity = capacity;
+  }
+  j->index[j->index_count++] = (journal_index_entry){time_ns, j->record_count};
+  return 0;
+}
+
+// Record one event or diff. Timestamps are clamped so the records stay
+// sorted even if the wall clock steps back.
+void journal_append(journal *j, const char *path, uint32_t mask,
+                    journal_kind kind, uint32_t changed, uint64_t size) {
+  if (!j || !j->dir) {
+    return;
+  }
+  uint64_t now = log_now_ns();
+
+  pthread_mutex_lock(&j->lock);
+  uint64_t hash = hash_string(path);
+  journal_path *slot = find_path(j, path, hash);
+  if (!slot->path) {
+    size_t length = strlen(path);
+    if (buffer_string(j, path, length) != 0 ||
+        remember_path(j, path, length) != 0) {
+      pthread_mutex_unlock(&j->lock);
+      return;
+    }
+    slot = find_path(j, path, hash);
+  }
+
+  if (now < j->last_ns) {
+    now = j->last_ns;
+  }
+  j->last_ns = now;
+  if (j->record_count % JOURNAL_INDEX_STRIDE == 0 &&
+      buffer_index(j, now) != 0) {
+    pthread_mutex_unlock(&j->lock);
+    return;
+  }
+  j->pending[j->pending_count++] =
+      (journal_record){now, slot->id, mask, kind, changed, size};
+  j->record_count++;
+  if (j->pending_count == PENDING_RECORDS) {
+    flush_locked(j);
+  }
+  pthread_mutex_unlock(&j->lock);
+}
+
+void journal_flush(journal *j) {
+  if (!j->dir) {
+    return;
+  }
+  pthread_mutex_lock(&j->lock);
+  if (j->pending_count > 0 || j->strings_length > 0) {
+    flush_locked(j);
+  }
+  pthread_mutex_unlock(&j->lock);
+}
+
+void journal_close(journal *j) {
+  if (!j->dir) {
+    return;
+  }
+  journal_flush(j);
+  if (j->records_fd != -1) {
+    close(j->records_fd);
+  }
+  if (j->strings_fd != -1) {
+    close(j->strings_fd);
+  }
+  if (j->index_fd != -1) {
+    close(j->index_fd);
+  }
+  for (size_t i = 0; i < j->path_capacity; i++) {
+    free(j->paths[i].path);
+  }
+  pthread_mutex_destroy(&j->lock);
+  free(j->paths);
+  free(j->pending);
+  free(j->strings);
+  free(j->index);
+  free(j->dir);
+  memset(j, 0, sizeof(*j));
+  j->records_fd = j->strings_fd = j->index_fd = -1;
+}
+
+// Query side: sqwatch journal <dir> [--since T] [--until T] [--under PATH]
+
+typedef struct {
+  const char *data;
+  size_t size;
+} mapped_file;
+
+static int map_journal_file(const char *dir, const char *name,
+                            mapped_file *file) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  file->data = NULL;
+  file->size = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, RED "+ Failed to open %s: %s\n" RESET, path,
+            strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(journal_header)) {
+    fprintf(stderr, RED "+ %s is not a sqwatch journal file\n" RESET, path);
+    close(fd);
+    return -1;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return -1;
+  }
+  const journal_header *header = data;
+  if (memcmp(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 ||
+      header->version != JOURNAL_VERSION ||
+      header->record_size != sizeof(journal_record)) {
+    fprintf(stderr, RED "+ %s is not a sqwatch journal file\n" RESET, path);
+    munmap(data, st.st_size);
+    return -1;
+  }
+  file->data = data;
+  file->size = st.st_size;
+  return 0;
+}
+
+static void unmap_journal_file(mapped_file *file) {
+  if (file->data) {
+    munmap((void *)file->data, file->size);
+  }
+}
+
+// now, -<n>[s|m|h|d] (relative), epoch seconds, or local
+// "YYYY-MM-DD[ HH:MM[:SS]]"
+static int parse_time_arg(const char *text, uint64_t *out) {
+  uint64_t now = log_now_ns();
+  if (strcmp(text, "now") == 0) {
+    *out = now;
+    return 0;
+  }
+
+  char *end;
+  if (text[0] == '-') {
+    double value = strtod(text + 1, &end);
+    if (end == text + 1 || value < 0) {
+      return -1;
+    }
+    double scale = *end == 'm' ? 60 : *end == 'h' ? 3600 : *end == 'd' ? 86400
+                                                                       : 1;
+    if (*end != '\0' && (strchr("smhd", *end) == NULL || end[1] != '\0')) {
+      return -1;
+    }
+    uint64_t ago = (uint64_t)(value * scale * 1e9);
+    *out = ago > now ? 0 : now - ago;
+    return 0;
+  }
+
+  double seconds = strtod(text, &end);
+  if (end != text && *end == '\0') {
+    *out = (uint64_t)(seconds * 1e9);
+    return 0;
+  }
+
+  static const char *formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S",
+                                  "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M",
+                                  "%Y-%m-%d"};
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(text, formats[i], &tm);
+    if (end && *end == '\0') {
+      tm.tm_isdst = -1;
+      time_t t = mktime(&tm);
+      if (t == (time_t)-1) {
+        return -1;
+      }
+      *out = (uint64_t)t * 1000000000ULL;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Path ids are dense, so one pass over the string table resolves which
+// ids fall under the prefix; records then only need an array lookup
+typedef struct {
+  const char **paths;
+  uint32_t *lengths;
+  uint8_t *matches;
+  uint32_t count;
+} path_table;
+
+// Spell a path one way: no "." components, no repeated or trailing
+// slashes. Recorded paths keep the root as sqwatch was given it, so
+// "./src/a.c" and "src//a.c" both become "src/a.c". Returns the length,
+// or -1 when it does not fit.
+static int normalize_path(const char *path, size_t len, char *out,
+                          size_t cap) {
+  size_t n = 0;
+  size_t i = 0;
+  if (len > 0 && path[0] == '/') {
+    out[n++] = '/';
+  }
+  while (i < len) {
+    while (i < len && path[i] == '/') {
+      i++;
+    }
+    size_t start = i;
+    while (i < len && path[i] != '/') {
+      i++;
+    }
+    size_t part = i - start;
+    if (part == 0 || (part == 1 && path[start] == '.')) {
+      continue;
+    }
+    if (n + part + 2 > cap) {
+      return -1;
+    }
+    if (n > 0 && out[n - 1] != '/') {
+      out[n++] = '/';
+    }
+    memcpy(out + n, path + start, part);
+    n += part;
+  }
+  out[n] = '\0';
+  return (int)n;
+}
+
+static int load_path_table(const mapped_file *strings, const char *prefix,
+                           path_table *table) {
+  memset(table, 0, sizeof(*table));
+  size_t end = sizeof(journal_header);
+  uint32_t count = 0;
+  for (;;) {
+    uint32_t n;
+    if (end + sizeof(n) > strings->size) {
+      break;
+    }
+    memcpy(&n, strings->data + end, sizeof(n));
+    if (end + sizeof(n) + n > strings->size) {
+      break;
+    }
+    end += sizeof(n) + n;
+    count++;
+  }
+
+  table->paths = malloc((count ? count : 1) * sizeof(char *));
+  table->lengths = malloc((count ? count : 1) * sizeof(uint32_t));
+  table->matches = malloc(count ? count : 1);
+  if (!table->paths || !table->lengths || !table->matches) {
+    return -1;
+  }
+
+  // "src", "src/" and "./src" all cover src itself and everything below
+  // it, however the watched root was spelled; "." covers every relative
+  // path
+  char want[PATH_MAX];
+  int want_len = 0;
+  if (prefix) {
+    want_len = normalize_path(prefix, strlen(prefix), want, sizeof(want));
+    if (want_len < 0) {
+      return -1;
+    }
+  }
+  char have[PATH_MAX];
+  size_t off = sizeof(journal_header);
+  for (uint32_t id = 0; id < count; id++) {
+    uint32_t n;
+    memcpy(&n, strings->data + off, sizeof(n));
+    const char *path = strings->data + off + sizeof(n);
+    int match = 1;
+    if (prefix) {
+      int have_len = normalize_path(path, n, have, sizeof(have));
+      match = have_len >= want_len &&
+              memcmp(have, want, (size_t)want_len) == 0 &&
+              (have_len == want_len || want_len == 0 ||
+               want[want_len - 1] == '/' || have[want_len] == '/');
+      if (want_len == 0 && have_len > 0 && have[0] == '/') {
+        match = 0;
+      }
+    }
+    table->paths[id] = path;
+    table->lengths[id] = n;
+    table->matches[id] = (uint8_t)match;
+    off += sizeof(n) + n;
+  }
+  table->count = count;
+  return 0;
+}
+
+static void free_path_table(path_table *table) {
+  free(table->paths);
+  free(table->lengths);
+  free(table->matches);
+}
+
+// First record that could be at or after since: binary search the sparse
+// index, leaving at most one stride to scan
+static uint64_t seek_records(const mapped_file *index, uint64_t since,
+                             uint64_t record_count) {
+  const journal_index_entry *entries =
+      (const journal_index_entry *)(index->data + sizeof(journal_header));
+  size_t count = (index->size - sizeof(journal_header)) /
+                 sizeof(journal_index_entry);
+  size_t lo = 0, hi = count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (entries[mid].time_ns < since) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return 0;
+  }
+  uint64_t start = entries[lo - 1].record;
+  return start < record_count ? start : record_count;
+}
+
+static void print_journal_usage(void) {
+  printf("Usage: sqwatch journal directory [--since time] [--until time] [--under path] [--diffs] [--count]\n");
+  printf("Options:\n");
+  printf("  --since time      Only records at or after time\n");
+  printf("  --until time      Only records at or before time\n");
+  printf("                    time is now, -<n>[s|m|h|d] (ago), epoch seconds,\n");
+  printf("                    or local YYYY-MM-DD[ HH:MM[:SS]]\n");
+  printf("  --under path      Only paths equal to or below path\n");
+  printf("  --diffs           Only diff records\n");
+  printf("  --count           Print the number of matching records only\n");
+}
+
+int journal_main(int argc, char *argv[]) {
+  static struct option options[] = {
+      {"since", required_argument, 0, 's'}, {"until", required_argument, 0, 'u'},
+      {"under", required_argument, 0, 'p'}, {"diffs", no_argument, 0, 'D'},
+      {"count", no_argument, 0, 'n'},       {"help", no_argument, 0, 'h'},
+      {0, 0, 0, 0}};
+  uint64_t since = 0, until = UINT64_MAX;
+  const char *prefix = NULL;
+  int diffs_only = 0, count_only = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+    switch (opt) {
+    case 's':
+    case 'u':
+      if (parse_time_arg(optarg, opt == 's' ? &since : &until) != 0) {
+        fprintf(stderr, "Invalid time: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'p':
+      prefix = optarg;
+      break;
+    case 'D':
+      diffs_only = 1;
+      break;
+    case 'n':
+      count_only = 1;
+      break;
+    case 'h':
+      print_journal_usage();
+      return EXIT_SUCCESS;
+    default:
+      print_journal_usage();
+      return EXIT_FAILURE;
+    }
+  }
+  if (optind != argc - 1) {
+    print_journal_usage();
+    return EXIT_FAILURE;
+  }
+  const char *dir = argv[optind];
+
+  uint64_t start_ns = debounce_now_ns();
+  mapped_file records, strings, index;
+  if (map_journal_file(dir, "records.bin", &records) != 0 ||
+      map_journal_file(dir, "strings.bin", &strings) != 0 ||
+      map_journal_file(dir, "index.bin", &index) != 0) {
+    return EXIT_FAILURE;
+  }
+
+  path_table table;
+  if (load_path_table(&strings, prefix, &table) != 0) {
+    fprintf(stderr, RED "+ Failed to load the journal path table\n" RESET);
+    return EXIT_FAILURE;
+  }
+
+  const journal_record *rec =
+      (const journal_record *)(records.data + sizeof(journal_header));
+  uint64_t record_count =
+      (records.size - sizeof(journal_header)) / sizeof(journal_record);
+  uint64_t matched = 0;
+  uint64_t i = seek_records(&index, since, record_count);
+  for (; i < record_count && rec[i].time_ns <= until; i++) {
+    const journal_record *r = &rec[i];
+    if (r->time_ns < since || r->path_id >= table.count ||
+        !table.matches[r->path_id] || (diffs_only && r->kind == JOURNAL_EVENT)) {
+      continue;
+    }
+    matched++;
+    if (count_only) {
+      continue;
+    }
+
+    char timestamp[64];
+    log_format_time(r->time_ns, timestamp, sizeof(timestamp));
+    printf("%s  %-12s %.*s", timestamp,
+           r->kind == JOURNAL_EVENT ? event_description(r->mask) : "Diff",
+           (int)table.lengths[r->path_id], table.paths[r->path_id]);
+    if (r->kind == JOURNAL_DIFF_TEXT) {
+      printf("  (%u lines changed, %llu bytes)", r->changed,
+             (unsigned long long)r->size);
+    } else if (r->kind == JOURNAL_DIFF_BINARY) {
+      printf("  (binary, %u bytes changed, %llu bytes)", r->changed,
+             (unsigned long long)r->size);
+    }
+    printf("\n");
+  }
+
+  if (count_only) {
+    printf("%llu\n", (unsigned long long)matched);
+  }
+  fprintf(stderr, DARK_GREY "+ %llu of %llu records matched in %.2fms\n" RESET,
+          (unsigned long long)matched, (unsigned long long)record_count,
+          (debounce_now_ns() - start_ns) / 1e6);
+
+  free_path_table(&table);
+  unmap_journal_file(&records);
+  unmap_journal_file(&strings);
+  unmap_journal_file(&index);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include "launcher.h"
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static int pidfd_open(pid_t pid) {
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+// The leader is signalled through its pidfd, which can never hit a reused
+// pid; killpg reaches the rest of the group. The group id stays reserved
+// until the leader is reaped, so both are safe while a job is live.
+static void signal_job(launcher_job *job, int signo) {
+  if (job->pidfd != -1) {
+    syscall(SYS_pidfd_send_signal, job->pidfd, signo, NULL, 0);
+  }
+  killpg(job->pid, signo);
+}
+
+static void release_job(launcher_job *job) {
+  launcher *l = job->owner;
+  if (job->pidfd != -1) {
+    reactor_remove(l->loop, job->pidfd);
+    close(job->pidfd);
+    job->pidfd = -1;
+  }
+  if (job->kill_timer_fd != -1) {
+    reactor_timer_disarm(job->kill_timer_fd);
+  }
+  job->pid = 0;
+  job->terminating = 0;
+  l->running--;
+}
+
+// Reap the job if its leader has exited and report it
+static void reap_job(launcher_job *job) {
+  if (job->pid <= 0) {
+    return;
+  }
+  // Peek first: the group id is only ours until the leader is reaped
+  siginfo_t info;
+  info.si_pid = 0;
+  if (waitid(P_PID, job->pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0 ||
+      info.si_pid == 0) {
+    return;
+  }
+  if (job->terminating) {
+    // Stragglers of a run being replaced don't get to outlive it
+    killpg(job->pid, SIGKILL);
+  }
+  int status = 0;
+  waitpid(job->pid, &status, 0);
+
+  launcher *l = job->owner;
+  release_job(job);
+  if (l->on_exit) {
+    l->on_exit(l, status, l->ctx);
+  }
+}
+
+static void on_job_exit(int fd, uint32_t events, void *data) {
+  (void)fd;
+  (void)events;
+  reap_job(data);
+}
+
+static void on_kill_timer(int fd, uint32_t events, void *data) {
+  (void)events;
+  launcher_job *job = data;
+  uint64_t expirations;
+  if (read(fd, &expirations, sizeof(expirations)) < 0) {
+    return;
+  }
+  // Grace period is over; force kill whatever is left of the group
+  if (job->pid > 0) {
+    signal_job(job, SIGKILL);
+  }
+}
+
+int launcher_init(launcher *l, reactor *loop, const char *command, int slots,
+                  uint64_t grace_ns, launcher_exit_fn on_exit, void *ctx) {
+  memset(l, 0, sizeof(*l));
+  l->loop = loop;
+  l->command = command;
+  l->grace_ns = grace_ns;
+  l->on_exit = on_exit;
+  l->ctx = ctx;
+  l->jobs = calloc(slots, sizeof(launcher_job));
+  if (!l->jobs) {
+    return -1;
+  }
+  l->slots = slots;
+  for (int i = 0; i < slots; i++) {
+    l->jobs[i].owner = l;
+    l->jobs[i].pidfd = -1;
+    l->jobs[i].kill_timer_fd = -1;
+  }
+  for (int i = 0; i < slots; i++) {
+    launcher_job *job = &l->jobs[i];
+    job->kill_timer_fd = reactor_timer_create();
+    if (job->kill_timer_fd == -1 ||
+        reactor_add(loop, job->kill_timer_fd, EPOLLIN, on_kill_timer, job) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Start one run in a free slot. Returns -1 if every slot is busy or the
+// spawn failed.
+int launcher_spawn(launcher *l) {
+  launcher_job *job = NULL;
+  for (int i = 0; i < l->slots && !job; i++) {
+    if (l->jobs[i].pid == 0) {
+      job = &l->jobs[i];
+    }
+  }
+  if (!job) {
+    return -1;
+  }
+
+  // The child starts in its own process group with the signals the watcher
+  // blocks (and consumes through its signalfd) unblocked and defaulted
+  posix_spawnattr_t attr;
+  sigset_t none, defaults;
+  sigemptyset(&none);
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGINT);
+  sigaddset(&defaults, SIGTERM);
+  sigaddset(&defaults, SIGCHLD);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                      POSIX_SPAWN_SETSIGMASK |
+                                      POSIX_SPAWN_SETSIGDEF);
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setsigmask(&attr, &none);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+
+  // Don't let the child inherit (and re-print) our buffered output
+  fflush(stdout);
+  fflush(stderr);
+  char *const args[] = {"/bin/sh", "-c", (char *)l->command, NULL};
+  pid_t pid;
+  int rc = posix_spawn(&pid, "/bin/sh", NULL, &attr, args, environ);
+  posix_spawnattr_destroy(&attr);
+  if (rc != 0) {
+    fprintf(stderr, "posix_spawn: %s\n", strerror(rc));
+    return -1;
+  }
+
+  job->pid = pid;
+  job->terminating = 0;
+  l->running++;
+  job->pidfd = pidfd_open(pid);
+  if (job->pidfd != -1 &&
+      reactor_add(l->loop, job->pidfd, EPOLLIN, on_job_exit, job) != 0) {
+    close(job->pidfd);
+    job->pidfd = -1;
+  }
+  return 0;
+}
+
+// SIGTERM every running group; each gets grace_ns to exit before SIGKILL.
+// Never blocks: exits arrive through the pidfds.
+void launcher_terminate(launcher *l) {
+  for (int i = 0; i < l->slots; i++) {
+    launcher_job *job = &l->jobs[i];
+    if (job->pid > 0 && !job->terminating) {
+      job->terminating = 1;
+      signal_job(job, SIGTERM);
+      reactor_timer_arm(job->kill_timer_fd, l->grace_ns);
+    }
+  }
+}
+
+// SIGCHLD fallback for kernels without pidfd support
+void launcher_reap(launcher *l) {
+  for (int i = 0; i < l->slots; i++) {
+    reap_job(&l->jobs[i]);
+  }
+}
+
+// Forward the watcher's exit signal to every run and wait for it, then
+// free the launcher
+void launcher_shutdown(launcher *l, int signo) {
+  for (int i = 0; i < l->slots; i++) {
+    launcher_job *job = &l->jobs[i];
+    if (job->pid > 0) {
+      signal_job(job, signo);
+      waitpid(job->pid, NULL, 0);
+    }
+    if (job->pidfd != -1) {
+      close(job->pidfd);
+    }
+    if (job->kill_timer_fd != -1) {
+      close(job->kill_timer_fd);
+    }
+  }
+  free(l->jobs);
+  memset(l, 0, sizeof(*l));
+}
+
+// restart, queue-one, skip or parallel[:N]; slots is the job limit
+int parse_busy_policy(const char *text, busy_policy *policy, int *slots) {
+  *slots = 1;
+  if (strcmp(text, "restart") == 0) {
+    *policy = BUSY_RESTART;
+  } else if (strcmp(text, "queue-one") == 0) {
+    *policy = BUSY_QUEUE_ONE;
+  } else if (strcmp(text, "skip") == 0) {
+    *policy = BUSY_SKIP;
+  } else if (strncmp(text, "parallel", 8) == 0) {
+    *policy = BUSY_PARALLEL;
+    *slots = 2;
+    if (text[8] == ':') {
+      char *end;
+      long n = strtol(text + 9, &end, 10);
+      if (end == text + 9 || *end != '\0' || n < 1 || n > 1024) {
+        return -1;
+      }
+      *slots = (int)n;
+    } else if (text[8] != '\0') {
+      return -1;
+    }
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+const char *busy_policy_name(busy_policy policy) {
+  switch (policy) {
+  case BUSY_QUEUE_ONE:
+    return "queue-one";
+  case BUSY_SKIP:
+    return "skip";
+  case BUSY_PARALLEL:
+    return "parallel";
+  default:
+    return "restart";
+  }
+}
@@ -0,0 +1,137 @@
+#include "linescan.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+typedef struct {
+  line_view *lines;
+  size_t count;
+  size_t capacity;
+  size_t start; // offset of the line being scanned
+} line_builder;
+
+static int push_line(line_builder *b, size_t end) {
+  if (b->count == b->capacity) {
+    size_t capacity = b->capacity * 2;
+    line_view *lines = realloc(b->lines, capacity * sizeof(line_view));
+    if (!lines) {
+      return -1;
+    }
+    b->lines = lines;
+    b->capacity = capacity;
+  }
+  b->lines[b->count++] = (line_view){b->start, end - b->start};
+  b->start = end + 1;
+  return 0;
+}
+
+// Scalar fallback, also used for the tail the vector loops leave behind
+static int scan_scalar(const char *data, size_t pos, size_t size,
+                       line_builder *b) {
+  while (pos < size) {
+    const char *nl = memchr(data + pos, '\n', size - pos);
+    if (!nl) {
+      break;
+    }
+    pos = (size_t)(nl - data);
+    if (push_line(b, pos) != 0) {
+      return -1;
+    }
+    pos++;
+  }
+  return 0;
+}
+
+#if defined(__x86_64__)
+// One bit per newline in a block starting at `base`
+static int push_mask(line_builder *b, size_t base, uint32_t mask) {
+  while (mask) {
+    if (push_line(b, base + __builtin_ctz(mask)) != 0) {
+      return -1;
+    }
+    mask &= mask - 1;
+  }
+  return 0;
+}
+
+static int scan_sse2(const char *data, size_t size, line_builder *b) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+    if (mask && push_mask(b, i, mask) != 0) {
+      return -1;
+    }
+  }
+  return scan_scalar(data, i, size, b);
+}
+
+__attribute__((target("avx2"))) static int
+scan_avx2(const char *data, size_t size, line_builder *b) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + i));
+    uint32_t mask =
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, nl));
+    if (mask && push_mask(b, i, mask) != 0) {
+      return -1;
+    }
+  }
+  return scan_scalar(data, i, size, b);
+}
+#else
+static int scan_plain(const char *data, size_t size, line_builder *b) {
+  return scan_scalar(data, 0, size, b);
+}
+#endif
+
+typedef int (*scan_fn)(const char *data, size_t size, line_builder *b);
+
+static scan_fn select_scanner(void) {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return scan_avx2;
+  }
+  return scan_sse2; // baseline on x86-64
+#else
+  return scan_plain;
+#endif
+}
+
+const char *linescan_impl(void) {
+  scan_fn scan = select_scanner();
+#if defined(__x86_64__)
+  if (scan == scan_avx2) {
+    return "avx2";
+  }
+  if (scan == scan_sse2) {
+    return "sse2";
+  }
+#endif
+  (void)scan;
+  return "scalar";
+}
+
+// Split a buffer into line views. A final line without a newline still
+// counts. Returns the number of lines, or -1 on allocation failure.
+int linescan_split(const char *data, size_t size, line_view **lines) {
+  // Start from a rough guess so typical files never reallocate
+  line_builder b = {NULL, 0, size / 32 + 16, 0};
+  b.lines = malloc(b.capacity * sizeof(line_view));
+  if (!b.lines) {
+    return -1;
+  }
+
+  if (select_scanner()(data, size, &b) != 0 ||
+      (b.start < size && push_line(&b, size) != 0)) {
+    free(b.lines);
+    return -1;
+  }
+  *lines = b.lines;
+  return (int)b.count;
+}
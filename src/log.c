@@ -0,0 +1,251 @@
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RED "\033[31m"
+#define RESET "\033[0m"
+
+#define LOG_BUFFER_SIZE (256 * 1024)
+
+static int open_log(log_sink *sink) {
+  sink->fd = open(sink->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (sink->fd == -1) {
+    fprintf(stderr, RED "+ Failed to open log file %s: %s\n" RESET, sink->path,
+            strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  sink->file_bytes = fstat(sink->fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+  return 0;
+}
+
+int log_open(log_sink *sink, const char *path, log_format format,
+             uint64_t max_bytes, int keep) {
+  memset(sink, 0, sizeof(*sink));
+  sink->fd = -1;
+  sink->path = strdup(path);
+  sink->buffer = malloc(LOG_BUFFER_SIZE);
+  if (!sink->path || !sink->buffer) {
+    free(sink->path);
+    free(sink->buffer);
+    memset(sink, 0, sizeof(*sink));
+    return -1;
+  }
+  sink->capacity = LOG_BUFFER_SIZE;
+  sink->format = format;
+  sink->max_bytes = max_bytes;
+  sink->keep = keep;
+  pthread_mutex_init(&sink->lock, NULL);
+  if (open_log(sink) != 0) {
+    log_close(sink);
+    return -1;
+  }
+  return 0;
+}
+
+static void write_all(log_sink *sink, const char *data, size_t length) {
+  while (length > 0 && sink->fd != -1) {
+    ssize_t n = write(sink->fd, data, length);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, RED "+ Failed to write log file %s: %s\n" RESET,
+              sink->path, strerror(errno));
+      return;
+    }
+    data += n;
+    length -= n;
+    sink->file_bytes += n;
+  }
+}
+
+static void flush_locked(log_sink *sink) {
+  write_all(sink, sink->buffer, sink->length);
+  sink->length = 0;
+}
+
+// Shift path.N-1 -> path.N ... path -> path.1 and start a fresh file
+static void rotate_locked(log_sink *sink) {
+  flush_locked(sink);
+  close(sink->fd);
+  sink->fd = -1;
+
+  char from[PATH_MAX], to[PATH_MAX];
+  for (int i = sink->keep; i > 0; i--) {
+    if (i == 1) {
+      snprintf(from, sizeof(from), "%s", sink->path);
+    } else {
+      snprintf(from, sizeof(from), "%s.%d", sink->path, i - 1);
+    }
+    snprintf(to, sizeof(to), "%s.%d", sink->path, i);
+    if (rename(from, to) != 0 && errno != ENOENT) {
+      fprintf(stderr, RED "+ Failed to rotate %s: %s\n" RESET, from,
+              strerror(errno));
+    }
+  }
+  if (sink->keep == 0) {
+    unlink(sink->path);
+  }
+  open_log(sink);
+}
+
+// Add one complete record. Records are never split across a flush or a
+// rotation.
+void log_append(log_sink *sink, const char *record, size_t length) {
+  if (!sink || !sink->path) {
+    return;
+  }
+  pthread_mutex_lock(&sink->lock);
+  if (sink->max_bytes > 0 && sink->file_bytes > 0 &&
+      sink->file_bytes + sink->length + length > sink->max_bytes) {
+    rotate_locked(sink);
+  }
+  if (sink->length + length > sink->capacity) {
+    flush_locked(sink);
+  }
+  if (length > sink->capacity) {
+    write_all(sink, record, length);
+  } else {
+    memcpy(sink->buffer + sink->length, record, length);
+    sink->length += length;
+  }
+  pthread_mutex_unlock(&sink->lock);
+}
+
+void log_flush(log_sink *sink) {
+  if (!sink->path) {
+    return;
+  }
+  pthread_mutex_lock(&sink->lock);
+  if (sink->length > 0) {
+    flush_locked(sink);
+  }
+  pthread_mutex_unlock(&sink->lock);
+}
+
+void log_close(log_sink *sink) {
+  if (!sink->path) {
+    return;
+  }
+  log_flush(sink);
+  if (sink->fd != -1) {
+    close(sink->fd);
+  }
+  pthread_mutex_destroy(&sink->lock);
+  free(sink->path);
+  free(sink->buffer);
+  memset(sink, 0, sizeof(*sink));
+  sink->fd = -1;
+}
+
+uint64_t log_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Local time with millisecond precision, e.g. 2024-05-01 12:00:00.123
+void log_format_time(uint64_t time_ns, char *out, size_t size) {
+  time_t seconds = (time_t)(time_ns / 1000000000ULL);
+  struct tm tm;
+  localtime_r(&seconds, &tm);
+  size_t n = strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+  snprintf(out + n, size - n, ".%03u",
+           (unsigned)(time_ns % 1000000000ULL / 1000000));
+}
+
+// Length of the valid UTF-8 sequence at p, or 0
+static size_t utf8_length(const unsigned char *p, size_t left) {
+  size_t n = p[0] >= 0xf0 && p[0] <= 0xf4 ? 4
+             : p[0] >= 0xe0              ? 3
+             : p[0] >= 0xc2 && p[0] < 0xe0 ? 2
+                                           : 0;
+  if (n == 0 || n > left) {
+    return 0;
+  }
+  for (size_t i = 1; i < n; i++) {
+    if ((p[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+// Write text as a JSON string. Bytes that aren't valid UTF-8 become
+// U+FFFD so every line stays parseable.
+void log_json_string(FILE *out, const char *text, size_t length) {
+  const unsigned char *p = (const unsigned char *)text;
+  fputc('"', out);
+  for (size_t i = 0; i < length;) {
+    unsigned char c = p[i];
+    if (c == '"' || c == '\\') {
+      fputc('\\', out);
+      fputc(c, out);
+    } else if (c == '\n') {
+      fputs("\\n", out);
+    } else if (c == '\r') {
+      fputs("\\r", out);
+    } else if (c == '\t') {
+      fputs("\\t", out);
+    } else if (c < 0x20 || c == 0x7f) {
+      fprintf(out, "\\u%04x", c);
+    } else if (c >= 0x80) {
+      size_t n = utf8_length(p + i, length - i);
+      if (n == 0) {
+        fputs("\\ufffd", out);
+        i++;
+      } else {
+        fwrite(p + i, 1, n, out);
+        i += n;
+      }
+      continue;
+    } else {
+      fputc(c, out);
+    }
+    i++;
+  }
+  fputc('"', out);
+}
+
+int parse_log_format(const char *text, log_format *out) {
+  if (strcmp(text, "text") == 0) {
+    *out = LOG_FORMAT_TEXT;
+  } else if (strcmp(text, "jsonl") == 0) {
+    *out = LOG_FORMAT_JSONL;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+// Byte count with an optional K, M or G suffix (powers of 1024)
+int parse_size_bytes(const char *text, uint64_t *out) {
+  char *end = NULL;
+  errno = 0;
+  unsigned long long value = strtoull(text, &end, 10);
+  if (end == text || errno != 0 || text[0] == '-') {
+    return -1;
+  }
+  int shift = 0;
+  if (*end == 'K' || *end == 'k') {
+    shift = 10;
+  } else if (*end == 'M' || *end == 'm') {
+    shift = 20;
+  } else if (*end == 'G' || *end == 'g') {
+    shift = 30;
+  } else if (*end != '\0') {
+    return -1;
+  }
+  if (shift && end[1] != '\0') {
+    return -1;
+  }
+  *out = (uint64_t)value << shift;
+  return 0;
+}
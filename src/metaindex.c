@@ -0,0 +1,157 @@
+#include "metaindex.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t round_pow2(size_t n) {
+  size_t cap = 16;
+  while (cap < n) {
+    cap <<= 1;
+  }
+  return cap;
+}
+
+static int64_t mtime_of(const struct stat *st) {
+  return (int64_t)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+static meta_entry *find_slot(const meta_index *index, const char *path,
+                             uint64_t hash) {
+  size_t mask = index->capacity - 1;
+  size_t i = hash & mask;
+  for (;;) {
+    meta_entry *slot = &index->slots[i];
+    if (slot->path && slot->hash == hash && strcmp(slot->path, path) == 0) {
+      return slot;
+    }
+    if (!slot->path && !slot->deleted) {
+      return NULL;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+static int rehash(meta_index *index, size_t capacity) {
+  meta_entry *slots = calloc(capacity, sizeof(meta_entry));
+  if (!slots) {
+    return -1;
+  }
+  meta_entry *old = index->slots;
+  size_t old_capacity = index->capacity;
+  index->slots = slots;
+  index->capacity = capacity;
+  index->used = index->count;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (!old[i].path) {
+      continue;
+    }
+    size_t mask = capacity - 1;
+    size_t j = old[i].hash & mask;
+    while (slots[j].path) {
+      j = (j + 1) & mask;
+    }
+    slots[j] = old[i];
+  }
+  free(old);
+  return 0;
+}
+
+int metaindex_init(meta_index *index, size_t initial_capacity) {
+  memset(index, 0, sizeof(*index));
+  return rehash(index, round_pow2(initial_capacity));
+}
+
+void metaindex_free(meta_index *index) {
+  for (size_t i = 0; i < index->capacity; i++) {
+    free(index->slots[i].path);
+  }
+  free(index->slots);
+  memset(index, 0, sizeof(*index));
+}
+
+meta_entry *metaindex_lookup(const meta_index *index, const char *path) {
+  if (!index->slots) {
+    return NULL;
+  }
+  return find_slot(index, path, hash_string(path));
+}
+
+// Record the current metadata for path, inserting it if needed, and stamp
+// it with the index's generation
+meta_entry *metaindex_update(meta_index *index, const char *path,
+                             const struct stat *st) {
+  if (!index->slots) {
+    return NULL;
+  }
+  uint64_t hash = hash_string(path);
+  meta_entry *entry = find_slot(index, path, hash);
+  if (!entry) {
+    // Keep the table at most 3/4 full, tombstones included
+    if ((index->used + 1) * 4 > index->capacity * 3) {
+      size_t capacity = index->count * 2 >= index->capacity
+                            ? index->capacity * 2
+                            : index->capacity;
+      if (rehash(index, capacity) != 0) {
+        return NULL;
+      }
+    }
+    char *path_copy = strdup(path);
+    if (!path_copy) {
+      return NULL;
+    }
+
+    size_t mask = index->capacity - 1;
+    size_t i = hash & mask;
+    while (index->slots[i].path) {
+      i = (i + 1) & mask;
+    }
+    entry = &index->slots[i];
+    if (!entry->deleted) {
+      index->used++;
+    }
+    entry->path = path_copy;
+    entry->hash = hash;
+    entry->deleted = 0;
+    entry->has_content = 0;
+    index->count++;
+  }
+
+  entry->ino = st->st_ino;
+  entry->size = st->st_size;
+  entry->mtime_ns = mtime_of(st);
+  entry->is_dir = S_ISDIR(st->st_mode);
+  entry->generation = index->generation;
+  index->changes++;
+  return entry;
+}
+
+int metaindex_remove(meta_index *index, const char *path) {
+  meta_entry *entry = metaindex_lookup(index, path);
+  if (!entry) {
+    return -1;
+  }
+  free(entry->path);
+  entry->path = NULL;
+  entry->deleted = 1;
+  index->count--;
+  index->changes++;
+  return 0;
+}
+
+// Nonzero when st describes a different file, or the same file rewritten
+int metaindex_changed(const meta_entry *entry, const struct stat *st) {
+  return entry->ino != (uint64_t)st->st_ino ||
+         entry->size != (uint64_t)st->st_size ||
+         entry->mtime_ns != mtime_of(st);
+}
+
+meta_entry *metaindex_next(const meta_index *index, size_t *iter) {
+  while (*iter < index->capacity) {
+    meta_entry *entry = &index->slots[(*iter)++];
+    if (entry->path) {
+      return entry;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include "metastore.h"
+#include "sqwatch.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Load a saved index into an empty meta_index. Returns the number of
+// entries, or -1 when there is no usable file (a cold start).
+int metastore_load(const char *file, meta_index *index) {
+  int fd = open(file, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno != ENOENT) {
+      fprintf(stderr, RED "+ Failed to open index %s: %s\n" RESET, file,
+              strerror(errno));
+    }
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(metastore_header)) {
+    close(fd);
+    return -1;
+  }
+  const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  metastore_header header;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, METASTORE_MAGIC, sizeof(METASTORE_MAGIC)) != 0 ||
+      header.version != METASTORE_VERSION ||
+      header.record_size != sizeof(metastore_record)) {
+    fprintf(stderr, RED "+ %s is not a sqwatch index, ignoring it\n" RESET,
+            file);
+    munmap((void *)data, st.st_size);
+    return -1;
+  }
+
+  size_t off = sizeof(header);
+  size_t end = (size_t)st.st_size;
+  uint64_t loaded = 0;
+  char path[PATH_MAX];
+  while (loaded < header.count && off + sizeof(metastore_record) <= end) {
+    metastore_record rec;
+    memcpy(&rec, data + off, sizeof(rec));
+    off += sizeof(rec);
+    if (rec.path_len == 0 || rec.path_len >= sizeof(path) ||
+        off + rec.path_len > end) {
+      break;
+    }
+    memcpy(path, data + off, rec.path_len);
+    path[rec.path_len] = '\0';
+    off += rec.path_len;
+
+    struct stat saved;
+    memset(&saved, 0, sizeof(saved));
+    saved.st_ino = rec.ino;
+    saved.st_size = rec.size;
+    saved.st_mode = rec.is_dir ? S_IFDIR : S_IFREG;
+    meta_entry *entry = metaindex_update(index, path, &saved);
+    if (!entry) {
+      break;
+    }
+    // Kept as saved: a pre-1970 mtime has no valid timespec to go through
+    entry->mtime_ns = rec.mtime_ns;
+    entry->content_hash = rec.content_hash;
+    entry->content_size = rec.content_size;
+    entry->has_content = rec.has_content;
+    loaded++;
+  }
+  munmap((void *)data, st.st_size);
+
+  // Saves are atomic, so a short file was damaged afterwards; keep what
+  // was readable and treat the rest as new
+  if (loaded < header.count) {
+    fprintf(stderr, RED "+ Index %s is truncated, loaded %llu of %llu "
+                        "entries\n" RESET,
+            file, (unsigned long long)loaded,
+            (unsigned long long)header.count);
+  }
+  return (int)loaded;
+}
+
+// Write the index, with each path's snapshot digest, to a temporary file
+// and rename it over file so a crash never leaves a torn index
+int metastore_save(const char *file, const meta_index *index,
+                   snapshot_store *snapshots) {
+  char tmp_path[PATH_MAX];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", file);
+  FILE *out = fopen(tmp_path, "we");
+  if (!out) {
+    fprintf(stderr, RED "+ Failed to write index %s: %s\n" RESET, tmp_path,
+            strerror(errno));
+    return -1;
+  }
+
+  metastore_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, METASTORE_MAGIC, sizeof(METASTORE_MAGIC));
+  header.version = METASTORE_VERSION;
+  header.record_size = sizeof(metastore_record);
+  header.count = index->count;
+  fwrite(&header, sizeof(header), 1, out);
+
+  size_t iter = 0;
+  meta_entry *entry;
+  while ((entry = metaindex_next(index, &iter)) != NULL) {
+    metastore_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.ino = entry->ino;
+    rec.size = entry->size;
+    rec.mtime_ns = entry->mtime_ns;
+    rec.path_len = (uint32_t)strlen(entry->path);
+    rec.is_dir = entry->is_dir;
+    snapshot_digest digest;
+    if (!entry->is_dir && snapshots &&
+        snapshot_lookup(snapshots, entry->path, &digest)) {
+      rec.content_hash = digest.hash;
+      rec.content_size = digest.size;
+      rec.has_content = 1;
+    }
+    fwrite(&rec, sizeof(rec), 1, out);
+    fwrite(entry->path, 1, rec.path_len, out);
+  }
+
+  int failed = fflush(out) != 0 || fsync(fileno(out)) != 0;
+  failed |= fclose(out) != 0;
+  if (failed || rename(tmp_path, file) != 0) {
+    fprintf(stderr, RED "+ Failed to write index %s: %s\n" RESET, file,
+            strerror(errno));
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include "pathmatch.h"
+#include "hash.h"
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_SEGMENTS 256
+#define MAX_ACTIVE 64
+#define GITIGNORE_MAX_SIZE (1024 * 1024)
+
+static match_node *node_new(const char *segment, size_t len) {
+  match_node *node = calloc(1, sizeof(match_node));
+  if (!node) {
+    return NULL;
+  }
+  node->segment = strndup(segment, len);
+  if (!node->segment) {
+    free(node);
+    return NULL;
+  }
+  return node;
+}
+
+static uint64_t edge_hash(const match_node *parent, const char *segment,
+                          size_t len) {
+  return hash_mix(hash_bytes(segment, len) ^ (uintptr_t)parent,
+                  0x9e3779b97f4a7c15ULL);
+}
+
+static match_node *edge_find(const match_trie *t, const match_node *parent,
+                             const char *segment, size_t len) {
+  if (t->edge_count == 0) {
+    return NULL;
+  }
+  uint64_t hash = edge_hash(parent, segment, len);
+  size_t mask = t->edge_capacity - 1;
+  for (size_t i = hash & mask; t->edges[i].child; i = (i + 1) & mask) {
+    match_edge *e = &t->edges[i];
+    if (e->hash == hash && e->parent == parent &&
+        strncmp(e->child->segment, segment, len) == 0 &&
+        e->child->segment[len] == '\0') {
+      return e->child;
+    }
+  }
+  return NULL;
+}
+
+static int edge_grow(match_trie *t) {
+  size_t capacity = t->edge_capacity ? t->edge_capacity * 2 : 64;
+  match_edge *edges = calloc(capacity, sizeof(match_edge));
+  if (!edges) {
+    return -1;
+  }
+  for (size_t i = 0; i < t->edge_capacity; i++) {
+    if (!t->edges[i].child) {
+      continue;
+    }
+    size_t j = t->edges[i].hash & (capacity - 1);
+    while (edges[j].child) {
+      j = (j + 1) & (capacity - 1);
+    }
+    edges[j] = t->edges[i];
+  }
+  free(t->edges);
+  t->edges = edges;
+  t->edge_capacity = capacity;
+  return 0;
+}
+
+static int is_glob(const char *segment, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    if (segment[i] == '*' || segment[i] == '?' || segment[i] == '[' ||
+        segment[i] == '\\') {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Follow or create the edge for one pattern segment
+static match_node *child_for(match_trie *t, match_node *parent,
+                             const char *segment, size_t len) {
+  if (len == 2 && segment[0] == '*' && segment[1] == '*') {
+    if (!parent->any) {
+      parent->any = node_new(segment, len);
+      if (parent->any) {
+        parent->any->self_loop = 1;
+      }
+    }
+    return parent->any;
+  }
+
+  if (is_glob(segment, len)) {
+    for (size_t i = 0; i < parent->glob_count; i++) {
+      if (strncmp(parent->globs[i]->segment, segment, len) == 0 &&
+          parent->globs[i]->segment[len] == '\0') {
+        return parent->globs[i];
+      }
+    }
+    match_node **globs = realloc(parent->globs,
+                                 (parent->glob_count + 1) * sizeof(match_node *));
+    if (!globs) {
+      return NULL;
+    }
+    parent->globs = globs;
+    match_node *node = node_new(segment, len);
+    if (node) {
+      parent->globs[parent->glob_count++] = node;
+    }
+    return node;
+  }
+
+  match_node *node = edge_find(t, parent, segment, len);
+  if (node) {
+    return node;
+  }
+  if ((t->edge_count + 1) * 4 > t->edge_capacity * 3 && edge_grow(t) != 0) {
+    return NULL;
+  }
+  node = node_new(segment, len);
+  if (!node) {
+    return NULL;
+  }
+  uint64_t hash = edge_hash(parent, segment, len);
+  size_t mask = t->edge_capacity - 1;
+  size_t i = hash & mask;
+  while (t->edges[i].child) {
+    i = (i + 1) & mask;
+  }
+  t->edges[i].hash = hash;
+  t->edges[i].parent = parent;
+  t->edges[i].child = node;
+  t->edge_count++;
+  return node;
+}
+
+static void node_free(match_node *node) {
+  if (!node) {
+    return;
+  }
+  for (size_t i = 0; i < node->glob_count; i++) {
+    node_free(node->globs[i]);
+  }
+  free(node->globs);
+  node_free(node->any);
+  free(node->segment);
+  free(node);
+}
+
+static void trie_free(match_trie *t) {
+  // Literal children are owned by the edge table, everything else by the
+  // node that points at it
+  for (size_t i = 0; i < t->edge_capacity; i++) {
+    if (t->edges[i].child) {
+      node_free(t->edges[i].child);
+    }
+  }
+  free(t->edges);
+  node_free(t->root);
+  memset(t, 0, sizeof(*t));
+}
+
+// Append the non-empty '/'-separated segments of text to the trie path
+static match_node *add_segments(match_trie *t, match_node *node,
+                                const char *text, size_t len) {
+  size_t i = 0;
+  while (node && i < len) {
+    while (i < len && text[i] == '/') {
+      i++;
+    }
+    size_t start = i;
+    while (i < len && text[i] != '/') {
+      i++;
+    }
+    if (i > start) {
+      node = child_for(t, node, text + start, i - start);
+    }
+  }
+  return node;
+}
+
+// Compile one .gitignore-style line relative to base:
+//   "name"  matches at any depth    "a/b" or "/a"  anchored to base
+//   "dir/"  directories only        "!pat"         re-includes
+static int add_rule(match_trie *t, const char *base, const char *line,
+                    size_t len) {
+  while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' ||
+                     line[len - 1] == '\r')) {
+    if (len > 1 && line[len - 2] == '\\') {
+      break;
+    }
+    len--;
+  }
+  if (len == 0 || line[0] == '#') {
+    return 0;
+  }
+
+  int negate = 0;
+  if (line[0] == '!') {
+    negate = 1;
+    line++;
+    len--;
+  } else if (line[0] == '\\' && len > 1 && (line[1] == '#' || line[1] == '!')) {
+    line++;
+    len--;
+  }
+
+  int dir_only = 0;
+  while (len > 0 && line[len - 1] == '/') {
+    dir_only = 1;
+    len--;
+  }
+  if (len == 0) {
+    return 0;
+  }
+
+  int anchored = memchr(line, '/', len) != NULL;
+  match_node *node = add_segments(t, t->root, base, strlen(base));
+  if (node && !anchored) {
+    node = child_for(t, node, "**", 2);
+  }
+  node = add_segments(t, node, line, len);
+  // "a/**" matches what is inside a, not a itself
+  if (node && node->self_loop) {
+    node = child_for(t, node, "*", 1);
+  }
+  if (!node) {
+    return -1;
+  }
+
+  uint32_t order = ++t->rules;
+  node->dir_rule = order;
+  node->dir_negate = negate;
+  if (!dir_only) {
+    node->file_rule = order;
+    node->file_negate = negate;
+  }
+  return 0;
+}
+
+static int trie_init(match_trie *t) {
+  memset(t, 0, sizeof(*t));
+  t->root = node_new("", 0);
+  return t->root ? 0 : -1;
+}
+
+int pathmatch_init(path_matcher *m, int gitignore) {
+  memset(m, 0, sizeof(*m));
+  pthread_rwlock_init(&m->lock, NULL);
+  if (trie_init(&m->exclude) != 0 || trie_init(&m->include) != 0) {
+    pathmatch_free(m);
+    return -1;
+  }
+  m->gitignore = gitignore;
+  return 0;
+}
+
+void pathmatch_free(path_matcher *m) {
+  trie_free(&m->exclude);
+  trie_free(&m->include);
+  pthread_rwlock_destroy(&m->lock);
+}
+
+// Add an --include or --exclude pattern relative to base (a watch root)
+int pathmatch_add(path_matcher *m, const char *base, const char *pattern,
+                  int include) {
+  pthread_rwlock_wrlock(&m->lock);
+  int ret = add_rule(include ? &m->include : &m->exclude, base, pattern,
+                     strlen(pattern));
+  if (ret == 0) {
+    m->has_rules = 1;
+    m->has_includes |= include;
+  }
+  pthread_rwlock_unlock(&m->lock);
+  return ret;
+}
+
+// Read dir/.gitignore through an open dirfd and add its rules, anchored at
+// dir. Returns the number of rules added.
+int pathmatch_load_gitignore(path_matcher *m, int dir_fd, const char *dir) {
+  int fd = openat(dir_fd, ".gitignore", O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return 0;
+  }
+  char *text = malloc(GITIGNORE_MAX_SIZE);
+  if (!text) {
+    close(fd);
+    return 0;
+  }
+  size_t len = 0;
+  ssize_t n;
+  while (len < GITIGNORE_MAX_SIZE &&
+         (n = read(fd, text + len, GITIGNORE_MAX_SIZE - len)) > 0) {
+    len += (size_t)n;
+  }
+  close(fd);
+
+  int added = 0;
+  pthread_rwlock_wrlock(&m->lock);
+  uint32_t before = m->exclude.rules;
+  for (size_t start = 0; start < len;) {
+    const char *nl = memchr(text + start, '\n', len - start);
+    size_t end = nl ? (size_t)(nl - text) : len;
+    add_rule(&m->exclude, dir, text + start, end - start);
+    start = end + 1;
+  }
+  added = (int)(m->exclude.rules - before);
+  if (added > 0) {
+    m->has_rules = 1;
+  }
+  pthread_rwlock_unlock(&m->lock);
+  free(text);
+  return added;
+}
+
+static int add_active(match_node **set, int count, match_node *node) {
+  if (!node || count == MAX_ACTIVE) {
+    return count;
+  }
+  for (int i = 0; i < count; i++) {
+    if (set[i] == node) {
+      return count;
+    }
+  }
+  set[count++] = node;
+  // "**" also matches zero segments
+  return add_active(set, count, node->any);
+}
+
+// Run path through the trie as an NFA, one segment at a time. Stops at the
+// first prefix whose winning rule is not a negation and returns its depth
+// (1-based), or 0 when nothing matched. A match on a directory prefix
+// covers everything below it.
+static int trie_match(const match_trie *t, const char *path, int is_dir) {
+  match_node *active[MAX_ACTIVE], *next[MAX_ACTIVE];
+  int count = add_active(active, 0, t->root);
+  int depth = 0;
+
+  const char *p = path;
+  while (*p && count > 0) {
+    while (*p == '/') {
+      p++;
+    }
+    const char *start = p;
+    while (*p && *p != '/') {
+      p++;
+    }
+    size_t len = (size_t)(p - start);
+    if (len == 0) {
+      break;
+    }
+    if (++depth > MAX_SEGMENTS) {
+      return 0;
+    }
+
+    char segment[NAME_MAX + 1];
+    if (len > NAME_MAX) {
+      return 0;
+    }
+    memcpy(segment, start, len);
+    segment[len] = '\0';
+
+    int next_count = 0;
+    for (int i = 0; i < count; i++) {
+      match_node *node = active[i];
+      if (node->self_loop) {
+        next_count = add_active(next, next_count, node);
+      }
+      next_count = add_active(next, next_count,
+                              edge_find(t, node, segment, len));
+      for (size_t g = 0; g < node->glob_count; g++) {
+        if (fnmatch(node->globs[g]->segment, segment, 0) == 0) {
+          next_count = add_active(next, next_count, node->globs[g]);
+        }
+      }
+    }
+
+    while (*p == '/') {
+      p++;
+    }
+    int as_file = *p == '\0' && !is_dir;
+    uint32_t best = 0;
+    int negate = 0;
+    for (int i = 0; i < next_count; i++) {
+      uint32_t rule = as_file ? next[i]->file_rule : next[i]->dir_rule;
+      if (rule > best) {
+        best = rule;
+        negate = as_file ? next[i]->file_negate : next[i]->dir_negate;
+      }
+    }
+    if (best && !negate) {
+      return depth;
+    }
+
+    memcpy(active, next, next_count * sizeof(match_node *));
+    count = next_count;
+  }
+  return 0;
+}
+
+// Whether path should be left unwatched and unreported. Directories are
+// only tested against the exclude rules, so --include never stops the
+// walk from reaching the files it selects.
+int pathmatch_excluded(path_matcher *m, const char *path, int is_dir) {
+  if (!m->has_rules) {
+    return 0;
+  }
+  pthread_rwlock_rdlock(&m->lock);
+  int excluded = trie_match(&m->exclude, path, is_dir) != 0;
+  if (!excluded && !is_dir && m->has_includes) {
+    excluded = trie_match(&m->include, path, 0) == 0;
+  }
+  pthread_rwlock_unlock(&m->lock);
+  return excluded;
+}
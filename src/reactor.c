@@ -0,0 +1,136 @@
+#include "reactor.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define MAX_REACTOR_EVENTS 64
+
+int reactor_init(reactor *r) {
+  memset(r, 0, sizeof(*r));
+  r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (r->epoll_fd == -1) {
+    perror("epoll_create1");
+    return -1;
+  }
+  return 0;
+}
+
+int reactor_add(reactor *r, int fd, uint32_t events, reactor_cb cb,
+                void *data) {
+  reactor_handler *handler = malloc(sizeof(reactor_handler));
+  if (!handler) {
+    return -1;
+  }
+  handler->fd = fd;
+  handler->cb = cb;
+  handler->data = data;
+
+  struct epoll_event ev = {.events = events, .data.ptr = handler};
+  if (epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    perror("epoll_ctl");
+    free(handler);
+    return -1;
+  }
+  handler->next = r->handlers;
+  r->handlers = handler;
+  return 0;
+}
+
+int reactor_remove(reactor *r, int fd) {
+  reactor_handler **link = &r->handlers;
+  while (*link && (*link)->fd != fd) {
+    link = &(*link)->next;
+  }
+  if (!*link) {
+    return -1;
+  }
+
+  reactor_handler *handler = *link;
+  *link = handler->next;
+  epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+  // Events for this fd may still be pending in the current batch
+  handler->fd = -1;
+  handler->next = r->retired;
+  r->retired = handler;
+  return 0;
+}
+
+static void free_retired(reactor *r) {
+  while (r->retired) {
+    reactor_handler *next = r->retired->next;
+    free(r->retired);
+    r->retired = next;
+  }
+}
+
+int reactor_run(reactor *r) {
+  struct epoll_event events[MAX_REACTOR_EVENTS];
+  r->running = 1;
+
+  while (r->running) {
+    int n = epoll_wait(r->epoll_fd, events, MAX_REACTOR_EVENTS, -1);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("epoll_wait");
+      return -1;
+    }
+
+    for (int i = 0; i < n && r->running; i++) {
+      reactor_handler *handler = events[i].data.ptr;
+      if (handler->fd != -1) {
+        handler->cb(handler->fd, events[i].events, handler->data);
+      }
+    }
+    free_retired(r);
+  }
+  return r->exit_code;
+}
+
+void reactor_stop(reactor *r, int exit_code) {
+  r->running = 0;
+  r->exit_code = exit_code;
+}
+
+void reactor_close(reactor *r) {
+  while (r->handlers) {
+    reactor_handler *next = r->handlers->next;
+    free(r->handlers);
+    r->handlers = next;
+  }
+  free_retired(r);
+  if (r->epoll_fd >= 0) {
+    close(r->epoll_fd);
+    r->epoll_fd = -1;
+  }
+}
+
+int reactor_timer_create(void) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd == -1) {
+    perror("timerfd_create");
+  }
+  return fd;
+}
+
+int reactor_timer_arm(int timer_fd, uint64_t delay_ns) {
+  // A zero it_value would disarm the timer; fire as soon as possible instead
+  if (delay_ns == 0) {
+    delay_ns = 1;
+  }
+  struct itimerspec spec = {0};
+  spec.it_value.tv_sec = delay_ns / 1000000000ULL;
+  spec.it_value.tv_nsec = delay_ns % 1000000000ULL;
+  return timerfd_settime(timer_fd, 0, &spec, NULL);
+}
+
+int reactor_timer_disarm(int timer_fd) {
+  struct itimerspec spec = {0};
+  return timerfd_settime(timer_fd, 0, &spec, NULL);
+}
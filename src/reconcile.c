@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+#include "reconcile.h"
+#include "cache.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// After the kernel drops events (IN_Q_OVERFLOW) nothing tells us what was
+// lost. Walk the roots again and compare inode, size and mtime against the
+// metadata index: new paths become creates, changed ones modifies, and
+// anything the walk didn't reach is a delete. Watches are only touched
+// where the tree differs from the registry.
+
+// Kernel default for fs.inotify.max_queued_events
+#define DEFAULT_QUEUED_EVENTS 16384
+
+typedef struct {
+  int inotify_fd; // -1 under fanotify
+  sqwatch_config *config;
+  reconcile_emit_fn emit;
+  reconcile_stats stats;
+} reconcile_ctx;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Only report what the user asked to watch
+static void emit(reconcile_ctx *ctx, const char *path, uint32_t mask) {
+  if (ctx->config->flags & mask) {
+    ctx->emit(path, mask);
+  }
+}
+
+// Make sure path is watched. A replaced inode needs a fresh watch even if
+// the registry still has one under the old wd.
+static void ensure_watch(reconcile_ctx *ctx, const char *path, int is_dir,
+                         int replaced) {
+  if (ctx->inotify_fd < 0) {
+    return;
+  }
+  watch_registry *registry = &ctx->config->registry;
+  watch_entry *watch = registry_lookup_path(registry, path);
+  if (watch && !replaced) {
+    return;
+  }
+  int old_wd = watch ? watch->wd : -1;
+
+  uint32_t mask = is_dir ? ctx->config->flags | IN_CREATE : ctx->config->flags;
+  int wd = inotify_add_watch(ctx->inotify_fd, path, mask);
+  if (wd == -1) {
+    return;
+  }
+  if (old_wd != -1 && old_wd != wd) {
+    registry_remove(registry, old_wd);
+  }
+  if (registry_add(registry, wd, path, is_dir) && wd != old_wd) {
+    ctx->stats.watches++;
+  }
+}
+
+static void visit_file(reconcile_ctx *ctx, const char *path,
+                       const struct stat *st) {
+  sqwatch_config *config = ctx->config;
+  meta_entry *entry = metaindex_lookup(&config->meta, path);
+  int replaced = 0;
+  if (!entry) {
+    if (config->diff_enabled && cache_dir) {
+      create_cache_for_file(&config->snapshots, path, config->verbose);
+    }
+    ctx->stats.created++;
+    emit(ctx, path, IN_CREATE);
+  } else if (metaindex_changed(entry, st)) {
+    replaced = entry->ino != (uint64_t)st->st_ino;
+    ctx->stats.modified++;
+    emit(ctx, path, IN_MODIFY);
+  }
+  ensure_watch(ctx, path, 0, replaced);
+  metaindex_update(&config->meta, path, st);
+}
+
+static void walk_dir(reconcile_ctx *ctx, const char *path,
+                     const struct stat *st) {
+  meta_entry *entry = metaindex_lookup(&ctx->config->meta, path);
+  ensure_watch(ctx, path, 1, entry && entry->ino != (uint64_t)st->st_ino);
+  metaindex_update(&ctx->config->meta, path, st);
+
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return;
+  }
+  int fd = dirfd(dir);
+  size_t path_len = strlen(path);
+  path_matcher *filter = &ctx->config->filter;
+  // Picks up .gitignore files added since the scan; rules only accumulate
+  if (filter->gitignore) {
+    pathmatch_load_gitignore(filter, fd, path);
+  }
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL) {
+    const char *name = d->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    struct stat child_st;
+    if (fstatat(fd, name, &child_st, 0) != 0) {
+      continue;
+    }
+    // Same rules as the initial scan: symlinked directories are skipped
+    int is_dir = S_ISDIR(child_st.st_mode) && d->d_type != DT_LNK;
+    if (!is_dir && !S_ISREG(child_st.st_mode)) {
+      continue;
+    }
+
+    char *child = malloc(path_len + strlen(name) + 2);
+    if (!child) {
+      continue;
+    }
+    sprintf(child, "%s/%s", path, name);
+    if (pathmatch_excluded(filter, child, is_dir)) {
+      free(child);
+      continue;
+    }
+    if (is_dir) {
+      walk_dir(ctx, child, &child_st);
+    } else {
+      visit_file(ctx, child, &child_st);
+    }
+    free(child);
+  }
+  closedir(dir);
+}
+
+// Everything not stamped by this pass has vanished
+static void sweep_missing(reconcile_ctx *ctx) {
+  sqwatch_config *config = ctx->config;
+  size_t iter = 0;
+  meta_entry *entry;
+  while ((entry = metaindex_next(&config->meta, &iter)) != NULL) {
+    if (entry->generation == config->meta.generation) {
+      continue;
+    }
+    if (!entry->is_dir) {
+      if (config->diff_enabled && cache_dir) {
+        snapshot_forget(&config->snapshots, entry->path);
+      }
+      ctx->stats.deleted++;
+      emit(ctx, entry->path, IN_DELETE);
+    }
+    watch_entry *watch = registry_lookup_path(&config->registry, entry->path);
+    if (watch) {
+      int wd = watch->wd;
+      inotify_rm_watch(ctx->inotify_fd, wd);
+      registry_remove(&config->registry, wd);
+    }
+    metaindex_remove(&config->meta, entry->path);
+  }
+}
+
+// Bring the watches and the metadata index back in line with the disk,
+// reporting the differences through emit
+void reconcile_tree(int inotify_fd, sqwatch_config *config,
+                    reconcile_emit_fn emit_fn, reconcile_stats *stats) {
+  reconcile_ctx ctx = {inotify_fd, config, emit_fn, {0}};
+  uint64_t start = now_ns();
+  config->meta.generation++;
+
+  for (int i = 0; i < config->root_count; i++) {
+    struct stat st;
+    if (stat(config->roots[i], &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      walk_dir(&ctx, config->roots[i], &st);
+    } else if (S_ISREG(st.st_mode)) {
+      visit_file(&ctx, config->roots[i], &st);
+    }
+  }
+  sweep_missing(&ctx);
+
+  ctx.stats.elapsed_ns = now_ns() - start;
+  if (stats) {
+    *stats = ctx.stats;
+  }
+}
+
+static int under_roots(const sqwatch_config *config, const char *path) {
+  for (int i = 0; i < config->root_count; i++) {
+    size_t len = strlen(config->roots[i]);
+    if (strncmp(path, config->roots[i], len) == 0 &&
+        (path[len] == '\0' || path[len] == '/')) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Compare the index the last run saved with the one the startup scan just
+// built. Only stat data is compared; files are never read. Paths outside
+// the current roots or filtered out are not reported as deleted.
+void reconcile_offline(sqwatch_config *config, const meta_index *saved,
+                       reconcile_emit_fn emit_fn, reconcile_stats *stats) {
+  reconcile_ctx ctx = {-1, config, emit_fn, {0}};
+  uint64_t start = now_ns();
+
+  size_t iter = 0;
+  meta_entry *entry;
+  while ((entry = metaindex_next(&config->meta, &iter)) != NULL) {
+    if (entry->is_dir) {
+      continue;
+    }
+    meta_entry *old = metaindex_lookup(saved, entry->path);
+    if (!old) {
+      ctx.stats.created++;
+      emit(&ctx, entry->path, IN_CREATE);
+    } else if (old->ino != entry->ino || old->size != entry->size ||
+               old->mtime_ns != entry->mtime_ns) {
+      ctx.stats.modified++;
+      emit(&ctx, entry->path, IN_MODIFY);
+    }
+  }
+
+  iter = 0;
+  while ((entry = metaindex_next(saved, &iter)) != NULL) {
+    if (entry->is_dir || metaindex_lookup(&config->meta, entry->path) ||
+        !under_roots(config, entry->path) ||
+        pathmatch_excluded(&config->filter, entry->path, 0)) {
+      continue;
+    }
+    if (config->diff_enabled && cache_dir) {
+      snapshot_forget(&config->snapshots, entry->path);
+    }
+    ctx.stats.deleted++;
+    emit(&ctx, entry->path, IN_DELETE);
+  }
+
+  ctx.stats.elapsed_ns = now_ns() - start;
+  if (stats) {
+    *stats = ctx.stats;
+  }
+}
+
+static long read_limit(const char *proc_path) {
+  FILE *f = fopen(proc_path, "r");
+  if (!f) {
+    return -1;
+  }
+  long value = -1;
+  if (fscanf(f, "%ld", &value) != 1) {
+    value = -1;
+  }
+  fclose(f);
+  return value;
+}
+
+// Warn when the kernel queue is likely to overflow under a burst. Without
+// an explicit --max-queued-events, expect room for two events per watch.
+void reconcile_check_queue_limit(const sqwatch_config *config) {
+  const char *proc_path = config->use_fanotify
+                              ? "/proc/sys/fs/fanotify/max_queued_events"
+                              : "/proc/sys/fs/inotify/max_queued_events";
+  const char *sysctl = config->use_fanotify ? "fs.fanotify.max_queued_events"
+                                            : "fs.inotify.max_queued_events";
+  long limit = read_limit(proc_path);
+  if (limit < 0) {
+    return;
+  }
+
+  long wanted = config->max_queued_events;
+  if (wanted <= 0) {
+    wanted = (long)config->registry.count * 2;
+    if (wanted < DEFAULT_QUEUED_EVENTS) {
+      wanted = DEFAULT_QUEUED_EVENTS;
+    }
+  }
+  if (limit < wanted) {
+    fprintf(stderr, RED "+ %s is %ld, below %ld; bursts may overflow the "
+                        "queue and force a rescan (sysctl -w %s=%ld)\n" RESET,
+            sysctl, limit, wanted, sysctl, wanted);
+  } else if (config->verbose) {
+    printf(DARK_GREY "+ %s: %ld\n" RESET, sysctl, limit);
+  }
+}
@@ -0,0 +1,232 @@
+#include "registry.h"
+#include "hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT_EMPTY -1
+#define SLOT_DELETED -2
+
+static uint64_t hash_wd(int wd) {
+  uint64_t x = (uint64_t)(uint32_t)wd;
+  x ^= x >> 16;
+  x *= 0x7feb352dULL;
+  x ^= x >> 15;
+  x *= 0x846ca68bULL;
+  x ^= x >> 16;
+  return x;
+}
+
+static uint64_t hash_path(const char *path) { return hash_string(path); }
+
+static size_t round_pow2(size_t n) {
+  size_t cap = 16;
+  while (cap < n) {
+    cap <<= 1;
+  }
+  return cap;
+}
+
+static watch_entry *find_slot(const watch_registry *reg, int wd) {
+  size_t mask = reg->capacity - 1;
+  size_t i = hash_wd(wd) & mask;
+  for (;;) {
+    watch_entry *slot = &reg->slots[i];
+    if (slot->wd == wd) {
+      return slot;
+    }
+    if (slot->wd == SLOT_EMPTY) {
+      return NULL;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+static void path_index_insert(watch_registry *reg, uint64_t hash, int wd) {
+  size_t mask = reg->path_capacity - 1;
+  size_t i = hash & mask;
+  while (reg->paths[i].wd >= 0) {
+    i = (i + 1) & mask;
+  }
+  if (reg->paths[i].wd == SLOT_EMPTY) {
+    reg->path_used++;
+  }
+  reg->paths[i].hash = hash;
+  reg->paths[i].wd = wd;
+}
+
+static void path_index_remove(watch_registry *reg, uint64_t hash, int wd) {
+  size_t mask = reg->path_capacity - 1;
+  size_t i = hash & mask;
+  while (reg->paths[i].wd != SLOT_EMPTY) {
+    if (reg->paths[i].wd == wd && reg->paths[i].hash == hash) {
+      reg->paths[i].wd = SLOT_DELETED;
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+static int rehash(watch_registry *reg, size_t capacity) {
+  watch_entry *slots = malloc(capacity * sizeof(watch_entry));
+  path_slot *paths = malloc(capacity * sizeof(path_slot));
+  if (!slots || !paths) {
+    free(slots);
+    free(paths);
+    return -1;
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    slots[i].wd = SLOT_EMPTY;
+    paths[i].wd = SLOT_EMPTY;
+  }
+
+  watch_entry *old = reg->slots;
+  size_t old_capacity = reg->capacity;
+  reg->slots = slots;
+  reg->capacity = capacity;
+  reg->used = reg->count;
+  free(reg->paths);
+  reg->paths = paths;
+  reg->path_capacity = capacity;
+  reg->path_used = 0;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].wd < 0) {
+      continue;
+    }
+    size_t mask = capacity - 1;
+    size_t j = hash_wd(old[i].wd) & mask;
+    while (slots[j].wd != SLOT_EMPTY) {
+      j = (j + 1) & mask;
+    }
+    slots[j] = old[i];
+    path_index_insert(reg, hash_path(old[i].path), old[i].wd);
+  }
+  free(old);
+  return 0;
+}
+
+int registry_init(watch_registry *reg, size_t initial_capacity) {
+  memset(reg, 0, sizeof(*reg));
+  return rehash(reg, round_pow2(initial_capacity));
+}
+
+void registry_free(watch_registry *reg) {
+  for (size_t i = 0; i < reg->capacity; i++) {
+    if (reg->slots[i].wd >= 0) {
+      free(reg->slots[i].path);
+    }
+  }
+  free(reg->slots);
+  free(reg->paths);
+  memset(reg, 0, sizeof(*reg));
+}
+
+watch_entry *registry_lookup(const watch_registry *reg, int wd) {
+  if (wd < 0 || !reg->slots) {
+    return NULL;
+  }
+  return find_slot(reg, wd);
+}
+
+watch_entry *registry_lookup_path(const watch_registry *reg, const char *path) {
+  if (!reg->paths) {
+    return NULL;
+  }
+  uint64_t hash = hash_path(path);
+  size_t mask = reg->path_capacity - 1;
+  size_t i = hash & mask;
+  while (reg->paths[i].wd != SLOT_EMPTY) {
+    if (reg->paths[i].wd >= 0 && reg->paths[i].hash == hash) {
+      watch_entry *entry = find_slot(reg, reg->paths[i].wd);
+      if (entry && strcmp(entry->path, path) == 0) {
+        return entry;
+      }
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+watch_entry *registry_add(watch_registry *reg, int wd, const char *path,
+                          int is_dir) {
+  if (wd < 0 || !path) {
+    return NULL;
+  }
+
+  char *path_copy = strdup(path);
+  if (!path_copy) {
+    return NULL;
+  }
+  uint64_t hash = hash_path(path);
+
+  // inotify hands back the same wd when an inode is watched twice
+  watch_entry *entry = registry_lookup(reg, wd);
+  if (entry) {
+    path_index_remove(reg, hash_path(entry->path), wd);
+    free(entry->path);
+    reg->dir_count -= entry->is_dir ? 1 : 0;
+  } else {
+    if ((reg->used + 1) * 4 > reg->capacity * 3 ||
+        (reg->path_used + 1) * 4 > reg->path_capacity * 3) {
+      size_t capacity = reg->capacity;
+      if ((reg->count + 1) * 2 > capacity) {
+        capacity *= 2;
+      }
+      if (rehash(reg, capacity) != 0) {
+        free(path_copy);
+        return NULL;
+      }
+    }
+    size_t mask = reg->capacity - 1;
+    size_t i = hash_wd(wd) & mask;
+    while (reg->slots[i].wd >= 0) {
+      i = (i + 1) & mask;
+    }
+    entry = &reg->slots[i];
+    if (entry->wd == SLOT_EMPTY) {
+      reg->used++;
+    }
+    entry->wd = wd;
+    reg->count++;
+  }
+
+  // A path replaced on disk (atomic save) may still be watched under its
+  // old wd; the newest watch wins and the old one is dropped outright, so a
+  // later rehash cannot index the path twice. Removal only leaves a
+  // tombstone, so entry stays valid.
+  watch_entry *stale = registry_lookup_path(reg, path);
+  if (stale) {
+    registry_remove(reg, stale->wd);
+  }
+
+  entry->path = path_copy;
+  entry->is_dir = is_dir;
+  reg->dir_count += is_dir ? 1 : 0;
+  path_index_insert(reg, hash, wd);
+  return entry;
+}
+
+int registry_remove(watch_registry *reg, int wd) {
+  watch_entry *entry = registry_lookup(reg, wd);
+  if (!entry) {
+    return -1;
+  }
+  path_index_remove(reg, hash_path(entry->path), wd);
+  reg->dir_count -= entry->is_dir ? 1 : 0;
+  free(entry->path);
+  entry->path = NULL;
+  entry->wd = SLOT_DELETED;
+  reg->count--;
+  return 0;
+}
+
+watch_entry *registry_next(const watch_registry *reg, size_t *iter) {
+  while (*iter < reg->capacity) {
+    watch_entry *slot = &reg->slots[(*iter)++];
+    if (slot->wd >= 0) {
+      return slot;
+    }
+  }
+  return NULL;
+}
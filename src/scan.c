@@ -0,0 +1,496 @@
+#define _GNU_SOURCE
+#include "scan.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCAN_MAX_THREADS 16
+#define DENTS_BUF_SIZE (32 * 1024)
+#define REGISTER_BATCH 256
+#define PROGRESS_INTERVAL_NS 250000000L
+
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+// Per-worker deque of directory paths. The owner pushes and pops at the
+// tail; idle workers steal from the head.
+typedef struct {
+  pthread_mutex_t lock;
+  char **items;
+  size_t head;
+  size_t tail;
+  size_t capacity;
+} scan_deque;
+
+typedef struct {
+  char *path;
+  int wd; // -1 when only indexing
+  int is_dir;
+  struct stat st;
+} scan_watch;
+
+typedef struct scan_ctx scan_ctx;
+
+typedef struct {
+  scan_ctx *ctx;
+  int id;
+  scan_deque deque;
+  scan_watch batch[REGISTER_BATCH];
+  int batch_count;
+  int show_progress; // only the calling thread prints progress
+  uint64_t start_ns;
+  char dents[DENTS_BUF_SIZE] __attribute__((aligned(8)));
+} scan_worker;
+
+struct scan_ctx {
+  int inotify_fd;
+  uint32_t flags;
+  sqwatch_config *config;
+  scan_worker *workers;
+  int thread_count;
+
+  atomic_long outstanding; // directories queued or being read
+  atomic_long queued;      // directories sitting in a deque
+  atomic_int sleepers;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond;
+
+  pthread_mutex_t registry_lock;
+
+  atomic_ullong dirs;
+  atomic_ullong files;
+  atomic_ullong watches;
+  atomic_ullong excluded;
+  atomic_ullong errors;
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int scan_default_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) {
+    return 1;
+  }
+  return n > SCAN_MAX_THREADS ? SCAN_MAX_THREADS : (int)n;
+}
+
+static int deque_push(scan_deque *dq, char *path) {
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail - dq->head == dq->capacity) {
+    size_t capacity = dq->capacity ? dq->capacity * 2 : 64;
+    char **items = malloc(capacity * sizeof(char *));
+    if (!items) {
+      pthread_mutex_unlock(&dq->lock);
+      return -1;
+    }
+    for (size_t i = dq->head; i < dq->tail; i++) {
+      items[i - dq->head] = dq->items[i % dq->capacity];
+    }
+    free(dq->items);
+    dq->items = items;
+    dq->tail -= dq->head;
+    dq->head = 0;
+    dq->capacity = capacity;
+  }
+  dq->items[dq->tail % dq->capacity] = path;
+  dq->tail++;
+  pthread_mutex_unlock(&dq->lock);
+  return 0;
+}
+
+static char *deque_pop(scan_deque *dq) {
+  char *path = NULL;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail > dq->head) {
+    dq->tail--;
+    path = dq->items[dq->tail % dq->capacity];
+  }
+  pthread_mutex_unlock(&dq->lock);
+  return path;
+}
+
+static char *deque_steal(scan_deque *dq) {
+  char *path = NULL;
+  pthread_mutex_lock(&dq->lock);
+  if (dq->tail > dq->head) {
+    path = dq->items[dq->head % dq->capacity];
+    dq->head++;
+  }
+  pthread_mutex_unlock(&dq->lock);
+  return path;
+}
+
+static void push_dir(scan_worker *w, char *path) {
+  scan_ctx *ctx = w->ctx;
+  atomic_fetch_add(&ctx->outstanding, 1);
+  if (deque_push(&w->deque, path) != 0) {
+    fprintf(stderr, RED "+ Failed to queue %s for scanning\n" RESET, path);
+    free(path);
+    atomic_fetch_add(&ctx->errors, 1);
+    atomic_fetch_sub(&ctx->outstanding, 1);
+    return;
+  }
+  atomic_fetch_add(&ctx->queued, 1);
+  if (atomic_load(&ctx->sleepers) > 0) {
+    pthread_mutex_lock(&ctx->idle_lock);
+    pthread_cond_signal(&ctx->idle_cond);
+    pthread_mutex_unlock(&ctx->idle_lock);
+  }
+}
+
+static char *next_dir(scan_worker *w) {
+  scan_ctx *ctx = w->ctx;
+  char *path = deque_pop(&w->deque);
+  for (int i = 1; !path && i < ctx->thread_count; i++) {
+    path = deque_steal(&ctx->workers[(w->id + i) % ctx->thread_count].deque);
+  }
+  if (path) {
+    atomic_fetch_sub(&ctx->queued, 1);
+  }
+  return path;
+}
+
+// Register the batched watches under a single registry lock
+static void flush_watches(scan_worker *w) {
+  scan_ctx *ctx = w->ctx;
+  if (w->batch_count == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&ctx->registry_lock);
+  for (int i = 0; i < w->batch_count; i++) {
+    scan_watch *sw = &w->batch[i];
+    metaindex_update(&ctx->config->meta, sw->path, &sw->st);
+    if (sw->wd != -1 && registry_add(&ctx->config->registry, sw->wd, sw->path, sw->is_dir)) {
+      atomic_fetch_add(&ctx->watches, 1);
+      if (!sw->is_dir) {
+        ctx->config->path_count++;
+      }
+      if (ctx->config->verbose) {
+        printf(CYAN "+ Watch set for %s %s\n" RESET,
+               sw->is_dir ? "directory" : "file", sw->path);
+      }
+    }
+    free(sw->path);
+  }
+  pthread_mutex_unlock(&ctx->registry_lock);
+  w->batch_count = 0;
+}
+
+// Watch a path and record its metadata. Without an inotify fd (fanotify
+// mode) only the metadata is recorded.
+static void add_scan_watch(scan_worker *w, const char *path, int is_dir,
+                           const struct stat *st) {
+  scan_ctx *ctx = w->ctx;
+  uint32_t mask = is_dir ? ctx->flags | IN_CREATE : ctx->flags;
+  int wd = -1;
+  if (ctx->inotify_fd >= 0) {
+    wd = inotify_add_watch(ctx->inotify_fd, path, mask);
+    if (wd == -1) {
+      atomic_fetch_add(&ctx->errors, 1);
+      if (errno == ENOSPC) {
+        fprintf(stderr, RED "+ Out of inotify watches at %s "
+                            "(raise fs.inotify.max_user_watches)\n" RESET,
+                path);
+      }
+      return;
+    }
+  }
+
+  char *path_copy = strdup(path);
+  if (!path_copy) {
+    return;
+  }
+  w->batch[w->batch_count].path = path_copy;
+  w->batch[w->batch_count].wd = wd;
+  w->batch[w->batch_count].is_dir = is_dir;
+  w->batch[w->batch_count].st = *st;
+  if (++w->batch_count == REGISTER_BATCH) {
+    flush_watches(w);
+  }
+}
+
+static char *join_path(const char *dir, size_t dir_len, const char *name) {
+  size_t name_len = strlen(name);
+  char *path = malloc(dir_len + name_len + 2);
+  if (!path) {
+    return NULL;
+  }
+  memcpy(path, dir, dir_len);
+  path[dir_len] = '/';
+  memcpy(path + dir_len + 1, name, name_len + 1);
+  return path;
+}
+
+// Watch one directory and queue its subdirectories. d_type classifies
+// entries, so only DT_UNKNOWN/DT_LNK ones are stat'ed before filtering;
+// files that pass the filter are then stat'ed on the open dirfd for the
+// metadata index, and special files never are.
+static void scan_dir(scan_worker *w, const char *path) {
+  scan_ctx *ctx = w->ctx;
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, RED "+ Failed to open directory %s: %s\n" RESET, path,
+            strerror(errno));
+    atomic_fetch_add(&ctx->errors, 1);
+    return;
+  }
+
+  struct stat dir_st;
+  if (fstat(fd, &dir_st) != 0) {
+    atomic_fetch_add(&ctx->errors, 1);
+    close(fd);
+    return;
+  }
+  add_scan_watch(w, path, 1, &dir_st);
+  atomic_fetch_add(&ctx->dirs, 1);
+  size_t path_len = strlen(path);
+  path_matcher *filter = &ctx->config->filter;
+  // Rules must be in place before this directory's entries are filtered
+  if (filter->gitignore) {
+    pathmatch_load_gitignore(filter, fd, path);
+  }
+
+  for (;;) {
+    long n = syscall(SYS_getdents64, fd, w->dents, sizeof(w->dents));
+    if (n <= 0) {
+      if (n < 0) {
+        atomic_fetch_add(&ctx->errors, 1);
+      }
+      break;
+    }
+
+    for (long off = 0; off < n;) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(w->dents + off);
+      off += d->d_reclen;
+
+      const char *name = d->d_name;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+
+      unsigned char type = d->d_type;
+      struct stat st;
+      if (type == DT_UNKNOWN || type == DT_LNK) {
+        if (fstatat(fd, name, &st, 0) != 0) {
+          continue;
+        }
+        // Symlinked directories are not descended into (no cycles)
+        if (S_ISREG(st.st_mode)) {
+          type = DT_REG;
+        } else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) {
+          type = DT_DIR;
+        } else {
+          continue;
+        }
+      } else if (type != DT_DIR && type != DT_REG) {
+        continue;
+      }
+
+      char *child = join_path(path, path_len, name);
+      if (!child) {
+        atomic_fetch_add(&ctx->errors, 1);
+        continue;
+      }
+      // Excluded directories are pruned with everything below them
+      if (pathmatch_excluded(filter, child, type == DT_DIR)) {
+        atomic_fetch_add(&ctx->excluded, 1);
+        free(child);
+        continue;
+      }
+      if (type == DT_DIR) {
+        push_dir(w, child);
+        continue;
+      }
+      // Kept files are stat'ed once, for the metadata index
+      if (d->d_type == DT_REG &&
+          (fstatat(fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) {
+        free(child);
+        continue;
+      }
+      add_scan_watch(w, child, 0, &st);
+      atomic_fetch_add(&ctx->files, 1);
+      free(child);
+    }
+  }
+  close(fd);
+}
+
+static void report_progress(scan_ctx *ctx, uint64_t start) {
+  fprintf(stderr, DARK_GREY "\r+ Scanning: %llu dirs, %llu files, %.1fs" RESET,
+          (unsigned long long)atomic_load(&ctx->dirs),
+          (unsigned long long)atomic_load(&ctx->files),
+          (now_ns() - start) / 1e9);
+  fflush(stderr);
+}
+
+static void *scan_worker_main(void *arg) {
+  scan_worker *w = arg;
+  scan_ctx *ctx = w->ctx;
+  uint64_t last_report = w->start_ns;
+
+  for (;;) {
+    char *path = next_dir(w);
+    if (path) {
+      scan_dir(w, path);
+      free(path);
+      if (atomic_fetch_sub(&ctx->outstanding, 1) == 1) {
+        // Last directory done: wake everyone so they can exit
+        pthread_mutex_lock(&ctx->idle_lock);
+        pthread_cond_broadcast(&ctx->idle_cond);
+        pthread_mutex_unlock(&ctx->idle_lock);
+      }
+    } else if (atomic_load(&ctx->outstanding) == 0) {
+      break;
+    } else {
+      // Nothing to steal yet; wait for a push or for the scan to finish
+      pthread_mutex_lock(&ctx->idle_lock);
+      atomic_fetch_add(&ctx->sleepers, 1);
+      while (atomic_load(&ctx->queued) == 0 &&
+             atomic_load(&ctx->outstanding) > 0) {
+        if (!w->show_progress) {
+          pthread_cond_wait(&ctx->idle_cond, &ctx->idle_lock);
+          continue;
+        }
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += PROGRESS_INTERVAL_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&ctx->idle_cond, &ctx->idle_lock, &deadline);
+        break;
+      }
+      atomic_fetch_sub(&ctx->sleepers, 1);
+      pthread_mutex_unlock(&ctx->idle_lock);
+    }
+
+    if (w->show_progress && now_ns() - last_report >= PROGRESS_INTERVAL_NS) {
+      report_progress(ctx, w->start_ns);
+      last_report = now_ns();
+    }
+  }
+
+  flush_watches(w);
+  return NULL;
+}
+
+void scan_tree(int inotify_fd, const char *root, uint32_t flags,
+               sqwatch_config *config, int threads, int report,
+               scan_stats *stats) {
+  uint64_t start = now_ns();
+  scan_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.inotify_fd = inotify_fd;
+  ctx.flags = flags;
+  ctx.config = config;
+  ctx.thread_count = threads < 1 ? 1 : threads;
+  pthread_mutex_init(&ctx.idle_lock, NULL);
+  pthread_cond_init(&ctx.idle_cond, NULL);
+  pthread_mutex_init(&ctx.registry_lock, NULL);
+
+  ctx.workers = calloc(ctx.thread_count, sizeof(scan_worker));
+  if (!ctx.workers) {
+    fprintf(stderr, RED "+ Failed to allocate scan workers\n" RESET);
+    return;
+  }
+  for (int i = 0; i < ctx.thread_count; i++) {
+    ctx.workers[i].ctx = &ctx;
+    ctx.workers[i].id = i;
+    ctx.workers[i].start_ns = start;
+    pthread_mutex_init(&ctx.workers[i].deque.lock, NULL);
+  }
+
+  struct stat path_stat;
+  if (stat(root, &path_stat) == -1) {
+    fprintf(stderr, RED "+ Failed to stat %s: %s\n" RESET, root,
+            strerror(errno));
+    ctx.errors++;
+  } else if (S_ISREG(path_stat.st_mode)) {
+    add_scan_watch(&ctx.workers[0], root, 0, &path_stat);
+    ctx.files++;
+    flush_watches(&ctx.workers[0]);
+  } else if (S_ISDIR(path_stat.st_mode)) {
+    char *root_copy = strdup(root);
+    if (root_copy) {
+      push_dir(&ctx.workers[0], root_copy);
+    }
+
+    // The calling thread works too, and reports progress if stderr is
+    // a terminal
+    pthread_t *tids = calloc(ctx.thread_count, sizeof(pthread_t));
+    int *started = calloc(ctx.thread_count, sizeof(int));
+    for (int i = 1; tids && started && i < ctx.thread_count; i++) {
+      started[i] = pthread_create(&tids[i], NULL, scan_worker_main,
+                                  &ctx.workers[i]) == 0;
+    }
+    ctx.workers[0].show_progress = report && isatty(STDERR_FILENO);
+    scan_worker_main(&ctx.workers[0]);
+    for (int i = 1; tids && started && i < ctx.thread_count; i++) {
+      if (started[i]) {
+        pthread_join(tids[i], NULL);
+      }
+    }
+    free(tids);
+    free(started);
+    if (ctx.workers[0].show_progress) {
+      fprintf(stderr, "\r\033[K");
+    }
+  }
+
+  scan_stats result = {
+      .dirs = atomic_load(&ctx.dirs),
+      .files = atomic_load(&ctx.files),
+      .watches = atomic_load(&ctx.watches),
+      .excluded = atomic_load(&ctx.excluded),
+      .errors = atomic_load(&ctx.errors),
+      .elapsed_ns = now_ns() - start,
+      .threads = ctx.thread_count,
+  };
+  if (report) {
+    printf(DARK_GREY "+ Scanned %s: %llu dirs, %llu files, %llu watches in "
+                     "%.1fms (%d thread%s)%s\n" RESET,
+           root, (unsigned long long)result.dirs,
+           (unsigned long long)result.files,
+           (unsigned long long)result.watches, result.elapsed_ns / 1e6,
+           result.threads, result.threads == 1 ? "" : "s",
+           result.errors ? ", some entries failed" : "");
+    if (result.excluded) {
+      printf(DARK_GREY "+ Excluded %llu entries under %s\n" RESET,
+             (unsigned long long)result.excluded, root);
+    }
+  }
+  if (stats) {
+    *stats = result;
+  }
+
+  for (int i = 0; i < ctx.thread_count; i++) {
+    pthread_mutex_destroy(&ctx.workers[i].deque.lock);
+    free(ctx.workers[i].deque.items);
+  }
+  free(ctx.workers);
+  pthread_mutex_destroy(&ctx.registry_lock);
+  pthread_cond_destroy(&ctx.idle_cond);
+  pthread_mutex_destroy(&ctx.idle_lock);
+}
@@ -0,0 +1,819 @@
+#include "snapshot.h"
+#include "codec.h"
+#include "copy.h"
+#include "hash.h"
+#include "sqwatch.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SLOT_EMPTY 0
+#define SLOT_LIVE 1
+#define SLOT_DELETED 2
+
+#define INITIAL_SLOTS 64
+
+// Eviction brings the store down to this share of the budget, so it does
+// not run again on the very next capture; prefetching stops at it too
+#define BUDGET_LOW_WATER(budget) ((budget) / 10 * 9)
+
+// Objects this large are kept as plain copies whatever the codec, so they
+// go through the copy engine (reflink, copy_file_range) rather than being
+// read and compressed in memory
+#define PLAIN_OBJECT_SIZE (1024 * 1024)
+
+// A temp file untouched this long was left by a crash, not a capture that
+// another sqwatch on the same cache directory is still writing
+#define STALE_TEMP_SECONDS 3600
+
+static int64_t now_realtime_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint64_t hash_digest(snapshot_digest d) {
+  return hash_mix(d.hash ^ d.size, 0x9e3779b97f4a7c15ULL);
+}
+
+snapshot_digest snapshot_digest_of(const void *data, size_t size) {
+  return (snapshot_digest){hash_bytes(size ? data : "", size), size};
+}
+
+int snapshot_digest_equal(snapshot_digest a, snapshot_digest b) {
+  return a.hash == b.hash && a.size == b.size;
+}
+
+// Whether content of this size is stored compressed. It depends on the
+// size alone, so an object has one name however it was captured.
+static int compressed(const snapshot_store *store, uint64_t size) {
+  return store->codec != CODEC_NONE && size < PLAIN_OBJECT_SIZE;
+}
+
+static void format_object_path(const snapshot_store *store,
+                               snapshot_digest digest, const char *suffix,
+                               char *out, size_t len) {
+  snprintf(out, len, "%s/%016" PRIx64 "-%" PRIu64 "%s", store->object_dir,
+           digest.hash, digest.size, suffix);
+}
+
+void snapshot_object_path(const snapshot_store *store, snapshot_digest digest,
+                          char *out, size_t len) {
+  format_object_path(store, digest, compressed(store, digest.size) ? ".z" : "",
+                     out, len);
+}
+
+static snapshot_ref *find_ref(const snapshot_store *store, const char *path,
+                              uint64_t hash) {
+  size_t mask = store->ref_capacity - 1;
+  size_t i = hash & mask;
+  while (store->refs[i].state != SLOT_EMPTY) {
+    snapshot_ref *ref = &store->refs[i];
+    if (ref->state == SLOT_LIVE && ref->path_hash == hash &&
+        strcmp(ref->path, path) == 0) {
+      return ref;
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+static snapshot_object *find_object(const snapshot_store *store,
+                                    snapshot_digest digest) {
+  size_t mask = store->object_capacity - 1;
+  size_t i = hash_digest(digest) & mask;
+  while (store->objects[i].state != SLOT_EMPTY) {
+    snapshot_object *object = &store->objects[i];
+    if (object->state == SLOT_LIVE &&
+        snapshot_digest_equal(object->digest, digest)) {
+      return object;
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+static int rehash_refs(snapshot_store *store, size_t capacity) {
+  snapshot_ref *refs = calloc(capacity, sizeof(snapshot_ref));
+  if (!refs) {
+    return -1;
+  }
+  for (size_t i = 0; i < store->ref_capacity; i++) {
+    if (store->refs[i].state != SLOT_LIVE) {
+      continue;
+    }
+    size_t j = store->refs[i].path_hash & (capacity - 1);
+    while (refs[j].state != SLOT_EMPTY) {
+      j = (j + 1) & (capacity - 1);
+    }
+    refs[j] = store->refs[i];
+  }
+  free(store->refs);
+  store->refs = refs;
+  store->ref_capacity = capacity;
+  store->ref_used = store->ref_count;
+  return 0;
+}
+
+static int rehash_objects(snapshot_store *store, size_t capacity) {
+  snapshot_object *objects = calloc(capacity, sizeof(snapshot_object));
+  if (!objects) {
+    return -1;
+  }
+  for (size_t i = 0; i < store->object_capacity; i++) {
+    if (store->objects[i].state != SLOT_LIVE) {
+      continue;
+    }
+    size_t j = hash_digest(store->objects[i].digest) & (capacity - 1);
+    while (objects[j].state != SLOT_EMPTY) {
+      j = (j + 1) & (capacity - 1);
+    }
+    objects[j] = store->objects[i];
+  }
+  free(store->objects);
+  store->objects = objects;
+  store->object_capacity = capacity;
+  store->object_used = store->object_count;
+  return 0;
+}
+
+int snapshot_init(snapshot_store *store, const char *cache_dir,
+                  snapshot_codec codec) {
+  memset(store, 0, sizeof(*store));
+  store->codec = codec;
+
+  char object_dir[PATH_MAX];
+  snprintf(object_dir, sizeof(object_dir), "%s/objects", cache_dir);
+  if (mkdir(object_dir, 0755) != 0 && errno != EEXIST) {
+    perror("Failed to create snapshot directory");
+    return -1;
+  }
+  store->object_dir = strdup(object_dir);
+  store->refs = calloc(INITIAL_SLOTS, sizeof(snapshot_ref));
+  store->objects = calloc(INITIAL_SLOTS, sizeof(snapshot_object));
+  if (!store->object_dir || !store->refs || !store->objects) {
+    snapshot_free(store);
+    return -1;
+  }
+  store->ref_capacity = INITIAL_SLOTS;
+  store->object_capacity = INITIAL_SLOTS;
+  pthread_mutex_init(&store->lock, NULL);
+  return 0;
+}
+
+void snapshot_free(snapshot_store *store) {
+  if (store->ref_capacity > 0) {
+    pthread_mutex_destroy(&store->lock);
+  }
+  for (size_t i = 0; i < store->ref_capacity; i++) {
+    if (store->refs[i].state == SLOT_LIVE) {
+      free(store->refs[i].path);
+    }
+  }
+  free(store->refs);
+  free(store->objects);
+  free(store->object_dir);
+  memset(store, 0, sizeof(*store));
+}
+
+int snapshot_lookup(snapshot_store *store, const char *path,
+                    snapshot_digest *digest) {
+  if (!store->refs) {
+    return 0;
+  }
+  pthread_mutex_lock(&store->lock);
+  snapshot_ref *ref = find_ref(store, path, hash_string(path));
+  if (ref) {
+    *digest = ref->digest;
+  }
+  pthread_mutex_unlock(&store->lock);
+  return ref != NULL;
+}
+
+static void release_object(snapshot_store *store, snapshot_digest digest);
+
+// Look up path's snapshot and hold its object until snapshot_unpin(), so
+// budget eviction by another worker cannot unlink it before it is loaded
+int snapshot_pin(snapshot_store *store, const char *path,
+                 snapshot_digest *digest) {
+  if (!store->refs) {
+    return 0;
+  }
+  pthread_mutex_lock(&store->lock);
+  snapshot_ref *ref = find_ref(store, path, hash_string(path));
+  snapshot_object *object = ref ? find_object(store, ref->digest) : NULL;
+  if (object) {
+    object->refs++;
+    *digest = ref->digest;
+  }
+  pthread_mutex_unlock(&store->lock);
+  return object != NULL;
+}
+
+void snapshot_unpin(snapshot_store *store, snapshot_digest digest) {
+  pthread_mutex_lock(&store->lock);
+  release_object(store, digest);
+  pthread_mutex_unlock(&store->lock);
+}
+
+static int acquire_object(snapshot_store *store, snapshot_digest digest,
+                          uint64_t stored) {
+  snapshot_object *object = find_object(store, digest);
+  if (object) {
+    object->refs++;
+    return 0;
+  }
+
+  if ((store->object_used + 1) * 4 > store->object_capacity * 3) {
+    size_t capacity = store->object_capacity;
+    if ((store->object_count + 1) * 2 > capacity) {
+      capacity *= 2;
+    }
+    if (rehash_objects(store, capacity) != 0) {
+      return -1;
+    }
+  }
+  size_t mask = store->object_capacity - 1;
+  size_t i = hash_digest(digest) & mask;
+  while (store->objects[i].state == SLOT_LIVE) {
+    i = (i + 1) & mask;
+  }
+  if (store->objects[i].state == SLOT_EMPTY) {
+    store->object_used++;
+  }
+  store->objects[i] = (snapshot_object){digest, stored, 1, SLOT_LIVE};
+  store->object_count++;
+  store->stored_bytes += stored;
+  store->raw_bytes += digest.size;
+  return 0;
+}
+
+static void release_object(snapshot_store *store, snapshot_digest digest) {
+  snapshot_object *object = find_object(store, digest);
+  if (!object || --object->refs > 0) {
+    return;
+  }
+
+  char object_path[PATH_MAX];
+  snapshot_object_path(store, digest, object_path, sizeof(object_path));
+  unlink(object_path);
+  object->state = SLOT_DELETED;
+  store->object_count--;
+  store->stored_bytes -= object->stored;
+  store->raw_bytes -= digest.size;
+}
+
+static void drop_ref(snapshot_store *store, snapshot_ref *ref) {
+  snapshot_digest digest = ref->digest;
+  free(ref->path);
+  ref->path = NULL;
+  ref->state = SLOT_DELETED;
+  store->ref_count--;
+  release_object(store, digest);
+}
+
+static int compare_last_used(const void *a, const void *b) {
+  const snapshot_ref *x = *(snapshot_ref *const *)a;
+  const snapshot_ref *y = *(snapshot_ref *const *)b;
+  return (x->last_used > y->last_used) - (x->last_used < y->last_used);
+}
+
+// Over budget: forget the least recently captured paths (never keep, the
+// one just captured) until the store is back under the low-water mark.
+// Evicted paths get a fresh baseline on their next change.
+static void enforce_budget(snapshot_store *store, const char *keep) {
+  if (store->budget == 0 || store->stored_bytes <= store->budget) {
+    return;
+  }
+  snapshot_ref **order = malloc(store->ref_count * sizeof(snapshot_ref *));
+  if (!order) {
+    return;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < store->ref_capacity; i++) {
+    if (store->refs[i].state == SLOT_LIVE) {
+      order[n++] = &store->refs[i];
+    }
+  }
+  qsort(order, n, sizeof(snapshot_ref *), compare_last_used);
+
+  uint64_t target = BUDGET_LOW_WATER(store->budget);
+  for (size_t i = 0; i < n && store->stored_bytes > target; i++) {
+    if (strcmp(order[i]->path, keep) == 0) {
+      continue;
+    }
+    drop_ref(store, order[i]);
+    store->evicted++;
+  }
+  free(order);
+}
+
+// Point path at digest, whose object file (stored bytes on disk) must
+// already be in place
+static int link_path(snapshot_store *store, const char *path,
+                     snapshot_digest digest, uint64_t stored,
+                     int64_t last_used) {
+  uint64_t hash = hash_string(path);
+  snapshot_ref *ref = find_ref(store, path, hash);
+  if (ref && snapshot_digest_equal(ref->digest, digest)) {
+    ref->last_used = last_used;
+    return 0;
+  }
+  if (acquire_object(store, digest, stored) != 0) {
+    return -1;
+  }
+
+  if (ref) {
+    snapshot_digest old = ref->digest;
+    ref->digest = digest;
+    ref->last_used = last_used;
+    release_object(store, old);
+    enforce_budget(store, path);
+    return 0;
+  }
+
+  char *path_copy = strdup(path);
+  if (!path_copy) {
+    release_object(store, digest);
+    return -1;
+  }
+  if ((store->ref_used + 1) * 4 > store->ref_capacity * 3) {
+    size_t capacity = store->ref_capacity;
+    if ((store->ref_count + 1) * 2 > capacity) {
+      capacity *= 2;
+    }
+    if (rehash_refs(store, capacity) != 0) {
+      free(path_copy);
+      release_object(store, digest);
+      return -1;
+    }
+  }
+  size_t mask = store->ref_capacity - 1;
+  size_t i = hash & mask;
+  while (store->refs[i].state == SLOT_LIVE) {
+    i = (i + 1) & mask;
+  }
+  if (store->refs[i].state == SLOT_EMPTY) {
+    store->ref_used++;
+  }
+  store->refs[i] = (snapshot_ref){path_copy, hash, digest, last_used, SLOT_LIVE};
+  store->ref_count++;
+  enforce_budget(store, path);
+  return 0;
+}
+
+// Move a finished temp file into place as the object for digest, or drop
+// it when that content is already stored
+static int place_object(snapshot_store *store, snapshot_digest digest,
+                        const char *tmp_path) {
+  if (find_object(store, digest)) {
+    unlink(tmp_path);
+    return 0;
+  }
+  char object_path[PATH_MAX];
+  snapshot_object_path(store, digest, object_path, sizeof(object_path));
+  if (rename(tmp_path, object_path) != 0) {
+    perror("Failed to store snapshot");
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+static int make_temp(const snapshot_store *store, char *tmp_path, size_t len) {
+  snprintf(tmp_path, len, "%s/.tmp-XXXXXX", store->object_dir);
+  int fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    perror("Failed to create snapshot file");
+  }
+  return fd;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+  const char *p = data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return -1;
+    }
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+// Index content that was just written to tmp_path. With only_missing, a
+// path that got a snapshot meanwhile (say from a diff worker, which is
+// newer) is left alone.
+static int commit_object(snapshot_store *store, const char *path,
+                         snapshot_digest digest, const char *tmp_path,
+                         uint64_t stored, int only_missing,
+                         int64_t last_used) {
+  pthread_mutex_lock(&store->lock);
+  if (only_missing && find_ref(store, path, hash_string(path))) {
+    pthread_mutex_unlock(&store->lock);
+    unlink(tmp_path);
+    return 1;
+  }
+  int rc = place_object(store, digest, tmp_path);
+  if (rc == 0) {
+    rc = link_path(store, path, digest, stored, last_used);
+  }
+  pthread_mutex_unlock(&store->lock);
+  return rc;
+}
+
+// Store content held in memory, compressed with the store's codec unless
+// it is large enough to be kept plain. The object is written outside the
+// lock; only indexing is serialized.
+static int store_buffer(snapshot_store *store, const char *path,
+                        const void *data, size_t size, int only_missing,
+                        int64_t last_used) {
+  snapshot_digest digest = snapshot_digest_of(data, size);
+
+  // Stored already (by this path or another): just point path at it
+  pthread_mutex_lock(&store->lock);
+  if (find_object(store, digest)) {
+    int rc = 1;
+    if (!only_missing || !find_ref(store, path, hash_string(path))) {
+      rc = link_path(store, path, digest, 0, last_used);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return rc;
+  }
+  pthread_mutex_unlock(&store->lock);
+
+  char tmp_path[PATH_MAX];
+  int fd = make_temp(store, tmp_path, sizeof(tmp_path));
+  if (fd < 0) {
+    return -1;
+  }
+  uint64_t stored = size;
+  int rc = compressed(store, size)
+               ? codec_write(fd, store->codec, data, size, &stored)
+               : write_all(fd, data, size);
+  close(fd);
+  if (rc != 0) {
+    perror("Failed to write snapshot");
+    unlink(tmp_path);
+    return -1;
+  }
+  return commit_object(store, path, digest, tmp_path, stored, only_missing,
+                       last_used);
+}
+
+// Read a whole file into memory, so it is hashed and compressed from one
+// consistent copy even if it is changing underneath
+static int slurp_file(const char *path, char **data, size_t *size) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  size_t capacity = st.st_size > 0 ? (size_t)st.st_size : 4096;
+  char *buf = malloc(capacity);
+  size_t len = 0;
+  while (buf) {
+    if (len == capacity) {
+      char *grown = realloc(buf, capacity * 2);
+      if (!grown) {
+        break;
+      }
+      buf = grown;
+      capacity *= 2;
+    }
+    ssize_t n = read(fd, buf + len, capacity - len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      break;
+    }
+    if (n == 0) {
+      close(fd);
+      *data = buf;
+      *size = len;
+      return 0;
+    }
+    len += (size_t)n;
+  }
+  free(buf);
+  close(fd);
+  return -1;
+}
+
+// Snapshot a file from disk. Files kept as plain copies are copied
+// (reflinking where the filesystem can) and the copy is hashed rather than
+// the source, so the digest always matches what was stored even if the
+// file is changing.
+static int capture_file(snapshot_store *store, const char *path,
+                        copy_method *method, int only_missing,
+                        int64_t last_used) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return -1;
+  }
+  if (compressed(store, (uint64_t)st.st_size)) {
+    char *data;
+    size_t size;
+    if (slurp_file(path, &data, &size) != 0) {
+      return -1;
+    }
+    if (method) {
+      *method = COPY_BUFFER;
+    }
+    int rc = store_buffer(store, path, data, size, only_missing, last_used);
+    free(data);
+    if (rc == 0) {
+      pthread_mutex_lock(&store->lock);
+      store->copies[COPY_BUFFER]++;
+      pthread_mutex_unlock(&store->lock);
+    }
+    return rc;
+  }
+
+  char tmp_path[PATH_MAX];
+  int fd = make_temp(store, tmp_path, sizeof(tmp_path));
+  if (fd < 0) {
+    return -1;
+  }
+  close(fd);
+  copy_method used;
+  if (copy_file_method(path, tmp_path, &used) != 0) {
+    unlink(tmp_path);
+    return -1;
+  }
+  if (method) {
+    *method = used;
+  }
+
+  fd = open(tmp_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    unlink(tmp_path);
+    return -1;
+  }
+  snapshot_digest digest = snapshot_digest_of(NULL, 0);
+  void *data = NULL;
+  if (st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      unlink(tmp_path);
+      return -1;
+    }
+    digest = snapshot_digest_of(data, st.st_size);
+  }
+  close(fd);
+
+  int rc;
+  if (compressed(store, (uint64_t)st.st_size)) {
+    // The file shrank while it was copied; compress what was copied
+    unlink(tmp_path);
+    used = COPY_BUFFER;
+    if (method) {
+      *method = used;
+    }
+    rc = store_buffer(store, path, data ? data : "", st.st_size, only_missing,
+                      last_used);
+  } else {
+    rc = commit_object(store, path, digest, tmp_path, (uint64_t)st.st_size,
+                       only_missing, last_used);
+  }
+  if (data) {
+    munmap(data, st.st_size);
+  }
+  if (rc == 0) {
+    pthread_mutex_lock(&store->lock);
+    store->copies[used]++;
+    pthread_mutex_unlock(&store->lock);
+  }
+  return rc;
+}
+
+int snapshot_capture_file(snapshot_store *store, const char *path,
+                          copy_method *method) {
+  return capture_file(store, path, method, 0, now_realtime_ns());
+}
+
+// Snapshot content already in memory, typically the buffer just diffed
+int snapshot_capture_buffer(snapshot_store *store, const char *path,
+                            const void *data, size_t size) {
+  return store_buffer(store, path, data, size, 0, now_realtime_ns());
+}
+
+// Load the object for digest into buf for diffing. Plain objects are
+// mapped; compressed ones are decoded block by block straight into
+// the buffer the diff splits, with no intermediate copy of the file.
+int snapshot_load(snapshot_store *store, snapshot_digest digest,
+                  ingest_buffer *buf) {
+  char object_path[PATH_MAX];
+  snapshot_object_path(store, digest, object_path, sizeof(object_path));
+  if (!compressed(store, digest.size)) {
+    return ingest_map(object_path, buf);
+  }
+
+  memset(buf, 0, sizeof(*buf));
+  int fd = open(object_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, RED "Failed to open %s: %s\n" RESET, object_path,
+            strerror(errno));
+    return -1;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  char *data = malloc(digest.size ? digest.size : 1);
+  if (!data || codec_read(fd, data, digest.size) != 0) {
+    fprintf(stderr, RED "Corrupt snapshot %s\n" RESET, object_path);
+    free(data);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  buf->data = data;
+  buf->size = digest.size;
+  buf->kind = digest.size ? INGEST_TEXT : INGEST_EMPTY;
+  return 0;
+}
+
+void snapshot_forget(snapshot_store *store, const char *path) {
+  if (!store->refs) {
+    return;
+  }
+  pthread_mutex_lock(&store->lock);
+  snapshot_ref *ref = find_ref(store, path, hash_string(path));
+  if (ref) {
+    drop_ref(store, ref);
+  }
+  pthread_mutex_unlock(&store->lock);
+}
+
+// Point path back at an object kept from an earlier run. Fails when the
+// object file is gone, does not hold content of the digest's size, or
+// was compressed by a codec this build cannot decode; snapshot_prune()
+// then removes it and the path is captured afresh.
+int snapshot_restore(snapshot_store *store, const char *path,
+                     snapshot_digest digest, int64_t last_used) {
+  char object_path[PATH_MAX];
+  snapshot_object_path(store, digest, object_path, sizeof(object_path));
+  int fd = open(object_path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  uint64_t size = (uint64_t)st.st_size;
+  if (compressed(store, digest.size) && codec_probe(fd, &size) != 0) {
+    size = UINT64_MAX;
+  }
+  close(fd);
+  if (size != digest.size) {
+    return -1;
+  }
+  pthread_mutex_lock(&store->lock);
+  int rc = link_path(store, path, digest, (uint64_t)st.st_size, last_used);
+  pthread_mutex_unlock(&store->lock);
+  return rc;
+}
+
+// Unlink what a saved index left behind: the objects of the listed
+// digests that no path uses any more (under either name, so objects of
+// the other codec go too) and temp files abandoned by a crash. Objects
+// the index did not list are never touched, so another sqwatch sharing
+// the cache directory keeps its snapshots. Returns how many were removed.
+size_t snapshot_prune(snapshot_store *store, const snapshot_digest *digests,
+                      size_t count) {
+  static const char *const suffixes[] = {"", ".z"};
+  size_t removed = 0;
+  pthread_mutex_lock(&store->lock);
+  for (size_t i = 0; i < count; i++) {
+    char live_path[PATH_MAX] = "";
+    if (find_object(store, digests[i])) {
+      snapshot_object_path(store, digests[i], live_path, sizeof(live_path));
+    }
+    for (size_t s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]); s++) {
+      char object_path[PATH_MAX];
+      format_object_path(store, digests[i], suffixes[s], object_path,
+                         sizeof(object_path));
+      if (strcmp(object_path, live_path) != 0 && unlink(object_path) == 0) {
+        removed++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&store->lock);
+
+  DIR *dir = opendir(store->object_dir);
+  if (!dir) {
+    return removed;
+  }
+  time_t cutoff = time(NULL) - STALE_TEMP_SECONDS;
+  struct dirent *d;
+  while ((d = readdir(dir)) != NULL) {
+    struct stat st;
+    if (strncmp(d->d_name, ".tmp-", 5) == 0 &&
+        fstatat(dirfd(dir), d->d_name, &st, 0) == 0 &&
+        st.st_mtime < cutoff && unlinkat(dirfd(dir), d->d_name, 0) == 0) {
+      removed++;
+    }
+  }
+  closedir(dir);
+  return removed;
+}
+
+static int compare_hotter(const void *a, const void *b) {
+  const snapshot_prefetch_item *x = a;
+  const snapshot_prefetch_item *y = b;
+  return (x->mtime_ns < y->mtime_ns) - (x->mtime_ns > y->mtime_ns);
+}
+
+static void *prefetch_main(void *arg) {
+  snapshot_prefetch *p = arg;
+  snapshot_store *store = p->store;
+  size_t captured = 0;
+  size_t i = 0;
+  for (; i < p->count && !atomic_load(&p->stop); i++) {
+    pthread_mutex_lock(&store->lock);
+    int full = store->budget &&
+               store->stored_bytes >= BUDGET_LOW_WATER(store->budget);
+    pthread_mutex_unlock(&store->lock);
+    if (full) {
+      break;
+    }
+    // The file's own mtime ranks it for eviction until it is diffed
+    copy_method method;
+    if (capture_file(store, p->items[i].path, &method, 1,
+                     p->items[i].mtime_ns) == 0) {
+      captured++;
+      if (p->verbose) {
+        printf(DARK_GREY "+ Cached: %s (%s)\n" RESET, p->items[i].path,
+               copy_method_name(method));
+      }
+    }
+  }
+  if (p->verbose && i < p->count && !atomic_load(&p->stop)) {
+    printf(DARK_GREY "+ Snapshot budget reached, %zu colder files left "
+                     "uncached\n" RESET, p->count - i);
+  }
+  if (p->verbose && p->started) {
+    printf(DARK_GREY "+ Background snapshots done: %zu files\n" RESET,
+           captured);
+  }
+  return NULL;
+}
+
+// Snapshot items hottest first. Takes ownership of items. In the
+// background the first change to a not yet captured file only records
+// its baseline.
+int snapshot_prefetch_start(snapshot_prefetch *p, snapshot_store *store,
+                            snapshot_prefetch_item *items, size_t count,
+                            int background, int verbose) {
+  p->store = store;
+  p->items = items;
+  p->count = count;
+  p->verbose = verbose;
+  p->started = 0;
+  atomic_store(&p->stop, 0);
+  qsort(items, count, sizeof(*items), compare_hotter);
+
+  if (background) {
+    p->started = 1;
+    if (pthread_create(&p->thread, NULL, prefetch_main, p) == 0) {
+      return 0;
+    }
+    p->started = 0;
+  }
+  prefetch_main(p);
+  return 0;
+}
+
+void snapshot_prefetch_stop(snapshot_prefetch *p) {
+  if (p->started) {
+    atomic_store(&p->stop, 1);
+    pthread_join(p->thread, NULL);
+    p->started = 0;
+  }
+  for (size_t i = 0; i < p->count; i++) {
+    free(p->items[i].path);
+  }
+  free(p->items);
+  p->items = NULL;
+  p->count = 0;
+}
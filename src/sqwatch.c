@@ -1,6 +1,10 @@
 #include "cache.h"
 #include "diff.h"
 #include "sqwatch.h"
+#include "scan.h"
+#include "reconcile.h"
+#include "metastore.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <signal.h>
@@ -13,94 +17,137 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-pid_t g_last_pid = 0;
 char *cache_dir = NULL;
 sqwatch_config config;
-int inotify_fd;
-static const int INITIAL_DIR_WATCHES = 16;
+int inotify_fd = -1;
+static const int INITIAL_WATCHES = 1024;
+static const uint64_t DEFAULT_VERSION_CACHE = 64ULL << 20;
 
-static void cleanup(int signo) {
+// Runs once the event loop has returned, never from a signal handler
+static void cleanup(void) {
   printf(RED "\n+ Exiting SQWatch... \n" RESET);
 
-  if (g_last_pid > 0) {
-    kill(-g_last_pid, signo);
-    waitpid(g_last_pid, NULL, 0);
+  // A background capture must not outlive the store it writes to
+  snapshot_prefetch_stop(&config.prefetch);
+
+  if (config.index_path) {
+    printf(DARK_GREY "+ Saving index to %s\n" RESET, config.index_path);
+    metastore_save(config.index_path, &config.meta, &config.snapshots);
   }
 
-  // Wipe the cache directory if it exists
+  // Wipe the cache directory if it exists; a persistent index keeps its
+  // snapshots for the next run
   if (cache_dir) {
-    printf(RED "+ Wiping cache directory: %s\n" RESET, cache_dir);
-    remove_directory(cache_dir);
+    if (!config.index_path) {
+      printf(RED "+ Wiping cache directory: %s\n" RESET, cache_dir);
+      remove_directory(cache_dir);
+    }
+    snapshot_free(&config.snapshots);
+  }
+  if (config.verbose && config.versions.hits + config.versions.misses > 0) {
+    printf(DARK_GREY "+ Version cache: %llu hits, %llu misses, %llu evictions\n" RESET,
+           (unsigned long long)config.versions.hits,
+           (unsigned long long)config.versions.misses,
+           (unsigned long long)config.versions.evictions);
+  }
+  versions_free(&config.versions);
+
+  if (config.use_fanotify) {
+    printf(RED "+ Removing fanotify marks\n" RESET);
+    fanwatch_close(&config.fan);
   }
 
   if (inotify_fd > 0) {
     printf(RED "+ Removing watches\n" RESET);
-    // Clean up file watches
-    for (int i = 0; i < MAX_PATHS; i++) {
-      if (config.watch_paths[i]) {
-        inotify_rm_watch(inotify_fd, i);
-        free(config.watch_paths[i]);
-        config.watch_paths[i] = NULL;
-      }
+    // Clean up file and directory watches
+    size_t iter = 0;
+    watch_entry *entry;
+    while ((entry = registry_next(&config.registry, &iter)) != NULL) {
+      inotify_rm_watch(inotify_fd, entry->wd);
     }
+    registry_free(&config.registry);
 
-    // Clean up directory watches
-    for (int i = 0; i < config.dir_watch_count; i++) {
-      if (config.dir_watches[i].path) {
-        inotify_rm_watch(inotify_fd, config.dir_watches[i].wd);
-        free(config.dir_watches[i].path);
-      }
-    }
-    free(config.dir_watches);
-    
     close(inotify_fd);
   }
+  metaindex_free(&config.meta);
+  pathmatch_free(&config.filter);
+  log_close(&config.log);
+  journal_close(&config.journal);
 
   free(cache_dir);
   exit(EXIT_SUCCESS);
 }
 
 int main(int argc, char *argv[]) {
-  signal(SIGTERM, cleanup);
-  signal(SIGINT, cleanup);
+  if (argc > 1 && strcmp(argv[1], "journal") == 0) {
+    return journal_main(argc - 1, argv + 1);
+  }
+
   char *command = NULL;
   char *paths[MAX_PATHS];
   int path_count = 0;
+  int inotify_path_count = 0;
   int opt;
-  uint32_t debounce_t = 1;
+  uint64_t debounce_ns = 1000000000ULL; // 1s
+  uint64_t max_wait_ns = 0;
+  debounce_mode mode = DEBOUNCE_TRAILING;
+  int scan_threads = scan_default_threads();
+  int diff_workers = diffpool_default_workers();
   char *log_file = NULL;
+  log_format log_fmt = LOG_FORMAT_TEXT;
+  uint64_t log_max_bytes = 0;
+  int log_keep = 5;
+  char *journal_dir = NULL;
+  char *includes[MAX_PATHS];
+  char *excludes[MAX_PATHS];
+  int include_count = 0;
+  int exclude_count = 0;
+  int use_gitignore = 0;
+  uint64_t version_budget = DEFAULT_VERSION_CACHE;
+  snapshot_codec codec = CODEC_LZ;
   int verbose = 0;
 
-  int inotify_fd = -1;
-  for (int i = 0; i < MAX_PATHS; i++) {
-    config.watch_paths[i] = NULL;
-    config.cached_paths[i] = NULL;
-  }
-  
-  // Initialize directory watch structures
-  config.dir_watches = malloc(INITIAL_DIR_WATCHES * sizeof(dir_watch));
-  if (!config.dir_watches) {
-    fprintf(stderr, "Failed to allocate memory for directory watches\n");
+  // Initialize the watch registry and the metadata index
+  if (registry_init(&config.registry, INITIAL_WATCHES) != 0 ||
+      metaindex_init(&config.meta, INITIAL_WATCHES) != 0) {
+    fprintf(stderr, "Failed to allocate memory for watch registry\n");
     return 1;
   }
-  config.dir_watch_count = 0;
-  config.max_dir_watches = INITIAL_DIR_WATCHES;
 
   // Determine the default cache directory
-  inotify_fd = inotify_init();
+  inotify_fd = inotify_init1(IN_CLOEXEC);
   if (inotify_fd == -1) {
-    perror("inotify_init");
-    free(config.dir_watches);  // Clean up if initialization fails
+    perror("inotify_init1");
+    registry_free(&config.registry);  // Clean up if initialization fails
     exit(EXIT_FAILURE);
   }
   int flags = IN_MODIFY;
 
   static struct option long_options[] = {
     {"diff", no_argument, 0, 'D'},
+    {"debounce-mode", required_argument, 0, 'B'},
+    {"max-wait", required_argument, 0, 'W'},
+    {"scan-threads", required_argument, 0, 'T'},
+    {"diff-workers", required_argument, 0, 'J'},
+    {"max-queued-events", required_argument, 0, 'Q'},
+    {"log-format", required_argument, 0, 'F'},
+    {"log-max-size", required_argument, 0, 'S'},
+    {"log-keep", required_argument, 0, 'K'},
+    {"journal", required_argument, 0, 'R'},
+    {"on-busy", required_argument, 0, 'O'},
+    {"min-interval", required_argument, 0, 'I'},
+    {"include", required_argument, 0, 'N'},
+    {"exclude", required_argument, 0, 'X'},
+    {"gitignore", no_argument, 0, 'G'},
+    {"index", required_argument, 0, 'P'},
+    {"lazy-cache", no_argument, 0, 'L'},
+    {"cache-budget", required_argument, 0, 'C'},
+    {"version-cache", required_argument, 0, 'V'},
+    {"snapshot-codec", required_argument, 0, 'Z'},
     {0, 0, 0, 0}
   };
 
-  while ((opt = getopt_long(argc, argv, "d:f:t:q:c:l:vh", long_options, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "d:f:m:t:q:c:l:vh", long_options, NULL)) != -1) {
     switch (opt) {
     case 'd':
       if (path_count >= MAX_PATHS) {
@@ -108,6 +155,7 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
       }
       paths[path_count++] = optarg;
+      inotify_path_count++;
 
       // Check if the specified path is a directory
       {
@@ -124,6 +172,7 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
       }
       paths[path_count++] = optarg;
+      inotify_path_count++;
 
       // Check if the specified path is a file
       {
@@ -134,14 +183,68 @@ int main(int argc, char *argv[]) {
         }
       }
       break;
+    case 'm':
+      if (path_count >= MAX_PATHS) {
+        fprintf(stderr, "Too many paths specified. Maximum is %d\n", MAX_PATHS);
+        exit(EXIT_FAILURE);
+      }
+      paths[path_count++] = optarg;
+      config.use_fanotify = 1;
+
+      // Check if the specified path is a directory
+      {
+        struct stat statbuf;
+        if (stat(optarg, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode)) {
+          fprintf(stderr, "Error: %s is not a valid directory.\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+      }
+      break;
+    case 'T':
+      scan_threads = atoi(optarg);
+      if (scan_threads < 1) {
+        fprintf(stderr, "Invalid scan thread count: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'J':
+      diff_workers = atoi(optarg);
+      if (diff_workers < 1) {
+        fprintf(stderr, "Invalid diff worker count: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'Q':
+      config.max_queued_events = atol(optarg);
+      if (config.max_queued_events < 1) {
+        fprintf(stderr, "Invalid max queued events: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
     case 'c':
       if (optarg && strlen(optarg) > 0) {
         command = optarg;
       }
       break;
     case 't':
-      debounce_t = atoi(optarg);
-      printf(DARK_GREY "+ Debounce set to %d\n" RESET, debounce_t);
+      if (parse_duration_ns(optarg, &debounce_ns) != 0) {
+        fprintf(stderr, "Invalid debounce time: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      printf(DARK_GREY "+ Debounce set to %.3fms\n" RESET, debounce_ns / 1e6);
+      break;
+    case 'B':
+      if (parse_debounce_mode(optarg, &mode) != 0) {
+        fprintf(stderr, "Invalid debounce mode: %s\n", optarg);
+        print_usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'W':
+      if (parse_duration_ns(optarg, &max_wait_ns) != 0) {
+        fprintf(stderr, "Invalid max wait: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
       break;
     case 'q':
       if (strcmp(optarg, "all") == 0) {
@@ -173,6 +276,82 @@ int main(int argc, char *argv[]) {
         log_file = optarg; // log file/directory
       }
 
+      break;
+    case 'F':
+      if (parse_log_format(optarg, &log_fmt) != 0) {
+        fprintf(stderr, "Invalid log format: %s\n", optarg);
+        print_usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'S':
+      if (parse_size_bytes(optarg, &log_max_bytes) != 0) {
+        fprintf(stderr, "Invalid log size: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'K':
+      log_keep = atoi(optarg);
+      if (log_keep < 0) {
+        fprintf(stderr, "Invalid log keep count: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'R':
+      journal_dir = optarg;
+      break;
+    case 'O':
+      if (parse_busy_policy(optarg, &config.on_busy, &config.command_slots) != 0) {
+        fprintf(stderr, "Invalid busy policy: %s\n", optarg);
+        print_usage();
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'I':
+      if (parse_duration_ns(optarg, &config.min_interval_ns) != 0) {
+        fprintf(stderr, "Invalid minimum interval: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'N':
+    case 'X':
+      if ((opt == 'N' ? include_count : exclude_count) >= MAX_PATHS) {
+        fprintf(stderr, "Too many patterns specified. Maximum is %d\n", MAX_PATHS);
+        exit(EXIT_FAILURE);
+      }
+      if (opt == 'N') {
+        includes[include_count++] = optarg;
+      } else {
+        excludes[exclude_count++] = optarg;
+      }
+      break;
+    case 'G':
+      use_gitignore = 1;
+      break;
+    case 'P':
+      config.index_path = optarg;
+      break;
+    case 'L':
+      config.lazy_cache = 1;
+      break;
+    case 'C':
+      if (parse_size_bytes(optarg, &config.cache_budget) != 0) {
+        fprintf(stderr, "Invalid cache budget: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'V':
+      if (parse_size_bytes(optarg, &version_budget) != 0) {
+        fprintf(stderr, "Invalid version cache size: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'Z':
+      if (parse_codec(optarg, &codec) != 0) {
+        fprintf(stderr, "Unsupported snapshot codec: %s\n", optarg);
+        print_usage();
+        exit(EXIT_FAILURE);
+      }
       break;
     case 'D':
       config.diff_enabled = 1;
@@ -229,26 +408,146 @@ int main(int argc, char *argv[]) {
     exit(EXIT_FAILURE);
   }
 
+  if (config.use_fanotify && inotify_path_count > 0) {
+    fprintf(stderr, "-m cannot be combined with -d or -f\n");
+    print_usage();
+    exit(EXIT_FAILURE);
+  }
+
   if (log_file) {
     printf(DARK_GREY "+ Logging to %s\n" RESET, log_file);
+    if (log_open(&config.log, log_file, log_fmt, log_max_bytes, log_keep) != 0) {
+      exit(EXIT_FAILURE);
+    }
   }
 
-  config.debounce_t = debounce_t;
+  if (mode == DEBOUNCE_MAX_WAIT && max_wait_ns == 0) {
+    // Ten windows, saturating for absurdly long ones
+    max_wait_ns =
+        debounce_ns > UINT64_MAX / 10 ? UINT64_MAX : debounce_ns * 10;
+  }
+  config.debounce_ns = debounce_ns;
+  config.max_wait_ns = max_wait_ns;
+  config.debounce_mode = mode;
+  if (verbose) {
+    printf(DARK_GREY "+ Debounce: %s, %.3fms window\n" RESET,
+           debounce_mode_name(mode), debounce_ns / 1e6);
+  }
   config.verbose = verbose;
-  config.log_file = log_file;
+  config.snapshot_codec = codec;
+  if (journal_dir) {
+    if (journal_open(&config.journal, journal_dir) != 0) {
+      exit(EXIT_FAILURE);
+    }
+    printf(DARK_GREY "+ Journaling to %s (%llu records)\n" RESET, journal_dir,
+           (unsigned long long)config.journal.record_count);
+  }
+  config.diff_workers = diff_workers;
   config.command = command;
+  if (config.command_slots == 0) {
+    config.command_slots = 1;
+  }
+  if (verbose && command) {
+    printf(DARK_GREY "+ Command policy: %s", busy_policy_name(config.on_busy));
+    if (config.on_busy == BUSY_PARALLEL) {
+      printf(" (%d slots)", config.command_slots);
+    }
+    printf(", %.3fms minimum interval\n" RESET, config.min_interval_ns / 1e6);
+  }
   config.flags = flags;
+  // fanotify reports canonical paths, so the roots, filters and scan keys
+  // must be spelled the same way; they live as long as the process
+  if (config.use_fanotify) {
+    for (int i = 0; i < path_count; i++) {
+      char *resolved = realpath(paths[i], NULL);
+      if (!resolved) {
+        fprintf(stderr, RED "+ Failed to resolve %s: %s\n" RESET, paths[i],
+                strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      paths[i] = resolved;
+    }
+  }
+  for (int i = 0; i < path_count; i++) {
+    config.roots[i] = paths[i];
+  }
+  config.root_count = path_count;
 
+  // Compile the filters before scanning so excluded subtrees are never
+  // entered. Patterns are relative to each root.
+  if (pathmatch_init(&config.filter, use_gitignore) != 0) {
+    fprintf(stderr, "Failed to allocate the path filter\n");
+    exit(EXIT_FAILURE);
+  }
   for (int i = 0; i < path_count; i++) {
-    add_watches_recursive(inotify_fd, paths[i], flags, &config);
+    if (use_gitignore) {
+      // git never tracks its own metadata
+      pathmatch_add(&config.filter, paths[i], ".git/", 0);
+    }
+    for (int j = 0; j < exclude_count; j++) {
+      if (pathmatch_add(&config.filter, paths[i], excludes[j], 0) != 0) {
+        fprintf(stderr, "Invalid exclude pattern: %s\n", excludes[j]);
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (int j = 0; j < include_count; j++) {
+      if (pathmatch_add(&config.filter, paths[i], includes[j], 1) != 0) {
+        fprintf(stderr, "Invalid include pattern: %s\n", includes[j]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  if (verbose && (include_count || exclude_count || use_gitignore)) {
+    printf(DARK_GREY "+ Filters: %d include, %d exclude%s\n" RESET,
+           include_count, exclude_count, use_gitignore ? ", .gitignore" : "");
+  }
+
+  // The index from the last run; the scan below builds the current one
+  // and the two are compared once the event loop is up
+  if (config.index_path) {
+    int loaded = -1;
+    if (metaindex_init(&config.saved, INITIAL_WATCHES) == 0) {
+      loaded = metastore_load(config.index_path, &config.saved);
+    }
+    if (loaded < 0) {
+      metaindex_free(&config.saved);
+      printf(DARK_GREY "+ No usable index at %s, starting cold\n" RESET,
+             config.index_path);
+    } else {
+      printf(DARK_GREY "+ Loaded index %s: %d entries\n" RESET,
+             config.index_path, loaded);
+    }
   }
 
+  if (config.use_fanotify) {
+    if (fanwatch_init(&config.fan) != 0) {
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < path_count; i++) {
+      if (fanwatch_add(&config.fan, paths[i], flags, verbose) != 0) {
+        exit(EXIT_FAILURE);
+      }
+      // No watches, but the metadata index is needed to recover from an
+      // overflow
+      scan_tree(-1, paths[i], flags, &config, scan_threads, 0, NULL);
+    }
+  } else {
+    for (int i = 0; i < path_count; i++) {
+      scan_tree(inotify_fd, paths[i], flags, &config, scan_threads, 1, NULL);
+    }
+  }
+  reconcile_check_queue_limit(&config);
+
   if (cache_dir && config.diff_enabled) {
-    create_caches(MAX_PATHS, cache_dir, config.watch_paths, config.cached_paths, verbose);
+    if (versions_init(&config.versions, version_budget) != 0 ||
+        create_caches(cache_dir, &config) != 0) {
+      fprintf(stderr, RED "Failed to set up the diff cache\n" RESET);
+      exit(EXIT_FAILURE);
+    }
   }
 
-  handle_events(inotify_fd, config);
-  cleanup(SIGTERM);
+  handle_events(inotify_fd, &config);
+  cleanup();
 
   return EXIT_SUCCESS;
 }
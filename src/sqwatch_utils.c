@@ -3,10 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <dirent.h>
@@ -18,10 +19,16 @@
 
 #include "sqwatch.h"
 #include "diff.h"
+#include "cache.h"
+#include "reactor.h"
+#include "debounce.h"
+#include "coalesce.h"
+#include "scan.h"
+#include "reconcile.h"
+#include "launcher.h"
+#include "metastore.h"
 
 
-extern pid_t g_last_pid;
-extern char **environ;
 
 const char* get_signal_desc(int signo) {
     switch (signo) {
@@ -70,307 +77,607 @@ void print_event_type(struct inotify_event *event) {
   fflush(stdout);  // Ensure partial line is displayed
 }
 
+// Used for directories that appear while running; these are small, so the
+// walk stays on the event loop thread
 void add_watches_recursive(int inotify_fd, const char *path, uint32_t flags, sqwatch_config *config) {
-    struct stat path_stat;
-    if (stat(path, &path_stat) == -1) {
-        fprintf(stderr, RED "+ Failed to stat %s: %s\n" RESET, path, strerror(errno));
+    scan_tree(inotify_fd, path, flags, config, 1, 0, NULL);
+}
+
+// Grace period between SIGTERM and SIGKILL for the previous command
+#define KILL_GRACE_NS 100000000ULL
+
+// Distinct paths waiting for a diff worker before the event loop blocks
+#define DIFF_QUEUE_CAPACITY 4096
+
+// Longest a buffered log or journal record waits before it reaches the file
+#define FLUSH_NS 1000000000ULL
+
+// How often a changed metadata index is checkpointed to --index
+#define INDEX_CHECKPOINT_NS 60000000000ULL
+
+// Event loop state shared by the reactor callbacks
+static struct {
+    reactor loop;
+    int inotify_fd;
+    int watch_fd;
+    int signal_fd;
+    int debounce_timer_fd;
+    int flush_timer_fd;
+    journal *journal;        // NULL unless --journal
+    debouncer debounce;
+    coalesce_table pending;  // Events held back, merged per path
+    diff_pool diffs;         // Diffs run here, off the event loop
+    int fire_after_batch;    // Debouncer wants to fire once the read batch is merged
+    int overflowed;          // Kernel dropped events; rescan after this batch
+    launcher commands;       // Runs of -c command
+    int spawn_pending;    // A run is owed once a slot and the interval allow
+    uint64_t last_spawn_ns;  // When the latest run started
+    int interval_timer_fd;   // Wakes a run deferred by --min-interval
+    int index_timer_fd;      // Periodic --index checkpoint
+    uint64_t saved_changes;  // meta.changes when the index was last saved
+} loop_state = {
+    .inotify_fd = -1,
+    .watch_fd = -1,
+    .signal_fd = -1,
+    .debounce_timer_fd = -1,
+    .flush_timer_fd = -1,
+    .interval_timer_fd = -1,
+    .index_timer_fd = -1,
+};
+
+// Start the owed run if a job slot is free and --min-interval allows it;
+// otherwise a command exit or the interval timer brings us back here
+static void start_pending(sqwatch_config *config) {
+    launcher *l = &loop_state.commands;
+    if (!loop_state.spawn_pending || l->running >= l->slots) {
+        return;
+    }
+    uint64_t now = debounce_now_ns();
+    if (loop_state.last_spawn_ns != 0 &&
+        now < loop_state.last_spawn_ns + config->min_interval_ns) {
+        reactor_timer_arm(loop_state.interval_timer_fd,
+                          loop_state.last_spawn_ns + config->min_interval_ns - now);
         return;
     }
+    loop_state.spawn_pending = 0;
+    loop_state.last_spawn_ns = now;
+    launcher_spawn(l);
+}
 
-    if (S_ISDIR(path_stat.st_mode)) {
-        // Add directory watch separately from file watches
-        int wd = add_watch(inotify_fd, path, flags | IN_CREATE);
-        if (wd != -1) {
-            // Add to directory watches
-            if (config->dir_watch_count >= config->max_dir_watches) {
-                int new_size = config->max_dir_watches * 2;
-                dir_watch *new_watches = realloc(config->dir_watches, 
-                                               new_size * sizeof(dir_watch));
-                if (!new_watches) {
-                    fprintf(stderr, RED "+ Failed to allocate memory for dir watches\n" RESET);
-                    return;
-                }
-                config->dir_watches = new_watches;
-                config->max_dir_watches = new_size;
-            }
-            
-            config->dir_watches[config->dir_watch_count].path = strdup(path);
-            config->dir_watches[config->dir_watch_count].wd = wd;
-            config->dir_watch_count++;
-            
+static void on_command_exit(launcher *l, int status, void *ctx) {
+    (void)l;
+    (void)status;
+    start_pending(ctx);
+}
+
+static void on_interval_timer(int fd, uint32_t events, void *data) {
+    (void)events;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    start_pending(data);
+}
+
+// Apply the --on-busy policy to a trigger. Never blocks: a restart starts
+// once the old run has been reaped.
+static void request_command(sqwatch_config *config) {
+    launcher *l = &loop_state.commands;
+    if (l->running > 0) {
+        switch (config->on_busy) {
+        case BUSY_RESTART:
+            launcher_terminate(l);
+            break;
+        case BUSY_SKIP:
             if (config->verbose) {
-                printf(CYAN "+ Watch set for directory %s\n" RESET, path);
+                printf(DARK_GREY "+ Command still running, trigger skipped\n" RESET);
             }
+            return;
+        case BUSY_QUEUE_ONE:
+        case BUSY_PARALLEL:
+            if (config->verbose && l->running >= l->slots) {
+                printf(DARK_GREY "+ Command still running, %s\n" RESET,
+                       loop_state.spawn_pending ? "follow-up run already queued"
+                                                : "queued a follow-up run");
+            }
+            break;
         }
+    }
+    loop_state.spawn_pending = 1;
+    start_pending(config);
+}
 
-        // Recurse into directory contents
-        DIR *dir = opendir(path);
-        if (!dir) {
-            fprintf(stderr, RED "+ Failed to open directory %s: %s\n" RESET, path, strerror(errno));
-            return;
+const char *event_description(uint32_t mask) {
+    return mask & IN_MODIFY ? "Modified" :
+        mask & IN_CREATE ? "Created" :
+        mask & IN_DELETE ? "Deleted" :
+        mask & IN_MOVED_FROM ? "Moved from" :
+        mask & IN_MOVED_TO ? "Moved to" :
+        mask & IN_CLOSE_WRITE ? "Modified" :
+        mask & IN_CLOSE_NOWRITE ? "Closed" :
+        mask & IN_OPEN ? "Opened" :
+        mask & IN_ATTRIB ? "Attributes" :
+        mask & IN_DELETE_SELF ? "Self deleted" :
+        mask & IN_MOVE_SELF ? "Self moved" :
+        mask & IN_UNMOUNT ? "Unmounted" :
+        mask & IN_Q_OVERFLOW ? "Queue overflow" :
+        mask & IN_IGNORED ? "Watch removed" : "Unknown";
+}
+
+// Diff worker body. The report is rendered into a private buffer and
+// written in one go, so reports for different files never interleave.
+static void diff_job(const char *path, uint32_t mask, void *ctx) {
+    sqwatch_config *config = ctx;
+    char *report = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&report, &length);
+    if (!out) {
+        perror("open_memstream");
+        return;
+    }
+    diff_event event = {path, "Modified", mask};
+    diff_summary summary;
+    run_diff(out, &event, &config->snapshots, &config->versions,
+             1, // diff is always verbose
+             &config->log, &summary);
+    fclose(out);
+    if (summary.compared) {
+        journal_append(loop_state.journal, path, mask,
+                       summary.binary ? JOURNAL_DIFF_BINARY : JOURNAL_DIFF_TEXT,
+                       (uint32_t)summary.changed, summary.size);
+    }
+    if (length > 0) {
+        fwrite(report, 1, length, stdout);
+        fflush(stdout);
+    }
+    free(report);
+}
+
+// Run the trigger/diff pipeline for everything held back by the debouncer:
+// one command run per burst, one trigger and at most one diff per path.
+static void fire_pending(sqwatch_config *config) {
+    coalesce_table *pending = &loop_state.pending;
+    if (pending->count == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < pending->count; i++) {
+        coalesced_event *event = &pending->events[i];
+        if (event->mask & ~IN_IGNORED) {
+            printf(CYAN "+ Trigger on %s: [ %s ]\n" RESET, 
+                event->path, event_description(event->mask));
         }
+    }
 
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
+    if (config->command != NULL) {
+        request_command(config);
+    }
+
+    if (cache_dir && config->diff_enabled) {
+        for (size_t i = 0; i < pending->count; i++) {
+            coalesced_event *event = &pending->events[i];
+            if (event->mask & (IN_MODIFY | IN_IGNORED)) {
+                diffpool_submit(&loop_state.diffs, event->path, event->mask);
             }
+        }
+    }
+    coalesce_clear(pending);
+}
 
-            char full_path[PATH_MAX];
-            snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-            add_watches_recursive(inotify_fd, full_path, flags, config);
+// Point the debounce timerfd at the scheduler's next deadline
+static void schedule_debounce(void) {
+    uint64_t deadline = debounce_deadline(&loop_state.debounce);
+    if (deadline == 0) {
+        reactor_timer_disarm(loop_state.debounce_timer_fd);
+        return;
+    }
+    uint64_t now = debounce_now_ns();
+    reactor_timer_arm(loop_state.debounce_timer_fd, deadline > now ? deadline - now : 0);
+}
+
+static void on_debounce_timer(int fd, uint32_t events, void *data) {
+    (void)events;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    if (debounce_expire(&loop_state.debounce, debounce_now_ns())) {
+        fire_pending(data);
+    }
+    schedule_debounce();
+}
+
+// Shared trigger/diff pipeline for every backend. Events are merged per
+// path and only acted on once the whole read batch has been consumed.
+static void dispatch_event(const char *path, uint32_t mask) {
+    journal_append(loop_state.journal, path, mask, JOURNAL_EVENT, 0, 0);
+    if (coalesce_add(&loop_state.pending, path, mask) < 0) {
+        fprintf(stderr, RED "+ Failed to allocate memory for pending events\n" RESET);
+        return;
+    }
+    if (debounce_event(&loop_state.debounce, debounce_now_ns())) {
+        loop_state.fire_after_batch = 1;
+    }
+}
+
+// fanotify reports every change on the filesystem; resolve each to a path
+// under the watched roots and feed it to the same pipeline as inotify.
+static void handle_fanotify_events(sqwatch_config *config, char *buffer,
+                                   ssize_t length) {
+    struct fanotify_event_metadata *meta = (struct fanotify_event_metadata *)buffer;
+
+    for (; FAN_EVENT_OK(meta, length); meta = FAN_EVENT_NEXT(meta, length)) {
+        if (meta->fd >= 0) {
+            close(meta->fd);
         }
-        closedir(dir);
-    } else if (S_ISREG(path_stat.st_mode)) {
-        // Regular file handling remains unchanged
-        int wd = add_watch(inotify_fd, path, flags);
-        if (wd != -1 && wd < MAX_PATHS) {
-            config->watch_paths[wd] = strdup(path);
-            config->path_count++;
-            if (config->verbose) {
-                printf(CYAN "+ Watch set for file %s\n" RESET, path);
-            }
+
+        uint32_t mask = fanwatch_event_mask(meta->mask);
+        if (mask & IN_Q_OVERFLOW) {
+            loop_state.overflowed = 1;
+            continue;
+        }
+        // Directories need no watches of their own under fanotify
+        if (mask & IN_ISDIR) {
+            continue;
         }
+
+        char full_path[PATH_MAX];
+        if (fanwatch_resolve(&config->fan, meta, full_path, sizeof(full_path)) != 0 ||
+            pathmatch_excluded(&config->filter, full_path, 0)) {
+            continue;
+        }
+        struct stat path_stat;
+        if (stat(full_path, &path_stat) == 0) {
+            metaindex_update(&config->meta, full_path, &path_stat);
+        } else {
+            metaindex_remove(&config->meta, full_path);
+        }
+        dispatch_event(full_path, mask);
     }
 }
 
-void handle_events(int inotify_fd, sqwatch_config config) {
-    char buffer[BUF_LEN];
-    time_t last_event = 0;
-    int events_since_last_run = 0;
-    char event_buffer[256] = "";
+static void handle_inotify_events(sqwatch_config *config, int inotify_fd,
+                                  char *buffer, ssize_t length) {
+    watch_registry *registry = &config->registry;
 
-    while (1) {
-        ssize_t length = read(inotify_fd, buffer, BUF_LEN);
-        if (length == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                continue;
-            }
-            perror("inotify read");
-            exit(EXIT_FAILURE);
+    int i = 0;
+    while (i < length) {
+        struct inotify_event *event = (struct inotify_event *)&buffer[i];
+
+        // The queue filled up and events were dropped (wd is -1)
+        if (event->mask & IN_Q_OVERFLOW) {
+            loop_state.overflowed = 1;
+            i += EVENT_SIZE + event->len;
+            continue;
         }
+        
+        // O(1) dispatch: find the watch this event belongs to
+        watch_entry *watch = registry_lookup(registry, event->wd);
 
-        time_t now = time(NULL);  // Add time_t now declaration
-        int i = 0;
-        while (i < length) {
-            struct inotify_event *event = (struct inotify_event *)&buffer[i];
+        if (watch && watch->is_dir && (event->mask & IN_CREATE)) {
+            char full_path[PATH_MAX];
+            snprintf(full_path, sizeof(full_path), "%s/%s", watch->path, event->name);
             
-            // Check if this is a directory watch event
-            int is_dir_watch = 0;
-            char *dir_path = NULL;
-            for (int d = 0; d < config.dir_watch_count; d++) {
-                if (config.dir_watches[d].wd == event->wd) {
-                    is_dir_watch = 1;
-                    dir_path = config.dir_watches[d].path;
-                    break;
+            struct stat path_stat;
+            // Filtered paths are never watched, so never reported either
+            if (!pathmatch_excluded(&config->filter, full_path, (event->mask & IN_ISDIR) != 0) &&
+                stat(full_path, &path_stat) == 0) {
+                if (S_ISREG(path_stat.st_mode)) {
+                    // New file created - add watch
+                    int new_wd = add_watch(inotify_fd, full_path, config->flags);
+                    watch_entry *file = NULL;
+                    if (new_wd != -1) {
+                        file = registry_add(registry, new_wd, full_path, 0);
+                    }
+                    if (file) {
+                        metaindex_update(&config->meta, full_path, &path_stat);
+                        if (config->diff_enabled && cache_dir) {
+                            create_cache_for_file(&config->snapshots, full_path, config->verbose);
+                        }
+                        
+                        if (config->verbose) {
+                            printf(CYAN "+ Added watch for new file: %s\n" RESET, full_path);
+                        }
+                    }
+                } else if (S_ISDIR(path_stat.st_mode)) {
+                    // New directory created - add recursive watches
+                    add_watches_recursive(inotify_fd, full_path, config->flags, config);
                 }
             }
+        } else if (watch && !watch->is_dir) {
+            char full_path[PATH_MAX];
+            int event_wd = event->wd;
+            
+            if (event->len > 0) {
+                snprintf(full_path, sizeof(full_path), "%s/%s", 
+                        watch->path, event->name);
+            } else {
+                snprintf(full_path, sizeof(full_path), "%s", watch->path);
+            }
 
-            if (is_dir_watch && (event->mask & IN_CREATE)) {
-                char full_path[PATH_MAX];
-                snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, event->name);
-                
-                struct stat path_stat;
-                if (stat(full_path, &path_stat) == 0) {
-                    if (S_ISREG(path_stat.st_mode)) {
-                        // New file created - add watch
-                        int new_wd = add_watch(inotify_fd, full_path, config.flags);
-                        if (new_wd != -1 && new_wd < MAX_PATHS) {
-                            // Free any existing path at this watch descriptor
-                            if (config.watch_paths[new_wd]) {
-                                free(config.watch_paths[new_wd]);
-                            }
-                            config.watch_paths[new_wd] = strdup(full_path);
-                            
-                            // Free any existing cache path before creating new one
-                            if (config.cached_paths[new_wd]) {
-                                free(config.cached_paths[new_wd]);
-                                config.cached_paths[new_wd] = NULL;
-                            }
-                            
-                            if (config.diff_enabled && cache_dir) {
-                                create_cache_for_file(full_path, cache_dir, &config.cached_paths[new_wd], config.verbose);
-                            }
-                            
-                            if (config.verbose) {
-                                printf(CYAN "+ Added watch for new file: %s\n" RESET, full_path);
-                            }
-                        }
-                    } else if (S_ISDIR(path_stat.st_mode)) {
-                        // New directory created - add recursive watches
-                        add_watches_recursive(inotify_fd, full_path, config.flags, &config);
-                    }
+            // Check if file still exists for any event
+            struct stat path_stat;
+            if (stat(full_path, &path_stat) != 0) {
+                if (config->verbose) {
+                    printf(DARK_GREY "+ File no longer exists: %s\n" RESET, full_path);
                 }
-            } else if (!is_dir_watch && event->wd < MAX_PATHS && config.watch_paths[event->wd]) {
-                char full_path[PATH_MAX];
-                int watch_updated = 0;
-                int event_wd = event->wd;
-                
-                if (event->len > 0) {
-                    snprintf(full_path, sizeof(full_path), "%s/%s", 
-                            config.watch_paths[event_wd], event->name);
-                } else {
-                    strncpy(full_path, config.watch_paths[event_wd], PATH_MAX - 1);
+                // Drop the snapshot; its object goes once no path shares it
+                if (config->diff_enabled && cache_dir) {
+                    if (config->verbose) {
+                        printf(DARK_GREY "+ Removing cache for: %s\n" RESET, full_path);
+                    }
+                    snapshot_forget(&config->snapshots, full_path);
                 }
+                // Clean up watch entry
+                registry_remove(registry, event->wd);
+                metaindex_remove(&config->meta, full_path);
+                i += EVENT_SIZE + event->len;
+                continue;
+            }
 
-                // Check if file still exists for any event
+            // IN_IGNORE is when text editors like helix save a file. 
+            // We need to reapply the watch to the file in case the file was not deleted.
+            if (event->mask & IN_IGNORED) {
                 struct stat path_stat;
-                if (stat(full_path, &path_stat) != 0) {
-                    if (config.verbose) {
-                        printf(DARK_GREY "+ File no longer exists: %s\n" RESET, full_path);
-                    }
-                    // Clean up watch path
-                    free(config.watch_paths[event->wd]);
-                    config.watch_paths[event->wd] = NULL;
+                if (stat(full_path, &path_stat) == 0) {  // File still exists
+                    int new_wd = add_watch(inotify_fd, full_path, config->flags);
                     
-                    // Clean up cache path
-                    if (config.cached_paths && config.cached_paths[event->wd]) {
-                        if (config.verbose) {
-                            printf(DARK_GREY "+ Removing cache for: %s\n" RESET, config.cached_paths[event->wd]);
+                    if (new_wd != -1) {
+                        // Snapshots are indexed by path, so they carry over
+                        if (event_wd != new_wd) {
+                            registry_remove(registry, event_wd);
                         }
-                        unlink(config.cached_paths[event->wd]); // Remove cache file
-                        free(config.cached_paths[event->wd]);
-                        config.cached_paths[event->wd] = NULL;
-                    }
-                    i += EVENT_SIZE + event->len;
-                    continue;
-                }
+                        registry_add(registry, new_wd, full_path, 0);
 
-                // IN_IGNORE is when text editors like helix save a file. 
-                // We need to reapply the watch to the file in case the file was not deleted.
-                if (event->mask & IN_IGNORED) {
-                    watch_updated = 1;
-                    struct stat path_stat;
-                    if (stat(full_path, &path_stat) == 0) {  // File still exists
-                        int new_wd = add_watch(inotify_fd, full_path, config.flags);
-                        
-                        if (new_wd != -1 && new_wd < MAX_PATHS) {
-                            // Free old path if it exists at new_wd
-                            if (config.watch_paths[new_wd]) {
-                                free(config.watch_paths[new_wd]);
-                            }
-                            config.watch_paths[new_wd] = strdup(full_path);
-                            if (event_wd != new_wd) {
-                                config.cached_paths[new_wd] = config.cached_paths[event_wd];
-                                config.cached_paths[event_wd] = NULL;
-                            }
-
-                            if (config.verbose) {
-                                printf(DARK_GREY "+ Reapplied watch for %s\n" RESET, full_path);
-                            }
-                            event_wd = new_wd;
+                        if (config->verbose) {
+                            printf(DARK_GREY "+ Reapplied watch for %s\n" RESET, full_path);
                         }
-                    } else {
-                        if (config.verbose) {
-                            printf(DARK_GREY "+ File no longer exists: %s\n" RESET, full_path);
-                        }
-                        // Clean up the old watch path
-                        free(config.watch_paths[event->wd]);
-                        config.watch_paths[event->wd] = NULL;
+                        event_wd = new_wd;
+                    }
+                } else {
+                    if (config->verbose) {
+                        printf(DARK_GREY "+ File no longer exists: %s\n" RESET, full_path);
                     }
+                    // Clean up the old watch entry
+                    registry_remove(registry, event->wd);
                 }
+            }
 
-                // Handle the event as before
-                char event_desc[32];
-                snprintf(event_desc, sizeof(event_desc), "%s", 
-                    event->mask & IN_MODIFY ? "Modified" :
-                    event->mask & IN_CREATE ? "Created" :
-                    event->mask & IN_DELETE ? "Deleted" :
-                    event->mask & IN_MOVED_FROM ? "Moved from" :
-                    event->mask & IN_MOVED_TO ? "Moved to" :
-                    event->mask & IN_CLOSE_WRITE ? "Modified" :
-                    event->mask & IN_CLOSE_NOWRITE ? "Closed" :
-                    event->mask & IN_OPEN ? "Opened" :
-                    event->mask & IN_ATTRIB ? "Attributes" :
-                    event->mask & IN_DELETE_SELF ? "Self deleted" :
-                    event->mask & IN_MOVE_SELF ? "Self moved" :
-                    event->mask & IN_UNMOUNT ? "Unmounted" :
-                    event->mask & IN_Q_OVERFLOW ? "Queue overflow" :
-                    event->mask & IN_IGNORED ? "Watch removed" : "Unknown");
-
-                if (now - last_event >= config.debounce_t || watch_updated) {
-                    // Properly terminate any existing process group
-                    if (g_last_pid > 0) {
-                        // Send SIGTERM to the entire process group
-                        killpg(g_last_pid, SIGTERM);
-                        
-                        // Wait a short time for graceful termination
-                        struct timespec timeout = {0, 100000000}; // 100ms
-                        nanosleep(&timeout, NULL);
-                        
-                        // If process still exists, force kill
-                        if (kill(-g_last_pid, 0) == 0) {
-                            killpg(g_last_pid, SIGKILL);
-                        }
-                        
-                        // Wait for the process group to finish
-                        while (waitpid(-g_last_pid, NULL, 0) > 0) {
-                            // Continue waiting for all children
-                        }
-                        
-                        g_last_pid = 0;
-                    }
-                    
-                    if (!(event->mask & IN_IGNORED)) {
-                        printf(CYAN "+ Trigger on %s: [ %s ]\n" RESET, 
-                            config.watch_paths[event_wd], event_desc);
-                    }
+            metaindex_update(&config->meta, full_path, &path_stat);
+            dispatch_event(full_path, event->mask);
+        }
 
-                    if (config.command != NULL) {
-                        g_last_pid = fork();
-                        if (g_last_pid == -1) {
-                            perror("fork");
-                            exit(EXIT_FAILURE);
-                        }
+        i += EVENT_SIZE + event->len;
+    }
+}
 
-                        if (g_last_pid == 0) {
-                            // Child process
-                            setpgid(0, 0);  // Create new process group
-                            setvbuf(stdout, NULL, _IONBF, 0);
-                            setvbuf(stderr, NULL, _IONBF, 0);
-                            char *const args[] = {"/bin/sh", "-c", (char *)config.command, NULL};
-                            execve("/bin/sh", args, environ);
-                            perror("execve");
-                            exit(EXIT_FAILURE);
-                        }
+// Events were dropped somewhere; find out what changed by rescanning
+static void recover_overflow(sqwatch_config *config) {
+    loop_state.overflowed = 0;
+    printf(RED "+ Event queue overflow, rescanning watched paths\n" RESET);
 
-                        // Parent continues without waiting
-                    }
-                    
-                    if (cache_dir && config.diff_enabled) {
-                        if (event->mask & (IN_MODIFY | IN_IGNORED)) {
-                            char event_desc[256];
-                            snprintf(event_desc, sizeof(event_desc), "Modified");
-                            
-                            run_diff(config.watch_paths[event_wd], 
-                                cache_dir,
-                                event_desc,
-                                1, // diff is always verbose
-                                config.log_file);
-                        }
+    reconcile_stats stats;
+    reconcile_tree(config->use_fanotify ? -1 : loop_state.inotify_fd, config,
+                   dispatch_event, &stats);
+    printf(DARK_GREY "+ Rescan: %llu created, %llu modified, %llu deleted, "
+                     "%llu watches restored in %.1fms\n" RESET,
+           (unsigned long long)stats.created, (unsigned long long)stats.modified,
+           (unsigned long long)stats.deleted, (unsigned long long)stats.watches,
+           stats.elapsed_ns / 1e6);
+}
 
-                    }
+static void on_watch_readable(int fd, uint32_t events, void *data) {
+    (void)events;
+    sqwatch_config *config = data;
+    char buffer[BUF_LEN] __attribute__((aligned(8)));
 
-                    last_event = now;
-                } else {
-                    if (event_buffer[0] != '\0') {
-                        strncat(event_buffer, ", ", sizeof(event_buffer) - strlen(event_buffer) - 1);
-                    }
-                    strncat(event_buffer, event_desc, sizeof(event_buffer) - strlen(event_buffer) - 1);
-                    events_since_last_run++;
-                }
-            }
+    ssize_t length = read(fd, buffer, BUF_LEN);
+    if (length == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return;
+        }
+        perror(config->use_fanotify ? "fanotify read" : "inotify read");
+        exit(EXIT_FAILURE);
+    }
 
-            i += EVENT_SIZE + event->len;
+    if (config->use_fanotify) {
+        handle_fanotify_events(config, buffer, length);
+    } else {
+        handle_inotify_events(config, loop_state.inotify_fd, buffer, length);
+    }
+
+    if (loop_state.overflowed) {
+        recover_overflow(config);
+    }
+
+    if (loop_state.fire_after_batch) {
+        loop_state.fire_after_batch = 0;
+        fire_pending(config);
+    }
+    schedule_debounce();
+}
+
+static void on_flush_timer(int fd, uint32_t events, void *data) {
+    (void)events;
+    sqwatch_config *config = data;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    log_flush(&config->log);
+    journal_flush(&config->journal);
+    reactor_timer_arm(fd, FLUSH_NS);
+}
+
+static void on_index_timer(int fd, uint32_t events, void *data) {
+    (void)events;
+    sqwatch_config *config = data;
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) < 0) {
+        return;
+    }
+    if (config->meta.changes != loop_state.saved_changes &&
+        metastore_save(config->index_path, &config->meta, &config->snapshots) == 0) {
+        loop_state.saved_changes = config->meta.changes;
+    }
+    reactor_timer_arm(fd, INDEX_CHECKPOINT_NS);
+}
+
+// Report what changed while sqwatch was not running, through the same
+// pipeline as live events
+static void replay_offline_changes(sqwatch_config *config) {
+    reconcile_stats stats;
+    reconcile_offline(config, &config->saved, dispatch_event, &stats);
+    metaindex_free(&config->saved);
+    printf(DARK_GREY "+ Changed since last run: %llu created, %llu modified, "
+                     "%llu deleted (%.1fms)\n" RESET,
+           (unsigned long long)stats.created, (unsigned long long)stats.modified,
+           (unsigned long long)stats.deleted, stats.elapsed_ns / 1e6);
+
+    if (loop_state.fire_after_batch) {
+        loop_state.fire_after_batch = 0;
+        fire_pending(config);
+    }
+    schedule_debounce();
+}
+
+static void on_signal(int fd, uint32_t events, void *data) {
+    (void)events;
+    struct signalfd_siginfo info;
+    if (read(fd, &info, sizeof(info)) != sizeof(info)) {
+        return;
+    }
+    if (info.ssi_signo == SIGCHLD) {
+        // Fallback for kernels without pidfd support
+        sqwatch_config *config = data;
+        if (config->command) {
+            launcher_reap(&loop_state.commands);
+        }
+        return;
+    }
+    reactor_stop(&loop_state.loop, info.ssi_signo);
+}
+
+// Runs the epoll reactor until SIGINT/SIGTERM; returns the signal received
+int handle_events(int inotify_fd, sqwatch_config *config) {
+    loop_state.inotify_fd = inotify_fd;
+    debounce_init(&loop_state.debounce, config->debounce_mode,
+                  config->debounce_ns, config->max_wait_ns);
+    loop_state.watch_fd = config->use_fanotify ? config->fan.fd : inotify_fd;
+
+    // Signals are consumed synchronously through a signalfd
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGCHLD);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        perror("sigprocmask");
+        exit(EXIT_FAILURE);
+    }
+
+    if (reactor_init(&loop_state.loop) != 0 || coalesce_init(&loop_state.pending) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    loop_state.signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    loop_state.debounce_timer_fd = reactor_timer_create();
+    if (loop_state.signal_fd == -1 || loop_state.debounce_timer_fd == -1) {
+        perror("Failed to set up event loop");
+        exit(EXIT_FAILURE);
+    }
+
+    fcntl(loop_state.watch_fd, F_SETFL,
+          fcntl(loop_state.watch_fd, F_GETFL) | O_NONBLOCK);
+    if (reactor_add(&loop_state.loop, loop_state.watch_fd, EPOLLIN, on_watch_readable, config) != 0 ||
+        reactor_add(&loop_state.loop, loop_state.signal_fd, EPOLLIN, on_signal, config) != 0 ||
+        reactor_add(&loop_state.loop, loop_state.debounce_timer_fd, EPOLLIN, on_debounce_timer, config) != 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (config->journal.dir) {
+        loop_state.journal = &config->journal;
+    }
+    if (config->log.path || config->journal.dir) {
+        loop_state.flush_timer_fd = reactor_timer_create();
+        if (loop_state.flush_timer_fd == -1 ||
+            reactor_add(&loop_state.loop, loop_state.flush_timer_fd, EPOLLIN, on_flush_timer, config) != 0) {
+            perror("Failed to set up log flushing");
+            exit(EXIT_FAILURE);
         }
+        reactor_timer_arm(loop_state.flush_timer_fd, FLUSH_NS);
+    }
+
+    if (config->command) {
+        loop_state.interval_timer_fd = reactor_timer_create();
+        if (loop_state.interval_timer_fd == -1 ||
+            reactor_add(&loop_state.loop, loop_state.interval_timer_fd, EPOLLIN, on_interval_timer, config) != 0 ||
+            launcher_init(&loop_state.commands, &loop_state.loop, config->command,
+                          config->command_slots, KILL_GRACE_NS, on_command_exit, config) != 0) {
+            perror("Failed to set up the command launcher");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (cache_dir && config->diff_enabled) {
+        if (diffpool_start(&loop_state.diffs, config->diff_workers,
+                           DIFF_QUEUE_CAPACITY, diff_job, config) != 0) {
+            fprintf(stderr, RED "Failed to start diff workers\n" RESET);
+            exit(EXIT_FAILURE);
+        }
+        if (config->verbose) {
+            printf(DARK_GREY "+ Diff workers: %d\n" RESET, loop_state.diffs.thread_count);
+        }
+    }
+
+    if (config->index_path) {
+        loop_state.saved_changes = config->meta.changes;
+        loop_state.index_timer_fd = reactor_timer_create();
+        if (loop_state.index_timer_fd == -1 ||
+            reactor_add(&loop_state.loop, loop_state.index_timer_fd, EPOLLIN, on_index_timer, config) != 0) {
+            perror("Failed to set up index checkpoints");
+            exit(EXIT_FAILURE);
+        }
+        reactor_timer_arm(loop_state.index_timer_fd, INDEX_CHECKPOINT_NS);
+        if (config->saved.slots) {
+            replay_offline_changes(config);
+        }
+    }
+
+    int signo = reactor_run(&loop_state.loop);
+
+    // In-flight diffs finish before the cache is wiped; queued ones are dropped
+    diffpool_stop(&loop_state.diffs);
+    log_flush(&config->log);
+    journal_flush(&config->journal);
+
+    // The running command gets the same signal and is waited for
+    if (config->command) {
+        launcher_shutdown(&loop_state.commands, signo > 0 ? signo : SIGTERM);
+    }
+
+    reactor_close(&loop_state.loop);
+    close(loop_state.signal_fd);
+    close(loop_state.debounce_timer_fd);
+    if (loop_state.flush_timer_fd != -1) {
+        close(loop_state.flush_timer_fd);
+    }
+    if (loop_state.interval_timer_fd != -1) {
+        close(loop_state.interval_timer_fd);
+    }
+    if (loop_state.index_timer_fd != -1) {
+        close(loop_state.index_timer_fd);
     }
+    coalesce_free(&loop_state.pending);
+    return signo > 0 ? signo : SIGTERM;
 }
 
 void print_usage(void) {
-    printf("Usage: sqwatch [-d directory] [-f file] [-t debounce time] -q event [-c command] [--diff] [-l log_file]\n");
+    printf("Usage: sqwatch [-d directory] [-f file] [-m directory] [-t debounce time] -q event [-c command] [--diff] [-l log_file]\n");
     printf("Options:\n");
     printf("  -d directory      Directory to watch\n");
     printf("  -f file           File to watch\n");
+    printf("  -m directory      Directory to watch through a single fanotify mark (no per-directory\n");
+    printf("                    watches; needs CAP_SYS_ADMIN and Linux 5.9+, cannot be mixed with -d/-f)\n");
     printf("  -q event          Event type to watch\n");
     printf("                     all: all events\n");
     printf("                     modify: file modifications\n");
@@ -378,10 +685,54 @@ void print_usage(void) {
     printf("                     delete: file deletion\n");
     printf("                     move: file moves\n");
     printf("                     attrib: attribute changes\n");
-    printf("  -t debounce time  (Optional) Time (in seconds) after trigger to ignore events\n");
+    printf("  -t debounce time  (Optional) Debounce window, e.g. 50ms, 250us, 1s (bare number = seconds,\n");
+    printf("                    default: 1s, 0 disables)\n");
+    printf("  --debounce-mode mode\n");
+    printf("                    (Optional) trailing: fire once the burst is quiet (default)\n");
+    printf("                               leading: fire on the first event and once after the burst\n");
+    printf("                               max-wait: trailing, but fire at least every --max-wait\n");
+    printf("  --max-wait time   (Optional) Longest a burst may be held back (default for max-wait: 10x the window)\n");
+    printf("  --include glob    (Optional, repeatable) Only watch files matching glob (.gitignore syntax,\n");
+    printf("                    relative to each watched path, e.g. '*.c' or 'src/**/*.h')\n");
+    printf("  --exclude glob    (Optional, repeatable) Never watch paths matching glob; an excluded\n");
+    printf("                    directory is skipped with everything below it\n");
+    printf("  --gitignore       (Optional) Also exclude what .gitignore files (and .git/) exclude\n");
+    printf("  --scan-threads n  (Optional) Threads used for the initial directory scan (default: CPU count)\n");
+    printf("  --diff-workers n  (Optional) Threads computing diffs off the event loop (default: CPU count, max 8)\n");
+    printf("  --max-queued-events n\n");
+    printf("                    (Optional) Warn at startup if the kernel event queue is shorter than n\n");
+    printf("                    (default: twice the watch count, at least 16384). An overflow is\n");
+    printf("                    recovered by rescanning the watched paths\n");
     printf("  -c command        (Optional) Command to execute when events are detected\n");
+    printf("  --on-busy policy  (Optional) What a trigger does while the command is still running\n");
+    printf("                               restart: terminate it and run again (default)\n");
+    printf("                               queue-one: let it finish, then run once more\n");
+    printf("                               skip: ignore the trigger\n");
+    printf("                               parallel[:N]: run up to N at once (default 2), then queue one\n");
+    printf("  --min-interval time\n");
+    printf("                    (Optional) Least time between two runs starting, e.g. 2s (default: 0)\n");
     printf("  --diff            Enable diff functionality to show file changes\n");
     printf("  -l log_file       (Optional) Log file to write changes to (requires --diff)\n");
+    printf("  --log-format fmt  (Optional) text (default) or jsonl: one JSON object per change with\n");
+    printf("                    ts_ns, path, event, mask and hunks (or regions for binary files)\n");
+    printf("  --log-max-size n  (Optional) Rotate the log once it reaches n bytes (K/M/G suffixes)\n");
+    printf("  --log-keep n      (Optional) Rotated logs kept as log_file.1 ... log_file.n (default: 5)\n");
+    printf("  --journal dir     (Optional) Record every event (and diff, with --diff) in a binary\n");
+    printf("                    journal; query it with: sqwatch journal dir [--since t] [--until t]\n");
+    printf("                    [--under path] (see sqwatch journal -h)\n");
+    printf("  --lazy-cache      (Optional) With --diff, start watching at once and snapshot files in the\n");
+    printf("                    background, most recently modified first\n");
+    printf("  --cache-budget n  (Optional) Disk space for snapshots (K/M/G suffixes); the least recently\n");
+    printf("                    changed files are evicted beyond it and re-snapshotted on their next change\n");
+    printf("  --version-cache n (Optional) Memory for parsed recent file versions, so the old side of a\n");
+    printf("                    diff is rarely read back from disk (K/M/G suffixes, default: 64M, 0 disables)\n");
+    printf("  --snapshot-codec c\n");
+    printf("                    (Optional) How snapshots are stored: lz (built-in, default), none (plain\n");
+    printf("                    copies) or zstd (when built with ZSTD=1). Files of 1M and up are always\n");
+    printf("                    kept as plain copies, reflinked or copied in-kernel where possible\n");
+    printf("  --index file      (Optional) Keep the metadata index in file across runs: changes made while\n");
+    printf("                    sqwatch was not running are reported at startup, and with --diff the\n");
+    printf("                    cache is kept and reused instead of being wiped on exit\n");
     printf("  -v                (Optional) Use verbose output (does not affect command output)\n");
     printf("  -h                Display this help message\n");
     printf("\nExamples:\n");
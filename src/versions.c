@@ -0,0 +1,201 @@
+#include "versions.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_BUCKETS 256
+
+static size_t bucket_of(const version_cache *cache, snapshot_digest digest) {
+  return hash_mix(digest.hash ^ digest.size, 0x9e3779b97f4a7c15ULL) &
+         (cache->bucket_count - 1);
+}
+
+int versions_init(version_cache *cache, uint64_t budget) {
+  memset(cache, 0, sizeof(*cache));
+  cache->budget = budget;
+  if (budget == 0) {
+    return 0;
+  }
+  cache->buckets = calloc(INITIAL_BUCKETS, sizeof(version_entry *));
+  if (!cache->buckets) {
+    return -1;
+  }
+  cache->bucket_count = INITIAL_BUCKETS;
+  pthread_mutex_init(&cache->lock, NULL);
+  return 0;
+}
+
+void versions_free(version_cache *cache) {
+  if (!cache->buckets) {
+    return;
+  }
+  version_entry *entry = cache->newest;
+  while (entry) {
+    version_entry *older = entry->older;
+    free(entry);
+    entry = older;
+  }
+  free(cache->buckets);
+  pthread_mutex_destroy(&cache->lock);
+  memset(cache, 0, sizeof(*cache));
+}
+
+static void lru_unlink(version_cache *cache, version_entry *entry) {
+  if (entry->newer) {
+    entry->newer->older = entry->older;
+  } else {
+    cache->newest = entry->older;
+  }
+  if (entry->older) {
+    entry->older->newer = entry->newer;
+  } else {
+    cache->oldest = entry->newer;
+  }
+  entry->newer = entry->older = NULL;
+}
+
+static void lru_push(version_cache *cache, version_entry *entry) {
+  entry->older = cache->newest;
+  entry->newer = NULL;
+  if (cache->newest) {
+    cache->newest->newer = entry;
+  } else {
+    cache->oldest = entry;
+  }
+  cache->newest = entry;
+}
+
+static version_entry **find(version_cache *cache, snapshot_digest digest) {
+  version_entry **link = &cache->buckets[bucket_of(cache, digest)];
+  while (*link && !snapshot_digest_equal((*link)->digest, digest)) {
+    link = &(*link)->chain;
+  }
+  return link;
+}
+
+static void grow(version_cache *cache) {
+  size_t count = cache->bucket_count * 2;
+  version_entry **buckets = calloc(count, sizeof(version_entry *));
+  if (!buckets) {
+    return;
+  }
+  version_entry **old = cache->buckets;
+  size_t old_count = cache->bucket_count;
+  cache->buckets = buckets;
+  cache->bucket_count = count;
+  for (size_t i = 0; i < old_count; i++) {
+    version_entry *entry = old[i];
+    while (entry) {
+      version_entry *next = entry->chain;
+      size_t b = bucket_of(cache, entry->digest);
+      entry->chain = buckets[b];
+      buckets[b] = entry;
+      entry = next;
+    }
+  }
+  free(old);
+}
+
+// Take entry out of the table and drop the cache's reference; borrowers
+// keep it alive until they release it
+static void evict(version_cache *cache, version_entry *entry) {
+  *find(cache, entry->digest) = entry->chain;
+  lru_unlink(cache, entry);
+  cache->count--;
+  cache->bytes -= entry->bytes;
+  if (--entry->refs == 0) {
+    free(entry);
+  }
+}
+
+// Borrow the parsed version with this digest, or NULL. Release it with
+// versions_release().
+version_entry *versions_get(version_cache *cache, snapshot_digest digest) {
+  if (!cache || !cache->buckets) {
+    return NULL;
+  }
+  pthread_mutex_lock(&cache->lock);
+  version_entry *entry = *find(cache, digest);
+  if (entry) {
+    lru_unlink(cache, entry);
+    lru_push(cache, entry);
+    entry->refs++;
+    cache->hits++;
+  } else {
+    cache->misses++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return entry;
+}
+
+void versions_release(version_cache *cache, version_entry *entry) {
+  pthread_mutex_lock(&cache->lock);
+  int last = --entry->refs == 0;
+  pthread_mutex_unlock(&cache->lock);
+  if (last) {
+    free(entry);
+  }
+}
+
+// Copy a parsed version into the cache, evicting the least recently used
+// ones to stay within budget. Versions larger than the budget are skipped.
+void versions_put(version_cache *cache, snapshot_digest digest,
+                  const char *data, size_t size, const line_view *lines,
+                  const uint64_t *hashes, int count) {
+  if (!cache || !cache->buckets) {
+    return;
+  }
+  size_t header = (sizeof(version_entry) + 7) & ~(size_t)7;
+  size_t lines_at = header;
+  size_t hashes_at = lines_at + (size_t)count * sizeof(line_view);
+  size_t data_at = hashes_at + (size_t)count * sizeof(uint64_t);
+  size_t bytes = data_at + size;
+  if (bytes > cache->budget) {
+    return;
+  }
+
+  // Build it outside the lock; most of the cost is the copy
+  char *block = malloc(bytes);
+  if (!block) {
+    return;
+  }
+  version_entry *entry = (version_entry *)block;
+  memset(entry, 0, sizeof(*entry));
+  entry->digest = digest;
+  entry->bytes = bytes;
+  entry->refs = 1;
+  entry->size = size;
+  entry->count = count;
+  entry->data = block + data_at;
+  if (count > 0) {
+    entry->lines = (line_view *)(block + lines_at);
+    entry->hashes = (uint64_t *)(block + hashes_at);
+    memcpy(entry->lines, lines, (size_t)count * sizeof(line_view));
+    memcpy(entry->hashes, hashes, (size_t)count * sizeof(uint64_t));
+  }
+  if (size > 0) {
+    memcpy(entry->data, data, size);
+  }
+
+  pthread_mutex_lock(&cache->lock);
+  version_entry **link = find(cache, digest);
+  if (*link) {
+    // Same content already cached (another path, or a racing worker)
+    pthread_mutex_unlock(&cache->lock);
+    free(block);
+    return;
+  }
+  while (cache->oldest && cache->bytes + bytes > cache->budget) {
+    evict(cache, cache->oldest);
+    cache->evictions++;
+  }
+  link = find(cache, digest);
+  *link = entry;
+  lru_push(cache, entry);
+  cache->count++;
+  cache->bytes += bytes;
+  if (cache->count > cache->bucket_count) {
+    grow(cache);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}